@@ -20,7 +20,7 @@ class Bench:
     def __init__(self, name, dir, ins, runs=None, dbg=None,
             bflags=None, xflags=None, sbtflags=[], mflags=None,
             srcdir=None, dstdir=None, narchs=None, xarchs=None,
-            cc=None, rvcc=None, rv32=None):
+            cc=None, rvcc=None, rv32=None, modes=None):
         self.name = name
         self.dir = dir
         self.ins = ins
@@ -29,6 +29,11 @@ class Bench:
         self.sbtflags = sbtflags
         self.dbg = dbg
         self.rv32 = rv32
+        self.modes = modes if modes else SBT.modes
+        # measure the selected modes only
+        if self.modes != SBT.modes:
+            mflags = (mflags if mflags else []) + \
+                ["-m", "native"] + self.modes
 
         xflags = cat(bflags, xflags)
         if dbg == "dbg":
@@ -49,7 +54,7 @@ class Bench:
         self.gm = GenMake(narchs, xarchs,
                 srcdir, dstdir, self.name,
                 xflags, bflags, mflags, self.sbtflags,
-                cc=cc, rvcc=rvcc)
+                cc=cc, rvcc=rvcc, modes=self.modes)
 
 
     def out_filter(self, of):
@@ -81,7 +86,7 @@ class Bench:
 
         # translations
         for xarch in self.xarchs:
-            for mode in SBT.modes:
+            for mode in self.modes:
                 (farch, narch) = xarch
                 am = ArchAndMode(farch, narch, mode)
                 (fin, fout) = self._gen_xinout(am)
@@ -93,7 +98,7 @@ class Bench:
         ams.extend(
             [ArchAndMode(farch, narch, mode)
             for (farch, narch) in self.xarchs
-            for mode in SBT.modes])
+            for mode in self.modes])
         return ams
 
 
@@ -191,6 +196,8 @@ class MiBench:
     def __init__(self, args):
         self.rv32 = args.rv32
         no_arm = args.no_arm
+        # translation modes (register modes by default)
+        self.modes = args.modes
 
         if GOPTS.rv32 == "rv8" or GOPTS.rv32 == "ovp":
             rv32 = RV32
@@ -260,7 +267,7 @@ arm-dstdir:
             bflags=bflags, xflags=xflags, sbtflags=sbtflags,
             narchs=self.narchs,
             xarchs=self.xarchs,
-            cc=cc, rvcc=rvcc, rv32=self.rv32,
+            cc=cc, rvcc=rvcc, rv32=self.rv32, modes=self.modes,
             **kwargs)
 
 
@@ -436,7 +443,8 @@ arm-dstdir:
         self._write()
 
     def _gen_csv_header(self):
-        return auto.measure.MiBench().header()
+        modes = ["native"] + self.modes if self.modes else None
+        return auto.measure.MiBench(modes).header()
 
     def _gen_epilogue(self):
         names = [b.name for b in self.benchs]
@@ -494,6 +502,10 @@ if __name__ == "__main__":
         help="exclude all ARM targets")
     parser.add_argument("--rv32", action="store_true",
         help="measure QEMU RV32 performance instead of that of translated bins")
+    parser.add_argument("--modes", type=str, nargs='+',
+        choices=SBT.all_modes(),
+        help="translation modes to build and measure "
+            "(default: all register modes)")
     args = parser.parse_args()
 
     mb = MiBench(args)
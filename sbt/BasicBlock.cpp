@@ -42,20 +42,11 @@ BasicBlock::~BasicBlock()
 template <typename M, typename K>
 static M splitMap(M& map, const K& key)
 {
-    M map2;
-
-    auto it = map.begin();
+    auto it = map.lower_bound(key);
     auto end = map.end();
-    for (; it != end; ++it)
-        if (it->first >= key)
-            break;
-
-    if (it == end)
-        return map2;
 
-    auto it2 = it;
-    for (; it2 != end; ++it2)
-        map2.insert(*it2);
+    // (building from a sorted range is linear)
+    M map2(it, end);
     map.erase(it, end);
     return map2;
 }
@@ -113,13 +113,18 @@ public:
     BasicBlockPtr split(uint64_t addr);
 
     // get basic block name from the specified address.
+    // (empty on release builds)
     static std::string getBBName(uint64_t addr)
     {
+#if SBT_DEBUG
         std::string name = "bb";
         llvm::raw_string_ostream ss(name);
         ss << llvm::Twine::utohexstr(addr);
         ss.flush();
         return name;
+#else
+        return "";
+#endif
     }
 
     /**
@@ -4,6 +4,7 @@
 #include "BasicBlock.h"
 #include "Context.h"
 #include "Function.h"
+#include "TBAA.h"
 #include "Types.h"
 #include "XRegister.h"
 
@@ -66,6 +67,7 @@ public:
     llvm::LoadInst* load(llvm::Value* ptr)
     {
         llvm::LoadInst* v = _builder->CreateLoad(ptr);
+        tagReg(v, ptr);
         updateFirst(v);
         return v;
     }
@@ -77,7 +79,8 @@ public:
         Register& x = _ctx->func->getReg(reg);
         DBGF("reg={0}", x.name());
         llvm::LoadInst* i = _builder->CreateLoad(
-                x.getForRead(), x.name() + "_");
+                x.getForRead(), IRNAME(x.name() + "_"));
+        tagReg(i, i->getPointerOperand());
         updateFirst(i);
         return i;
     }
@@ -86,34 +89,27 @@ public:
     llvm::StoreInst* store(llvm::Value* v, llvm::Value* ptr)
     {
         llvm::StoreInst* i = _builder->CreateStore(v, ptr);
+        tagReg(i, ptr);
         updateFirst(i);
         return i;
     }
 
     // store value in register
-    llvm::StoreInst* store(llvm::Value* v, unsigned reg, bool cfaSet=true)
+    llvm::StoreInst* store(llvm::Value* v, unsigned reg)
     {
         if (reg == XRegister::ZERO)
             return nullptr;
 
         xassert(_ctx->func);
 
-        if (cfaSet && reg == XRegister::SP)
-            _ctx->func->setCFAOffs(v);
-
         Register& x = _ctx->func->getReg(reg);
         llvm::StoreInst* i = _builder->CreateStore(v,
                 x.getForWrite(), !VOLATILE);
+        tagReg(i, i->getPointerOperand());
         updateFirst(i);
         return i;
     }
 
-    llvm::Value* getSpilledAddress(llvm::Constant* imm, Register::Type t)
-    {
-        xassert(_ctx->func);
-        return _ctx->func->getSpilledAddress(imm, t);
-    }
-
     // nop
     void nop()
     {
@@ -361,6 +357,13 @@ public:
         return v;
     }
 
+    llvm::Value* inBoundsGEP(llvm::Value* ptr, std::vector<llvm::Value*> idx)
+    {
+        llvm::Value* v = _builder->CreateInBoundsGEP(ptr, idx);
+        updateFirst(v);
+        return v;
+    }
+
     // call function
     llvm::Value* call(
         llvm::Function* f,
@@ -398,6 +401,22 @@ public:
         return v;
     }
 
+    // extract value from aggregate
+    llvm::Value* extractValue(llvm::Value* agg, unsigned idx)
+    {
+        llvm::Value* v = _builder->CreateExtractValue(agg, idx);
+        updateFirst(v);
+        return v;
+    }
+
+    // insert value in aggregate
+    llvm::Value* insertValue(llvm::Value* agg, llvm::Value* val, unsigned idx)
+    {
+        llvm::Value* v = _builder->CreateInsertValue(agg, val, idx);
+        updateFirst(v);
+        return v;
+    }
+
     // br
     llvm::Value* br(const BasicBlock& bb)
     {
@@ -421,6 +440,29 @@ public:
         return v;
     }
 
+    // select
+    llvm::Value* select(llvm::Value* cond, llvm::Value* t, llvm::Value* f)
+    {
+        llvm::Value* v = _builder->CreateSelect(cond, t, f);
+        updateFirst(v);
+        return v;
+    }
+
+    // vector elements
+    llvm::Value* extractElement(llvm::Value* vec, uint64_t i)
+    {
+        llvm::Value* v = _builder->CreateExtractElement(vec, i);
+        updateFirst(v);
+        return v;
+    }
+
+    llvm::Value* insertElement(llvm::Value* vec, llvm::Value* e, uint64_t i)
+    {
+        llvm::Value* v = _builder->CreateInsertElement(vec, e, i);
+        updateFirst(v);
+        return v;
+    }
+
     llvm::IndirectBrInst* indBr(llvm::Value* addr)
     {
         addr = bitOrPointerCast(addr, _t->i32ptr);
@@ -605,7 +647,8 @@ public:
         DBGF("reg={0}", f.name());
         llvm::Value* ptr = f.getForRead();
         ptr = fp64PtrToFP32Ptr(ptr);
-        llvm::LoadInst* i = _builder->CreateLoad(ptr, f.name() + "_");
+        llvm::LoadInst* i = _builder->CreateLoad(ptr, IRNAME(f.name() + "_"));
+        tagReg(i, ptr);
         updateFirst(i);
         return i;
     }
@@ -616,7 +659,8 @@ public:
         Register& f = _ctx->func->getFReg(reg);
         DBGF("reg={0}", f.name());
         llvm::LoadInst* i = _builder->CreateLoad(
-                f.getForRead(), f.name() + "_");
+                f.getForRead(), IRNAME(f.name() + "_"));
+        tagReg(i, i->getPointerOperand());
         updateFirst(i);
         return i;
     }
@@ -631,6 +675,7 @@ public:
         llvm::Value* ptr = f.getForWrite();
         ptr = fp64PtrToFP32Ptr(ptr);
         llvm::StoreInst* i = _builder->CreateStore(v, ptr, !VOLATILE);
+        tagReg(i, ptr);
         updateFirst(i);
         return i;
     }
@@ -642,6 +687,7 @@ public:
         Register& f = _ctx->func->getFReg(reg);
         llvm::StoreInst* i = _builder->CreateStore(v,
                 f.getForWrite(), !VOLATILE);
+        tagReg(i, i->getPointerOperand());
         updateFirst(i);
         return i;
     }
@@ -858,6 +904,13 @@ private:
         if (!_first && _updateFirst)
             _first = llvm::dyn_cast<llvm::Instruction>(v);
     }
+
+    // set alias analysis metadata of global register load/store
+    void tagReg(llvm::Instruction* i, llvm::Value* ptr)
+    {
+        if (_ctx->tbaa)
+            _ctx->tbaa->tagReg(i, ptr);
+    }
 };
 
 }
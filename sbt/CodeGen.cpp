@@ -0,0 +1,127 @@
+#include "CodeGen.h"
+
+#include "Options.h"
+#include "SBTError.h"
+
+#include <llvm/ADT/Triple.h>
+#include <llvm/Analysis/TargetLibraryInfo.h>
+#include <llvm/Analysis/TargetTransformInfo.h>
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/CodeGen.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Host.h>
+#include <llvm/Support/TargetRegistry.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Target/TargetMachine.h>
+#include <llvm/Target/TargetOptions.h>
+#include <llvm/Transforms/IPO.h>
+#include <llvm/Transforms/IPO/PassManagerBuilder.h>
+
+#undef ENABLE_DBGS
+#define ENABLE_DBGS 1
+#include "Debug.h"
+
+namespace sbt {
+
+CodeGen::CodeGen(const Options* opts, llvm::Error& err) :
+    _opts(opts)
+{
+    if (_opts->hostTriple().empty()) {
+        // translated code is 32-bit (guest addresses are i32):
+        // use the 32-bit variant of the default target, as 'llc -march=x86'
+        llvm::Triple triple(llvm::sys::getDefaultTargetTriple());
+        triple = triple.get32BitArchVariant();
+        if (triple.getArch() == llvm::Triple::x86)
+            triple.setArchName("i686");
+        _triple = triple.str();
+    } else
+        _triple = _opts->hostTriple();
+    _triple = llvm::Triple::normalize(_triple);
+
+    std::string strError;
+    const llvm::Target* target =
+        llvm::TargetRegistry::lookupTarget(_triple, strError);
+    if (!target) {
+        err = ERRORF("host target not found: {0}: {1}", _triple, strError);
+        return;
+    }
+
+    llvm::TargetOptions to;
+    llvm::Reloc::Model rm = _opts->hostPIC()?
+        llvm::Reloc::PIC_ : llvm::Reloc::Static;
+    llvm::CodeGenOpt::Level ol = _opts->xopt()?
+        llvm::CodeGenOpt::Aggressive : llvm::CodeGenOpt::None;
+
+    _tm.reset(target->createTargetMachine(_triple, _opts->hostCPU(),
+        _opts->hostAttrs(), to, rm, llvm::None, ol));
+    if (!_tm) {
+        err = ERRORF("could not create target machine for {0}", _triple);
+        return;
+    }
+
+    DBGF("triple={0}, cpu={1}, attrs={2}",
+        _triple, _opts->hostCPU(), _opts->hostAttrs());
+}
+
+
+// (TargetMachine is complete only here)
+CodeGen::~CodeGen() = default;
+
+
+void CodeGen::optimize(llvm::Module* module)
+{
+    // same as 'opt -O3', plus target specific analyses and passes
+    llvm::PassManagerBuilder pmb;
+    pmb.OptLevel = 3;
+    pmb.SizeLevel = 0;
+    pmb.Inliner = llvm::createFunctionInliningPass(
+        pmb.OptLevel, pmb.SizeLevel, false);
+    pmb.LoopVectorize = true;
+    pmb.SLPVectorize = true;
+    _tm->adjustPassManager(pmb);
+
+    llvm::legacy::FunctionPassManager fpm(module);
+    fpm.add(llvm::createTargetTransformInfoWrapperPass(
+        _tm->getTargetIRAnalysis()));
+    pmb.populateFunctionPassManager(fpm);
+
+    llvm::legacy::PassManager mpm;
+    mpm.add(new llvm::TargetLibraryInfoWrapperPass(llvm::Triple(_triple)));
+    mpm.add(llvm::createTargetTransformInfoWrapperPass(
+        _tm->getTargetIRAnalysis()));
+    pmb.populateModulePassManager(mpm);
+
+    fpm.doInitialization();
+    for (llvm::Function& f : *module)
+        fpm.run(f);
+    fpm.doFinalization();
+    mpm.run(*module);
+}
+
+
+llvm::Error CodeGen::emitObj(llvm::Module* module, const std::string& path)
+{
+    module->setTargetTriple(_triple);
+    module->setDataLayout(_tm->createDataLayout());
+
+    if (_opts->xopt())
+        optimize(module);
+
+    std::error_code ec;
+    llvm::raw_fd_ostream os(path, ec, llvm::sys::fs::F_None);
+    if (ec)
+        return llvm::errorCodeToError(ec);
+
+    llvm::legacy::PassManager pm;
+    pm.add(new llvm::TargetLibraryInfoWrapperPass(llvm::Triple(_triple)));
+    if (_tm->addPassesToEmitFile(pm, os, nullptr,
+            llvm::TargetMachine::CGFT_ObjectFile))
+        return ERRORF("host target {0} can't emit object files", _triple);
+
+    pm.run(*module);
+    os.flush();
+    return llvm::Error::success();
+}
+
+}
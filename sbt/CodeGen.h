@@ -0,0 +1,58 @@
+#ifndef SBT_CODEGEN_H
+#define SBT_CODEGEN_H
+
+#include <llvm/Support/Error.h>
+
+#include <memory>
+#include <string>
+
+namespace llvm {
+class Module;
+class TargetMachine;
+}
+
+namespace sbt {
+
+class Options;
+
+/**
+ * Host code generator.
+ *
+ * Optimizes the translated module and compiles it to a host object file,
+ * in-process, using the same LLVMContext and Module that were used in the
+ * translation, instead of writing bitcode and running opt and llc on it.
+ */
+class CodeGen
+{
+public:
+    /**
+     * ctor.
+     *
+     * @param opts translator options, that select the host target
+     * @param err
+     */
+    CodeGen(const Options* opts, llvm::Error& err);
+
+    ~CodeGen();
+
+    /**
+     * Optimize (if enabled) and compile module, writing a host object file.
+     *
+     * Note that the module is changed in the process.
+     *
+     * @param module translated module
+     * @param path output object file path
+     */
+    llvm::Error emitObj(llvm::Module* module, const std::string& path);
+
+private:
+    const Options* _opts;
+    std::string _triple;
+    std::unique_ptr<llvm::TargetMachine> _tm;
+
+    void optimize(llvm::Module* module);
+};
+
+}
+
+#endif
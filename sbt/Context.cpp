@@ -4,6 +4,7 @@
 #include "FRegister.h"
 #include "Function.h"
 #include "Stack.h"
+#include "TranslationCache.h"
 #include "XRegister.h"
 
 namespace sbt {
@@ -25,4 +26,9 @@ void Context::addFunc(FunctionPtr&& f)
     _func->upsert(std::move(fname), std::move(f));
 }
 
+void Context::recordFunc(uint64_t addr, const Function* f) const
+{
+    cache->recordFunc(addr, f);
+}
+
 }
@@ -19,11 +19,15 @@ class FRegister;
 class FRegisters;
 class Function;
 class Module;
+class Profile;
+class RegFile;
 class Register;
 class SBTRelocation;
 class SBTSection;
 class ShadowImage;
 class Stack;
+class TBAA;
+class TranslationCache;
 class Translator;
 class XRegister;
 class XRegisters;
@@ -85,8 +89,18 @@ public:
     XRegisters* x = nullptr;
     FRegisters* f = nullptr;
     Register* fcsr = nullptr;
+    // global register file struct (null if disabled)
+    RegFile* regFile = nullptr;
     // stack
     Stack* stack = nullptr;
+    // translation cache (null if disabled)
+    TranslationCache* cache = nullptr;
+    // alias analysis metadata (null if disabled)
+    TBAA* tbaa = nullptr;
+    // profile (null if not generating or using one)
+    Profile* profile = nullptr;
+    // number of translated guest instructions
+    size_t translatedInstrs = 0;
     // flags
     // inside C main function?
     bool inMain = false;
@@ -111,6 +125,8 @@ public:
     Function* funcByAddr(uint64_t addr, bool assertNotNull = true) const
     {
         Function** f = (*_funcByAddr)[addr];
+        if (cache)
+            recordFunc(addr, f? *f : nullptr);
         if (assertNotNull)
             xassert(f);
         else if (!f)
@@ -121,6 +137,9 @@ public:
     // add function to maps
     void addFunc(FunctionPtr&& f);
 
+    // record function lookup in translation cache
+    void recordFunc(uint64_t addr, const Function* f) const;
+
     // module scope
     // (module == object file)
     const Module* sbtmodule = nullptr;
@@ -35,8 +35,20 @@
 #   define xassert(expr) static_cast<void>(expr)
 #endif
 
+#if SBT_DEBUG
 #   define xunreachable(msg) \
         xassert(false && msg)
+#else
+#   define xunreachable(msg) __builtin_unreachable()
+#endif
+
+// IR value names are useful only to debug the translator: on release
+// builds, don't even build them (the LLVM context discards them anyway)
+#if SBT_DEBUG
+#   define IRNAME(name) (name)
+#else
+#   define IRNAME(name) ""
+#endif
 
 // global dynamic debug flag
 namespace sbt {
@@ -112,7 +124,7 @@ inline Logger::Logger(const std::string& file)
 #undef DBGS
 #undef DBGF
 #undef DBG
-#if ENABLE_DBGS
+#if ENABLE_DBGS && SBT_DEBUG
 #   include <llvm/Support/FormatVariadic.h>
 #   define DBGS (g_debug? LOGS : llvm::nulls())
 #   define DBGF(...) \
@@ -129,7 +141,9 @@ inline Logger::Logger(const std::string& file)
         } \
     } while(0)
 #else
-#   define DBGS llvm::nulls()
+    // discard the operands, without evaluating them
+    // (the empty 'if' keeps a following 'else' bound to the caller's 'if')
+#   define DBGS if (true) {} else llvm::nulls()
 #   define DBGF(...)
 #   define DBG(a)
 #endif
@@ -0,0 +1,604 @@
+#include "Decoder.h"
+
+#include "Debug.h"
+
+#include <llvm/MC/MCInst.h>
+
+// LLVM internal instruction and register info
+#define GET_INSTRINFO_ENUM
+#include <llvm/Target/RISCV/RISCVGenInstrInfo.inc>
+#define GET_REGINFO_ENUM
+#include <llvm/Target/RISCV/RISCVGenRegisterInfo.inc>
+
+#include <vector>
+
+namespace sbt {
+
+namespace RISCV = llvm::RISCV;
+
+namespace {
+
+// operand layouts, in MCInst operand order
+// (must match LLVM's RISC-V instruction definitions)
+enum Layout : uint8_t {
+    L_NONE,     // -
+    L_R,        // rd, rs1, rs2
+    L_R_RM,     // rd, rs1, rs2, rm
+    L_R4_RM,    // rd, rs1, rs2, rs3, rm
+    L_R2,       // rd, rs1
+    L_R2_RM,    // rd, rs1, rm
+    L_I,        // rd, rs1, imm
+    L_SHIFT,    // rd, rs1, shamt
+    L_S,        // rs2, rs1, imm
+    L_B,        // rs1, rs2, imm
+    L_U,        // rd, imm
+    L_J,        // rd, imm
+    L_CSR,      // rd, csr, rs1
+    L_CSRI,     // rd, csr, zimm
+    L_FENCE     // pred, succ
+};
+
+// register classes
+enum RegClass : uint8_t {
+    X,          // integer
+    S,          // single precision
+    D           // double precision
+};
+
+struct Encoding
+{
+    uint32_t mask;
+    uint32_t match;
+    uint16_t opcode;
+    Layout layout;
+    // rd register class
+    RegClass rdc;
+    // source registers class (except the base register of loads/stores,
+    // that is always X)
+    RegClass rsc;
+};
+
+// major opcodes
+enum : uint32_t {
+    LOAD        = 0x03,
+    LOAD_FP     = 0x07,
+    MISC_MEM    = 0x0F,
+    OP_IMM      = 0x13,
+    AUIPC       = 0x17,
+    STORE       = 0x23,
+    STORE_FP    = 0x27,
+    OP          = 0x33,
+    LUI         = 0x37,
+    MADD        = 0x43,
+    MSUB        = 0x47,
+    NMSUB       = 0x4B,
+    NMADD       = 0x4F,
+    OP_FP       = 0x53,
+    BRANCH      = 0x63,
+    JALR        = 0x67,
+    JAL         = 0x6F,
+    SYSTEM      = 0x73
+};
+
+// encoding masks
+enum : uint32_t {
+    M_OPC       = 0x0000007F,   // opcode
+    M_F3        = 0x0000707F,   // funct3, opcode
+    M_F7        = 0xFE00007F,   // funct7, opcode
+    M_F7F3      = 0xFE00707F,   // funct7, funct3, opcode
+    M_F7RS2     = 0xFFF0007F,   // funct7, rs2, opcode
+    M_F7RS2F3   = 0xFFF0707F,   // funct7, rs2, funct3, opcode
+    M_R4        = 0x0600007F,   // fmt, opcode
+    M_FENCE     = 0xF00FFFFF,   // all but pred/succ
+    M_ALL       = 0xFFFFFFFF
+};
+
+constexpr uint32_t f3(uint32_t v)
+{
+    return v << 12;
+}
+
+constexpr uint32_t f7(uint32_t v)
+{
+    return v << 25;
+}
+
+constexpr uint32_t rs2(uint32_t v)
+{
+    return v << 20;
+}
+
+constexpr uint32_t fmt(uint32_t v)
+{
+    return v << 25;
+}
+
+// NOTE keep sorted by major opcode
+const Encoding g_encodings[] = {
+    // loads
+    { M_F3, LOAD | f3(0), RISCV::LB, L_I, X, X },
+    { M_F3, LOAD | f3(1), RISCV::LH, L_I, X, X },
+    { M_F3, LOAD | f3(2), RISCV::LW, L_I, X, X },
+    { M_F3, LOAD | f3(4), RISCV::LBU, L_I, X, X },
+    { M_F3, LOAD | f3(5), RISCV::LHU, L_I, X, X },
+    { M_F3, LOAD_FP | f3(2), RISCV::FLW, L_I, S, X },
+    { M_F3, LOAD_FP | f3(3), RISCV::FLD, L_I, D, X },
+
+    // fences
+    { M_FENCE, MISC_MEM | f3(0), RISCV::FENCE, L_FENCE, X, X },
+    { M_ALL, MISC_MEM | f3(1), RISCV::FENCE_I, L_NONE, X, X },
+
+    // ALU ops with immediates
+    { M_F3, OP_IMM | f3(0), RISCV::ADDI, L_I, X, X },
+    { M_F3, OP_IMM | f3(2), RISCV::SLTI, L_I, X, X },
+    { M_F3, OP_IMM | f3(3), RISCV::SLTIU, L_I, X, X },
+    { M_F3, OP_IMM | f3(4), RISCV::XORI, L_I, X, X },
+    { M_F3, OP_IMM | f3(6), RISCV::ORI, L_I, X, X },
+    { M_F3, OP_IMM | f3(7), RISCV::ANDI, L_I, X, X },
+    // (RV32 shifts: shamt[5] must be 0)
+    { M_F7F3, OP_IMM | f3(1) | f7(0x00), RISCV::SLLI, L_SHIFT, X, X },
+    { M_F7F3, OP_IMM | f3(5) | f7(0x00), RISCV::SRLI, L_SHIFT, X, X },
+    { M_F7F3, OP_IMM | f3(5) | f7(0x20), RISCV::SRAI, L_SHIFT, X, X },
+
+    { M_OPC, AUIPC, RISCV::AUIPC, L_U, X, X },
+
+    // stores
+    { M_F3, STORE | f3(0), RISCV::SB, L_S, X, X },
+    { M_F3, STORE | f3(1), RISCV::SH, L_S, X, X },
+    { M_F3, STORE | f3(2), RISCV::SW, L_S, X, X },
+    { M_F3, STORE_FP | f3(2), RISCV::FSW, L_S, X, S },
+    { M_F3, STORE_FP | f3(3), RISCV::FSD, L_S, X, D },
+
+    // ALU ops
+    { M_F7F3, OP | f3(0) | f7(0x00), RISCV::ADD, L_R, X, X },
+    { M_F7F3, OP | f3(0) | f7(0x20), RISCV::SUB, L_R, X, X },
+    { M_F7F3, OP | f3(1) | f7(0x00), RISCV::SLL, L_R, X, X },
+    { M_F7F3, OP | f3(2) | f7(0x00), RISCV::SLT, L_R, X, X },
+    { M_F7F3, OP | f3(3) | f7(0x00), RISCV::SLTU, L_R, X, X },
+    { M_F7F3, OP | f3(4) | f7(0x00), RISCV::XOR, L_R, X, X },
+    { M_F7F3, OP | f3(5) | f7(0x00), RISCV::SRL, L_R, X, X },
+    { M_F7F3, OP | f3(5) | f7(0x20), RISCV::SRA, L_R, X, X },
+    { M_F7F3, OP | f3(6) | f7(0x00), RISCV::OR, L_R, X, X },
+    { M_F7F3, OP | f3(7) | f7(0x00), RISCV::AND, L_R, X, X },
+    // M
+    { M_F7F3, OP | f3(0) | f7(0x01), RISCV::MUL, L_R, X, X },
+    { M_F7F3, OP | f3(1) | f7(0x01), RISCV::MULH, L_R, X, X },
+    { M_F7F3, OP | f3(2) | f7(0x01), RISCV::MULHSU, L_R, X, X },
+    { M_F7F3, OP | f3(3) | f7(0x01), RISCV::MULHU, L_R, X, X },
+    { M_F7F3, OP | f3(4) | f7(0x01), RISCV::DIV, L_R, X, X },
+    { M_F7F3, OP | f3(5) | f7(0x01), RISCV::DIVU, L_R, X, X },
+    { M_F7F3, OP | f3(6) | f7(0x01), RISCV::REM, L_R, X, X },
+    { M_F7F3, OP | f3(7) | f7(0x01), RISCV::REMU, L_R, X, X },
+
+    { M_OPC, LUI, RISCV::LUI, L_U, X, X },
+
+    // fused multiply-add
+    { M_R4, MADD | fmt(0), RISCV::FMADD_S, L_R4_RM, S, S },
+    { M_R4, MADD | fmt(1), RISCV::FMADD_D, L_R4_RM, D, D },
+    { M_R4, MSUB | fmt(0), RISCV::FMSUB_S, L_R4_RM, S, S },
+    { M_R4, MSUB | fmt(1), RISCV::FMSUB_D, L_R4_RM, D, D },
+    { M_R4, NMSUB | fmt(0), RISCV::FNMSUB_S, L_R4_RM, S, S },
+    { M_R4, NMSUB | fmt(1), RISCV::FNMSUB_D, L_R4_RM, D, D },
+    { M_R4, NMADD | fmt(0), RISCV::FNMADD_S, L_R4_RM, S, S },
+    { M_R4, NMADD | fmt(1), RISCV::FNMADD_D, L_R4_RM, D, D },
+
+    // FP ops: single
+    { M_F7, OP_FP | f7(0x00), RISCV::FADD_S, L_R_RM, S, S },
+    { M_F7, OP_FP | f7(0x04), RISCV::FSUB_S, L_R_RM, S, S },
+    { M_F7, OP_FP | f7(0x08), RISCV::FMUL_S, L_R_RM, S, S },
+    { M_F7, OP_FP | f7(0x0C), RISCV::FDIV_S, L_R_RM, S, S },
+    { M_F7RS2, OP_FP | f7(0x2C) | rs2(0), RISCV::FSQRT_S, L_R2_RM, S, S },
+    { M_F7F3, OP_FP | f7(0x10) | f3(0), RISCV::FSGNJ_S, L_R, S, S },
+    { M_F7F3, OP_FP | f7(0x10) | f3(1), RISCV::FSGNJN_S, L_R, S, S },
+    { M_F7F3, OP_FP | f7(0x10) | f3(2), RISCV::FSGNJX_S, L_R, S, S },
+    { M_F7F3, OP_FP | f7(0x14) | f3(0), RISCV::FMIN_S, L_R, S, S },
+    { M_F7F3, OP_FP | f7(0x14) | f3(1), RISCV::FMAX_S, L_R, S, S },
+    { M_F7RS2, OP_FP | f7(0x60) | rs2(0), RISCV::FCVT_W_S, L_R2_RM, X, S },
+    { M_F7RS2, OP_FP | f7(0x60) | rs2(1), RISCV::FCVT_WU_S, L_R2_RM, X, S },
+    { M_F7RS2F3, OP_FP | f7(0x70) | rs2(0) | f3(0), RISCV::FMV_X_W, L_R2, X, S },
+    { M_F7F3, OP_FP | f7(0x50) | f3(2), RISCV::FEQ_S, L_R, X, S },
+    { M_F7F3, OP_FP | f7(0x50) | f3(1), RISCV::FLT_S, L_R, X, S },
+    { M_F7F3, OP_FP | f7(0x50) | f3(0), RISCV::FLE_S, L_R, X, S },
+    { M_F7RS2, OP_FP | f7(0x68) | rs2(0), RISCV::FCVT_S_W, L_R2_RM, S, X },
+    { M_F7RS2, OP_FP | f7(0x68) | rs2(1), RISCV::FCVT_S_WU, L_R2_RM, S, X },
+    { M_F7RS2F3, OP_FP | f7(0x78) | rs2(0) | f3(0), RISCV::FMV_W_X, L_R2, S, X },
+
+    // FP ops: double
+    { M_F7, OP_FP | f7(0x01), RISCV::FADD_D, L_R_RM, D, D },
+    { M_F7, OP_FP | f7(0x05), RISCV::FSUB_D, L_R_RM, D, D },
+    { M_F7, OP_FP | f7(0x09), RISCV::FMUL_D, L_R_RM, D, D },
+    { M_F7, OP_FP | f7(0x0D), RISCV::FDIV_D, L_R_RM, D, D },
+    { M_F7RS2, OP_FP | f7(0x2D) | rs2(0), RISCV::FSQRT_D, L_R2_RM, D, D },
+    { M_F7F3, OP_FP | f7(0x11) | f3(0), RISCV::FSGNJ_D, L_R, D, D },
+    { M_F7F3, OP_FP | f7(0x11) | f3(1), RISCV::FSGNJN_D, L_R, D, D },
+    { M_F7F3, OP_FP | f7(0x11) | f3(2), RISCV::FSGNJX_D, L_R, D, D },
+    { M_F7F3, OP_FP | f7(0x15) | f3(0), RISCV::FMIN_D, L_R, D, D },
+    { M_F7F3, OP_FP | f7(0x15) | f3(1), RISCV::FMAX_D, L_R, D, D },
+    { M_F7RS2, OP_FP | f7(0x20) | rs2(1), RISCV::FCVT_S_D, L_R2_RM, S, D },
+    { M_F7RS2F3, OP_FP | f7(0x21) | rs2(0) | f3(0), RISCV::FCVT_D_S, L_R2, D, S },
+    { M_F7F3, OP_FP | f7(0x51) | f3(2), RISCV::FEQ_D, L_R, X, D },
+    { M_F7F3, OP_FP | f7(0x51) | f3(1), RISCV::FLT_D, L_R, X, D },
+    { M_F7F3, OP_FP | f7(0x51) | f3(0), RISCV::FLE_D, L_R, X, D },
+    { M_F7RS2, OP_FP | f7(0x61) | rs2(0), RISCV::FCVT_W_D, L_R2_RM, X, D },
+    { M_F7RS2, OP_FP | f7(0x61) | rs2(1), RISCV::FCVT_WU_D, L_R2_RM, X, D },
+    { M_F7RS2F3, OP_FP | f7(0x69) | rs2(0) | f3(0), RISCV::FCVT_D_W, L_R2, D, X },
+    { M_F7RS2F3, OP_FP | f7(0x69) | rs2(1) | f3(0), RISCV::FCVT_D_WU, L_R2, D, X },
+
+    // branches
+    { M_F3, BRANCH | f3(0), RISCV::BEQ, L_B, X, X },
+    { M_F3, BRANCH | f3(1), RISCV::BNE, L_B, X, X },
+    { M_F3, BRANCH | f3(4), RISCV::BLT, L_B, X, X },
+    { M_F3, BRANCH | f3(5), RISCV::BGE, L_B, X, X },
+    { M_F3, BRANCH | f3(6), RISCV::BLTU, L_B, X, X },
+    { M_F3, BRANCH | f3(7), RISCV::BGEU, L_B, X, X },
+
+    // jumps
+    { M_F3, JALR | f3(0), RISCV::JALR, L_I, X, X },
+    { M_OPC, JAL, RISCV::JAL, L_J, X, X },
+
+    // system
+    { M_ALL, SYSTEM, RISCV::ECALL, L_NONE, X, X },
+    { M_ALL, SYSTEM | rs2(1), RISCV::EBREAK, L_NONE, X, X },
+    { M_F3, SYSTEM | f3(1), RISCV::CSRRW, L_CSR, X, X },
+    { M_F3, SYSTEM | f3(2), RISCV::CSRRS, L_CSR, X, X },
+    { M_F3, SYSTEM | f3(3), RISCV::CSRRC, L_CSR, X, X },
+    { M_F3, SYSTEM | f3(5), RISCV::CSRRWI, L_CSRI, X, X },
+    { M_F3, SYSTEM | f3(6), RISCV::CSRRSI, L_CSRI, X, X },
+    { M_F3, SYSTEM | f3(7), RISCV::CSRRCI, L_CSRI, X, X }
+};
+
+const size_t NUM_ENCODINGS = sizeof(g_encodings) / sizeof(g_encodings[0]);
+static_assert(NUM_ENCODINGS <= 256, "encoding index doesn't fit in 8 bits");
+
+// encodings of each major opcode: [begin, end)
+struct Group
+{
+    uint8_t begin = 0;
+    uint8_t end = 0;
+};
+
+// index encodings by major opcode
+// (bits 2 to 6: the 2 lowest bits are always set in 32-bit encodings)
+const std::vector<Group>& groups()
+{
+    static const std::vector<Group> groups = [] {
+        std::vector<Group> gv(32);
+        for (size_t i = 0; i < NUM_ENCODINGS; i++) {
+            Group& g = gv[(g_encodings[i].match >> 2) & 0x1F];
+            if (g.begin == g.end)
+                g.begin = i;
+            g.end = i + 1;
+        }
+        return gv;
+    }();
+    return groups;
+}
+
+// registers, by class and number
+const unsigned g_xregs[32] = {
+    RISCV::X0, RISCV::X1, RISCV::X2, RISCV::X3, RISCV::X4, RISCV::X5, RISCV::X6, RISCV::X7,
+    RISCV::X8, RISCV::X9, RISCV::X10, RISCV::X11, RISCV::X12, RISCV::X13, RISCV::X14, RISCV::X15,
+    RISCV::X16, RISCV::X17, RISCV::X18, RISCV::X19, RISCV::X20, RISCV::X21, RISCV::X22, RISCV::X23,
+    RISCV::X24, RISCV::X25, RISCV::X26, RISCV::X27, RISCV::X28, RISCV::X29, RISCV::X30, RISCV::X31
+};
+
+const unsigned g_sregs[32] = {
+    RISCV::F0_32, RISCV::F1_32, RISCV::F2_32, RISCV::F3_32, RISCV::F4_32, RISCV::F5_32, RISCV::F6_32, RISCV::F7_32,
+    RISCV::F8_32, RISCV::F9_32, RISCV::F10_32, RISCV::F11_32, RISCV::F12_32, RISCV::F13_32, RISCV::F14_32, RISCV::F15_32,
+    RISCV::F16_32, RISCV::F17_32, RISCV::F18_32, RISCV::F19_32, RISCV::F20_32, RISCV::F21_32, RISCV::F22_32, RISCV::F23_32,
+    RISCV::F24_32, RISCV::F25_32, RISCV::F26_32, RISCV::F27_32, RISCV::F28_32, RISCV::F29_32, RISCV::F30_32, RISCV::F31_32
+};
+
+const unsigned g_dregs[32] = {
+    RISCV::F0_64, RISCV::F1_64, RISCV::F2_64, RISCV::F3_64, RISCV::F4_64, RISCV::F5_64, RISCV::F6_64, RISCV::F7_64,
+    RISCV::F8_64, RISCV::F9_64, RISCV::F10_64, RISCV::F11_64, RISCV::F12_64, RISCV::F13_64, RISCV::F14_64, RISCV::F15_64,
+    RISCV::F16_64, RISCV::F17_64, RISCV::F18_64, RISCV::F19_64, RISCV::F20_64, RISCV::F21_64, RISCV::F22_64, RISCV::F23_64,
+    RISCV::F24_64, RISCV::F25_64, RISCV::F26_64, RISCV::F27_64, RISCV::F28_64, RISCV::F29_64, RISCV::F30_64, RISCV::F31_64
+};
+
+unsigned reg(RegClass rc, unsigned num)
+{
+    switch (rc) {
+        case X: return g_xregs[num];
+        case S: return g_sregs[num];
+        case D: return g_dregs[num];
+    }
+    xunreachable("Invalid register class!");
+}
+
+bool hasRM(Layout l)
+{
+    return l == L_R_RM || l == L_R4_RM || l == L_R2_RM;
+}
+
+// rounding modes 5 and 6 are reserved
+bool validRM(unsigned rm)
+{
+    return rm != 5 && rm != 6;
+}
+
+// immediates
+
+int32_t immI(uint32_t ri)
+{
+    return static_cast<int32_t>(ri) >> 20;
+}
+
+int32_t immS(uint32_t ri)
+{
+    return (static_cast<int32_t>(ri) >> 25 << 5) | ((ri >> 7) & 0x1F);
+}
+
+// branch offset
+int32_t immB(uint32_t ri)
+{
+    return (static_cast<int32_t>(ri & 0x80000000) >> 19) |
+        ((ri & 0x80) << 4) |
+        ((ri >> 20) & 0x7E0) |
+        ((ri >> 7) & 0x1E);
+}
+
+// jump offset
+int32_t immJ(uint32_t ri)
+{
+    return (static_cast<int32_t>(ri & 0x80000000) >> 11) |
+        (ri & 0xFF000) |
+        ((ri >> 9) & 0x800) |
+        ((ri >> 20) & 0x7FE);
+}
+
+} // namespace
+
+
+bool Decoder::decode(uint32_t ri, Inst& inst)
+{
+    // compressed instructions are not supported
+    if ((ri & 3) != 3)
+        return false;
+
+    const Group& g = groups()[(ri >> 2) & 0x1F];
+    for (unsigned i = g.begin; i < g.end; i++) {
+        const Encoding& e = g_encodings[i];
+        if ((ri & e.mask) != e.match)
+            continue;
+
+        inst.opcode = e.opcode;
+        inst.enc = i;
+        inst.rd = (ri >> 7) & 0x1F;
+        inst.rs1 = (ri >> 15) & 0x1F;
+        inst.rs2 = (ri >> 20) & 0x1F;
+        inst.rs3 = ri >> 27;
+        inst.rm = (ri >> 12) & 7;
+
+        if (hasRM(e.layout) && !validRM(inst.rm))
+            return false;
+
+        switch (e.layout) {
+            case L_I:
+                inst.imm = immI(ri);
+                break;
+            case L_SHIFT:
+                inst.imm = inst.rs2;
+                break;
+            case L_S:
+                inst.imm = immS(ri);
+                break;
+            case L_B:
+                inst.imm = immB(ri);
+                break;
+            case L_U:
+                inst.imm = ri >> 12;
+                break;
+            case L_J:
+                inst.imm = immJ(ri);
+                break;
+            case L_CSR:
+            case L_CSRI:
+                inst.imm = ri >> 20;
+                break;
+            case L_FENCE:
+                inst.imm = (ri >> 20) & 0xFF;
+                break;
+            default:
+                inst.imm = 0;
+        }
+        return true;
+    }
+    return false;
+}
+
+
+unsigned Decoder::operands(const Inst& inst, Operand* ops)
+{
+    const Encoding& e = g_encodings[inst.enc];
+    unsigned n = 0;
+
+    auto addReg = [&](RegClass rc, unsigned num) {
+        Operand& op = ops[n++];
+        switch (rc) {
+            case X: op.kind = Operand::XREG; break;
+            case S: op.kind = Operand::SREG; break;
+            case D: op.kind = Operand::DREG; break;
+        }
+        op.val = num;
+    };
+    auto addImm = [&](int32_t imm) {
+        Operand& op = ops[n++];
+        op.kind = Operand::IMM;
+        op.val = imm;
+    };
+
+    switch (e.layout) {
+        case L_NONE:
+            break;
+
+        case L_R:
+            addReg(e.rdc, inst.rd);
+            addReg(e.rsc, inst.rs1);
+            addReg(e.rsc, inst.rs2);
+            break;
+
+        case L_R_RM:
+            addReg(e.rdc, inst.rd);
+            addReg(e.rsc, inst.rs1);
+            addReg(e.rsc, inst.rs2);
+            addImm(inst.rm);
+            break;
+
+        case L_R4_RM:
+            addReg(e.rdc, inst.rd);
+            addReg(e.rsc, inst.rs1);
+            addReg(e.rsc, inst.rs2);
+            addReg(e.rsc, inst.rs3);
+            addImm(inst.rm);
+            break;
+
+        case L_R2:
+            addReg(e.rdc, inst.rd);
+            addReg(e.rsc, inst.rs1);
+            break;
+
+        case L_R2_RM:
+            addReg(e.rdc, inst.rd);
+            addReg(e.rsc, inst.rs1);
+            addImm(inst.rm);
+            break;
+
+        case L_I:
+        case L_SHIFT:
+            addReg(e.rdc, inst.rd);
+            addReg(X, inst.rs1);
+            addImm(inst.imm);
+            break;
+
+        case L_S:
+            addReg(e.rsc, inst.rs2);
+            addReg(X, inst.rs1);
+            addImm(inst.imm);
+            break;
+
+        case L_B:
+            addReg(X, inst.rs1);
+            addReg(X, inst.rs2);
+            addImm(inst.imm);
+            break;
+
+        case L_U:
+        case L_J:
+            addReg(X, inst.rd);
+            addImm(inst.imm);
+            break;
+
+        case L_CSR:
+            addReg(X, inst.rd);
+            addImm(inst.imm);
+            addReg(X, inst.rs1);
+            break;
+
+        case L_CSRI:
+            addReg(X, inst.rd);
+            addImm(inst.imm);
+            addImm(inst.rs1);
+            break;
+
+        case L_FENCE:
+            addImm(inst.imm >> 4);
+            addImm(inst.imm & 0xF);
+            break;
+    }
+    return n;
+}
+
+
+void Decoder::toMCInst(const Inst& inst, llvm::MCInst& mcinst)
+{
+    Operand ops[MAX_OPERANDS];
+    unsigned n = operands(inst, ops);
+
+    mcinst.clear();
+    mcinst.setOpcode(inst.opcode);
+    for (unsigned i = 0; i < n; i++) {
+        const Operand& op = ops[i];
+        switch (op.kind) {
+            case Operand::XREG:
+                mcinst.addOperand(llvm::MCOperand::createReg(reg(X, op.val)));
+                break;
+            case Operand::SREG:
+                mcinst.addOperand(llvm::MCOperand::createReg(reg(S, op.val)));
+                break;
+            case Operand::DREG:
+                mcinst.addOperand(llvm::MCOperand::createReg(reg(D, op.val)));
+                break;
+            case Operand::IMM:
+                mcinst.addOperand(llvm::MCOperand::createImm(op.val));
+                break;
+            case Operand::NONE:
+                xunreachable("Invalid operand!");
+        }
+    }
+}
+
+
+void Decoder::regs(const Inst& inst, RegSet& use, RegSet& def)
+{
+    const Encoding& e = g_encodings[inst.enc];
+
+    auto add = [](RegSet& set, RegClass rc, unsigned num) {
+        if (rc == X)
+            set.x |= 1u << num;
+        else
+            set.f |= 1u << num;
+    };
+
+    switch (e.layout) {
+        case L_NONE:
+        case L_FENCE:
+            break;
+
+        case L_R4_RM:
+            add(use, e.rsc, inst.rs3);
+            // fall through
+        case L_R:
+        case L_R_RM:
+            add(use, e.rsc, inst.rs2);
+            // fall through
+        case L_R2:
+        case L_R2_RM:
+            add(def, e.rdc, inst.rd);
+            add(use, e.rsc, inst.rs1);
+            break;
+
+        case L_I:
+        case L_SHIFT:
+            add(def, e.rdc, inst.rd);
+            add(use, X, inst.rs1);
+            break;
+
+        case L_S:
+            add(use, e.rsc, inst.rs2);
+            add(use, X, inst.rs1);
+            break;
+
+        case L_B:
+            add(use, X, inst.rs1);
+            add(use, X, inst.rs2);
+            break;
+
+        case L_U:
+        case L_J:
+        case L_CSRI:
+            add(def, X, inst.rd);
+            break;
+
+        case L_CSR:
+            add(def, X, inst.rd);
+            add(use, X, inst.rs1);
+            break;
+    }
+
+    // x0 is never read nor written
+    use.x &= ~1u;
+    def.x &= ~1u;
+}
+
+}
@@ -0,0 +1,158 @@
+#ifndef SBT_DECODER_H
+#define SBT_DECODER_H
+
+#include <cstdint>
+
+namespace llvm {
+class MCInst;
+}
+
+namespace sbt {
+
+/**
+ * Native RV32G instruction decoder.
+ *
+ * Decodes the fixed 32-bit encodings handled by Instruction with a table
+ * of encoding masks, without going through LLVM's MCDisassembler, into a
+ * compact form, that Instruction translates directly. It can also be
+ * expanded to the same MCInst that MCDisassembler would produce, to print
+ * it.
+ *
+ * Other encodings (such as the A extension ones) are not decoded and must
+ * be handled by the Disassembler.
+ */
+class Decoder
+{
+public:
+    // decoded instruction
+    struct Inst
+    {
+        // llvm::RISCV opcode
+        uint16_t opcode = 0;
+        // encoding table index
+        uint8_t enc = 0;
+        // register numbers
+        uint8_t rd = 0;
+        uint8_t rs1 = 0;
+        uint8_t rs2 = 0;
+        uint8_t rs3 = 0;
+        // rounding mode
+        uint8_t rm = 0;
+        // immediate, CSR number or fence arguments
+        int32_t imm = 0;
+    };
+
+    // instruction operand
+    struct Operand
+    {
+        enum Kind : uint8_t {
+            NONE,
+            XREG,   // integer register
+            SREG,   // single precision register
+            DREG,   // double precision register
+            IMM     // immediate
+        };
+
+        Kind kind = NONE;
+        // register number or immediate
+        int32_t val = 0;
+
+        bool isReg() const
+        {
+            return kind == XREG || kind == SREG || kind == DREG;
+        }
+
+        bool isImm() const
+        {
+            return kind == IMM;
+        }
+    };
+
+    static const unsigned MAX_OPERANDS = 5;
+
+    /**
+     * Decode one instruction.
+     *
+     * This may be called concurrently from several threads.
+     *
+     * @param rawInst instruction in binary format
+     * @param inst [output] decoded instruction
+     *
+     * @return false if the encoding is not supported
+     */
+    static bool decode(uint32_t rawInst, Inst& inst);
+
+    /**
+     * Get the operands of a decoded instruction, in the same order as
+     * in the MCInst that MCDisassembler would produce.
+     *
+     * @param inst decoded instruction
+     * @param ops [output] operands (at least MAX_OPERANDS entries)
+     *
+     * @return number of operands
+     */
+    static unsigned operands(const Inst& inst, Operand* ops);
+
+    // convert decoded instruction to MCInst
+    // (only needed to print it)
+    static void toMCInst(const Inst& inst, llvm::MCInst& mcinst);
+
+    // register set: one bit per register number
+    struct RegSet
+    {
+        // integer registers
+        uint32_t x = 0;
+        // floating point registers
+        uint32_t f = 0;
+
+        RegSet& operator|=(const RegSet& other)
+        {
+            x |= other.x;
+            f |= other.f;
+            return *this;
+        }
+
+        RegSet& operator&=(const RegSet& other)
+        {
+            x &= other.x;
+            f &= other.f;
+            return *this;
+        }
+
+        RegSet operator~() const
+        {
+            RegSet r;
+            r.x = ~x;
+            r.f = ~f;
+            return r;
+        }
+
+        bool empty() const
+        {
+            return !x && !f;
+        }
+
+        bool operator==(const RegSet& other) const
+        {
+            return x == other.x && f == other.f;
+        }
+
+        bool operator!=(const RegSet& other) const
+        {
+            return !(*this == other);
+        }
+    };
+
+    /**
+     * Get the registers explicitly read and written by an instruction.
+     *
+     * @param inst decoded instruction
+     * @param use [output] registers read are added here
+     * @param def [output] registers written are added here
+     */
+    static void regs(const Inst& inst, RegSet& use, RegSet& def);
+};
+
+}
+
+#endif
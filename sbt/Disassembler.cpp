@@ -7,6 +7,7 @@
 #include <llvm/MC/MCInst.h>
 #include <llvm/MC/MCInstPrinter.h>
 #include <llvm/Support/FormatVariadic.h>
+#include <llvm/Support/raw_ostream.h>
 
 namespace sbt {
 
@@ -16,25 +17,43 @@ llvm::Error Disassembler::disasm(
     llvm::MCInst& inst,
     size_t& size)
 {
-    llvm::MCDisassembler::DecodeStatus sts =
-        _disasm->getInstruction(inst, size,
-            llvm::ArrayRef<uint8_t>(
-                reinterpret_cast<uint8_t*>(&rawInst), sizeof(rawInst)),
-            addr, DBGS, llvm::nulls());
-    if (sts == llvm::MCDisassembler::DecodeStatus::Success) {
-#if SBT_DEBUG
-        // print instruction
-        DBGS << llvm::formatv("{0:X-8}: ", addr);
-        _printer->printInst(&inst, DBGS, "", *_sti);
-        DBGS << "\n";
-#endif
     // failed to disasm
-    } else
+    if (!decode(addr, rawInst, inst, size))
         return ERROR2F(InvalidInstructionEncoding,
             "invalid instruction encoding at address {0:X-8}: {1:X-8}",
             addr, rawInst);
 
+    print(addr, inst);
     return llvm::Error::success();
 }
 
+
+bool Disassembler::decode(
+    uint64_t addr,
+    uint32_t rawInst,
+    llvm::MCInst& inst,
+    size_t& size) const
+{
+    // NOTE the comment/verbose streams are not thread safe,
+    //      so don't use DBGS/nulls() here
+    llvm::raw_null_ostream vs, cs;
+    llvm::MCDisassembler::DecodeStatus sts =
+        _disasm->getInstruction(inst, size,
+            llvm::ArrayRef<uint8_t>(
+                reinterpret_cast<uint8_t*>(&rawInst), sizeof(rawInst)),
+            addr, vs, cs);
+    return sts == llvm::MCDisassembler::DecodeStatus::Success;
+}
+
+
+void Disassembler::print(uint64_t addr, const llvm::MCInst& inst)
+{
+#if SBT_DEBUG
+    // print instruction
+    DBGS << llvm::formatv("{0:X-8}: ", addr);
+    _printer->printInst(&inst, DBGS, "", *_sti);
+    DBGS << "\n";
+#endif
+}
+
 }
@@ -39,6 +39,22 @@ public:
     llvm::MCInst& inst,
     size_t& size);
 
+  /**
+   * Decode one instruction, without printing it.
+   *
+   * This may be called concurrently from several threads.
+   *
+   * @return true on success, false if the encoding is invalid
+   */
+  bool decode(
+    uint64_t addr,
+    uint32_t rawInst,
+    llvm::MCInst& inst,
+    size_t& size) const;
+
+  // print instruction (debug mode only)
+  void print(uint64_t addr, const llvm::MCInst& inst);
+
 private:
   const llvm::MCDisassembler* _disasm;
   llvm::MCInstPrinter* _printer;
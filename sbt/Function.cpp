@@ -4,11 +4,15 @@
 #include "Constants.h"
 #include "Instruction.h"
 #include "Module.h"
+#include "Profile.h"
 #include "SBTError.h"
 #include "Section.h"
 #include "ShadowImage.h"
 #include "Stack.h"
+#include "TranslationCache.h"
 
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/DerivedTypes.h>
 #include <llvm/IR/Function.h>
 #include <llvm/IR/Module.h>
 #include <llvm/Support/FormatVariadic.h>
@@ -23,20 +27,228 @@ void Function::create(
     llvm::FunctionType* ft,
     llvm::Function::LinkageTypes linkage)
 {
+    // functions of a region are translated into it
+    if (oneRegion()) {
+        _f = _sec->region()->func();
+        xassert(_f && "region function not created yet!");
+        return;
+    }
+
+    // use the function's signature if no function type was specified
+    bool useSig = !ft;
+    if (useSig)
+        ft = sigType();
+
     // if function already exists in LLVM module, do nothing
     _f = _ctx->module->getFunction(_name);
-    if (_f)
+    if (_f) {
+        // unless it was declared before its signature was known
+        // (by data relocations, that are processed before any code)
+        if (!useSig || _f->getFunctionType() == ft || !_f->isDeclaration())
+            return;
+
+        DBGF("{0}: updating signature", _name);
+        llvm::Function* old = _f;
+        old->setName("");
+        _f = llvm::Function::Create(ft, linkage, _name, _ctx->module);
+        old->replaceAllUsesWith(
+            llvm::ConstantExpr::getBitCast(_f, old->getType()));
+        old->eraseFromParent();
         return;
+    }
 
     DBGF("{0}", _name);
 
-    // create a function with no parameters if no function type was specified
-    if (!ft)
-        ft = _ctx->t.voidFunc;
     _f = llvm::Function::Create(ft, linkage, _name, _ctx->module);
 }
 
 
+// register passed by value
+struct SigReg {
+    bool fp;
+    unsigned num;
+};
+
+// registers of a set, in signature order: X registers first, then F ones
+static std::vector<SigReg> sigRegs(const Decoder::RegSet& regs)
+{
+    std::vector<SigReg> v;
+    for (unsigned i = 1; i < XRegisters::NUM; i++)
+        if (regs.x & (1u << i))
+            v.push_back({false, i});
+    for (unsigned i = 0; i < FRegisters::NUM; i++)
+        if (regs.f & (1u << i))
+            v.push_back({true, i});
+    return v;
+}
+
+
+// get the values of n return registers from a return value
+static std::vector<llvm::Value*> unpackRets(
+    Builder* bld,
+    llvm::Value* ret,
+    size_t n)
+{
+    if (n == 1)
+        return { ret };
+
+    std::vector<llvm::Value*> vals;
+    for (size_t i = 0; i < n; i++)
+        vals.push_back(bld->extractValue(ret, i));
+    return vals;
+}
+
+
+// pack the values of return registers into a return value
+static llvm::Value* packRets(
+    Builder* bld,
+    llvm::Type* ty,
+    const std::vector<llvm::Value*>& vals)
+{
+    if (vals.size() == 1)
+        return vals.front();
+
+    llvm::Value* ret = llvm::UndefValue::get(ty);
+    for (size_t i = 0; i < vals.size(); i++)
+        ret = bld->insertValue(ret, vals[i], i);
+    return ret;
+}
+
+
+const SBTSection::RegUsage* Function::sig() const
+{
+    if (!_ctx->opts->funcSigs() || !localRegs() || !_sec || _name == "main")
+        return nullptr;
+
+    const SBTSection::RegUsage* ru = _sec->regUsage(_addr);
+    if (!ru || (ru->args.empty() && ru->rets.empty()))
+        return nullptr;
+    return ru;
+}
+
+
+llvm::FunctionType* Function::sigType() const
+{
+    const Types& t = _ctx->t;
+    const SBTSection::RegUsage* sig = this->sig();
+    if (!sig)
+        return t.voidFunc;
+
+    auto regType = [&t](const SigReg& r) {
+        return r.fp? t.fp64 : t.i32;
+    };
+
+    std::vector<llvm::Type*> params;
+    for (const SigReg& r : sigRegs(sig->args))
+        params.push_back(regType(r));
+
+    std::vector<llvm::Type*> rets;
+    for (const SigReg& r : sigRegs(sig->rets))
+        rets.push_back(regType(r));
+
+    llvm::Type* retty;
+    if (rets.empty())
+        retty = t.voidT;
+    else if (rets.size() == 1)
+        retty = rets.front();
+    else
+        retty = llvm::StructType::get(*_ctx->ctx, rets);
+
+    return llvm::FunctionType::get(retty, params, !VAR_ARG);
+}
+
+
+llvm::Function* Function::icallFunc()
+{
+    if (!_ctx->opts->funcSigs())
+        return _f;
+
+    // Whether a wrapper is really needed is only known after all code
+    // sections are analyzed, so always declare it for now.
+    const std::string name = _name + ".w";
+    llvm::Function* w = _ctx->module->getFunction(name);
+    if (!w)
+        w = llvm::Function::Create(_ctx->t.voidFunc,
+            llvm::Function::ExternalLinkage, name, _ctx->module);
+    return w;
+}
+
+
+void Function::genICallWrapper()
+{
+    llvm::Function* w = _ctx->module->getFunction(_name + ".w");
+    if (!w || !w->isDeclaration())
+        return;
+    xassert(_f);
+
+    // no signature: use the function itself
+    const SBTSection::RegUsage* sig = this->sig();
+    if (!sig) {
+        w->replaceAllUsesWith(
+            llvm::ConstantExpr::getBitCast(_f, w->getType()));
+        w->eraseFromParent();
+        return;
+    }
+
+    DBGF("{0}", _name);
+
+    Builder bldi(_ctx, NO_FIRST);
+    Builder* bld = &bldi;
+    BasicBlock bb(_ctx, "entry", w);
+    bld->setInsertBlock(&bb);
+
+    auto globalReg = [this](const SigReg& r) -> Register& {
+        return r.fp? _ctx->f->getReg(r.num) : _ctx->x->getReg(r.num);
+    };
+
+    // load arguments from global registers
+    std::vector<llvm::Value*> args;
+    for (const SigReg& r : sigRegs(sig->args))
+        args.push_back(bld->load(globalReg(r).getForRead()));
+
+    // call
+    llvm::Value* ret = bld->call(_f, args);
+
+    // store return values in global registers
+    std::vector<SigReg> rets = sigRegs(sig->rets);
+    std::vector<llvm::Value*> vals = unpackRets(bld, ret, rets.size());
+    for (size_t i = 0; i < rets.size(); i++)
+        bld->store(vals[i], globalReg(rets[i]).getForWrite());
+
+    bld->retVoid();
+    w->setLinkage(llvm::Function::InternalLinkage);
+}
+
+
+void Function::call(Function* f)
+{
+    Builder* bld = _ctx->bld;
+    const SBTSection::RegUsage* sig = f->sig();
+    if (!sig) {
+        bld->call(f->func());
+        return;
+    }
+
+    auto localReg = [this](const SigReg& r) -> Register& {
+        return r.fp? getFReg(r.num) : getReg(r.num);
+    };
+
+    // pass arguments
+    std::vector<llvm::Value*> args;
+    for (const SigReg& r : sigRegs(sig->args))
+        args.push_back(bld->load(localReg(r).getForRead()));
+
+    // call
+    llvm::Value* ret = bld->call(f->func(), args);
+
+    // get return values
+    std::vector<SigReg> rets = sigRegs(sig->rets);
+    std::vector<llvm::Value*> vals = unpackRets(bld, ret, rets.size());
+    for (size_t i = 0; i < rets.size(); i++)
+        bld->store(vals[i], localReg(rets[i]).getForWrite());
+}
+
+
 llvm::Error Function::translate()
 {
     DBGS << _name << ":\n";
@@ -88,18 +300,24 @@ llvm::Error Function::startMain()
 
     // first bb
     bld->setInsertBlock(newBB(_addr));
+    createBBs();
 
     // create local register file
     if (localRegs()) {
         _regs.reset(new XRegisters(_ctx, XRegisters::LOCAL));
         _fregs.reset(new FRegisters(_ctx, FRegisters::LOCAL));
     }
+    if (oneRegion())
+        _sec->region()->init(_f, _regs, _fregs);
+
+    if (_ctx->profile)
+        _ctx->profile->startFunc(_addr, _f);
 
     copyArgv();
 
     // set stack pointer
-    bld->store(_ctx->stack->end(), XRegister::SP, false/*cfaSet*/);
-    spillInit();
+    bld->store(_ctx->stack->end(), XRegister::SP);
+    createStackSlots();
 
     _ctx->inMain = true;
     return llvm::Error::success();
@@ -116,19 +334,58 @@ llvm::Error Function::start()
     if (!ptr)
         ptr = newBB(_addr);
     _ctx->bld->setInsertBlock(ptr);
+    createBBs();
+
+    if (_ctx->profile)
+        _ctx->profile->startFunc(_addr, oneRegion()? nullptr : _f);
+
+    // use region's register file, that is always up to date
+    if (oneRegion()) {
+        Region* rgn = _sec->region();
+        rgn->setEntry(_addr, ptr);
+        _regs = rgn->regs();
+        _fregs = rgn->fregs();
+        return llvm::Error::success();
+    }
 
     // create local register file
     if (localRegs()) {
         _regs.reset(new XRegisters(_ctx, XRegisters::LOCAL));
         _fregs.reset(new FRegisters(_ctx, FRegisters::LOCAL));
-        spillInit();
     }
+    createStackSlots();
     loadRegisters(S_FUNC_START);
 
+    // copy arguments to local registers
+    if (const SBTSection::RegUsage* sig = this->sig()) {
+        auto arg = _f->arg_begin();
+        for (const SigReg& r : sigRegs(sig->args)) {
+            Register& local = r.fp? getFReg(r.num) : getReg(r.num);
+            // NOTE don't count this write
+            _ctx->bld->store(&*arg++, local.get());
+        }
+    }
+
     return llvm::Error::success();
 }
 
 
+void Function::createBBs()
+{
+    // create all BBs found by the CFG discovery pass, in address order,
+    // so that they don't need to be created out of order or split later
+    const uint64_t isz = Constants::INSTRUCTION_SIZE;
+    for (uint64_t addr = _addr + isz; addr < _end; addr += isz) {
+        if (_sec->isBBLeader(addr) && !findBB(addr))
+            newBB(addr);
+    }
+
+    uint64_t nextBB = nextBBAddr(_addr);
+    if (nextBB != Constants::INVALID_ADDR)
+        updateNextBB(nextBB);
+}
+
+
 bool Function::terminated() const
 {
     llvm::Value* v = _ctx->bld->getInsertBlock()->bb()->getTerminator();
@@ -163,7 +420,9 @@ llvm::Error Function::finish()
             freturn();
     }
     _ctx->inMain = false;
-    cleanRegs();
+    // region registers are cleaned after all its functions are translated
+    if (!oneRegion())
+        cleanRegs();
 
     // last BB may be empty
     auto it = _bbMap.end();
@@ -251,6 +510,8 @@ llvm::Error Function::translateInstrs(uint64_t st, uint64_t end)
 
             _nextf->setEnd(end);
             _end = addr;
+            if (_ctx->cache)
+                _ctx->cache->noStore();
 
             return llvm::Error::success();
         }
@@ -280,6 +541,7 @@ llvm::Error Function::translateInstrs(uint64_t st, uint64_t end)
         BasicBlock* bb = bld->getInsertBlock();
         if (auto err = inst.translate())
             return err;
+        _ctx->translatedInstrs++;
         // add translated instruction to BB's instruction map
         llvm::Instruction* first = bld->first();
         llvm::BasicBlock* fbb = first->getParent();
@@ -315,7 +577,7 @@ llvm::Error Function::translateInstrs(uint64_t st, uint64_t end)
 }
 
 
-static int isFunction(ConstSymbolPtrVec symv)
+static int isFunction(ConstSymbolRange symv)
 {
     int i = 1;
     for (const auto& sym : symv) {
@@ -343,8 +605,11 @@ bool Function::isFunction(Context* ctx, uint64_t addr, ConstSectionPtr sec)
     // get symbol by offset
     if (!sec)
         sec = ctx->sec->section();
-    ConstSymbolPtrVec symv = sec->lookup(addr);
-    return sbt::isFunction(symv);
+    ConstSymbolRange symv = sec->lookup(addr);
+    bool isFunc = sbt::isFunction(symv);
+    if (ctx->cache)
+        ctx->cache->recordIsFunc(addr, isFunc);
+    return isFunc;
 }
 
 
@@ -366,7 +631,7 @@ Function* Function::getByAddr(Context* ctx, uint64_t addr, ConstSectionPtr sec)
     }
 
     // get symbol by offset
-    ConstSymbolPtrVec symv = sec->lookup(addr);
+    ConstSymbolRange symv = sec->lookup(addr);
     // XXX lookup by symbol name
     if (symv.empty())
         DBGF("WARNING: symbol not found at {0:X+8}", addr);
@@ -377,9 +642,11 @@ Function* Function::getByAddr(Context* ctx, uint64_t addr, ConstSectionPtr sec)
     if (!(n=sbt::isFunction(symv)))
         name = "f" + llvm::Twine::utohexstr(addr).str();
     else
-        name = symv.at(--n)->name();
+        name = symv[--n]->name();
     FunctionPtr f(new Function(ctx, name, ssec, addr));
     f->create();
+    if (ctx->cache)
+        ctx->cache->noStore();
     // insert in maps
     ctx->addFunc(std::move(f));
 
@@ -528,96 +795,246 @@ static bool syncReg(size_t i, int syncFlags)
 }
 
 
-void Function::loadRegisters(int syncFlags)
+Decoder::RegSet Function::liveRegs(int syncFlags, const Function* callee) const
 {
-    if (!localRegs())
-        return;
+    // on calls, sync the registers of the callee,
+    // on function entry/exit, our own
+    const Function* f = (syncFlags & (S_CALL | S_CALL_RETURNED))?
+        callee : this;
+    const SBTSection::RegUsage* ru =
+        f && f->_sec? f->_sec->regUsage(f->_addr) : nullptr;
+
+    // unknown function: sync everything
+    Decoder::RegSet regs;
+    if (!ru) {
+        regs.x = ~0u;
+        regs.f = ~0u;
+        return regs;
+    }
 
-    Builder* bld = _ctx->bld;
-    xassert(bld);
-    syncFlags |= S_LOAD;
-    syncFlags |= abi()? S_ABI : 0;
+    // Registers written by the function must be synced after it returns.
+    // Before it starts, the registers that it reads must be synced, but
+    // also the ones that it writes, because these are all stored back
+    // on return, even if not written in every path.
+    regs = ru->def;
+    if (syncFlags & (S_CALL | S_FUNC_START))
+        regs |= ru->use;
+    return regs;
+}
 
-    auto loadXReg = [&](size_t i) {
-        if (!syncReg(i, syncFlags | S_XREG))
-            return;
 
-        Register& local = getReg(i);
-        Register& global = _ctx->x->getReg(i);
-        // NOTE don't count this write
-        llvm::Value* v = bld->load(global.getForRead());
-        bld->store(v, local.get());
-    };
+Decoder::RegSet Function::byValRegs(
+    int syncFlags,
+    const Function* callee) const
+{
+    Decoder::RegSet regs;
+    const SBTSection::RegUsage* sig;
+
+    if (syncFlags & S_CALL) {
+        if (callee && (sig = callee->sig()))
+            regs = sig->args;
+    } else if (syncFlags & S_CALL_RETURNED) {
+        // arguments not written by the callee are still valid
+        if (callee && (sig = callee->sig())) {
+            regs = sig->args;
+            regs &= ~sig->def;
+            regs |= sig->rets;
+        }
+    } else if (syncFlags & S_FUNC_START) {
+        if ((sig = this->sig()))
+            regs = sig->args;
+    } else if (syncFlags & S_FUNC_RETURN) {
+        if ((sig = this->sig()))
+            regs = sig->rets;
+    }
+    return regs;
+}
 
-    auto loadFReg = [&](size_t i) {
-        if (!_ctx->opts->syncFRegs())
-            return;
 
-        if (!syncReg(i, syncFlags))
-            return;
+void Function::loadRegisters(int syncFlags, const Function* callee)
+{
+    if (!localRegs())
+        return;
 
-        Register& local = getFReg(i);
-        Register& global = _ctx->f->getReg(i);
-        // NOTE don't count this write
-        llvm::Value* v = bld->load(global.getForRead());
-        bld->store(v, local.get());
-    };
+    const Decoder::RegSet byVal = byValRegs(syncFlags, callee);
+    syncFlags |= S_LOAD;
+    syncFlags |= abi()? S_ABI : 0;
 
-    for (size_t i = 1; i < XRegisters::NUM; i++)
-        loadXReg(i);
-    for (size_t i = 0; i < FRegisters::NUM; i++)
-        loadFReg(i);
+    // in live mode, the return registers of external functions are
+    // handled by syncReg()
+    bool useLive = live() && !(syncFlags & S_RET_REGS_ONLY);
+    Decoder::RegSet regs;
+    if (useLive)
+        regs = liveRegs(syncFlags, callee);
+
+    uint32_t xmask = 0;
+    uint32_t fmask = 0;
+    for (size_t i = 1; i < XRegisters::NUM; i++) {
+        if (byVal.x & (1u << i))
+            continue;
+        if (useLive? !(regs.x & (1u << i)) : !syncReg(i, syncFlags | S_XREG))
+            continue;
+        xmask |= 1u << i;
+    }
+    const bool syncF = _ctx->opts->syncFRegs();
+    for (size_t i = 0; syncF && i < FRegisters::NUM; i++) {
+        if (byVal.f & (1u << i))
+            continue;
+        if (useLive? !(regs.f & (1u << i)) : !syncReg(i, syncFlags))
+            continue;
+        fmask |= 1u << i;
+    }
+
+    syncRegs(xmask, fmask, true);
 }
 
 
-void Function::storeRegisters(int syncFlags)
+void Function::storeRegisters(int syncFlags, const Function* callee)
 {
     if (!localRegs())
         return;
 
-    Builder* bld = _ctx->bld;
-    xassert(bld);
+    const Decoder::RegSet byVal = byValRegs(syncFlags, callee);
     syncFlags |= abi()? S_ABI : 0;
 
-    auto storeXReg = [&](size_t i) {
-        if (!syncReg(i, syncFlags | S_XREG))
-            return;
+    bool useLive = live() && !(syncFlags & S_RET_REGS_ONLY);
+    Decoder::RegSet regs;
+    if (useLive)
+        regs = liveRegs(syncFlags, callee);
+
+    uint32_t xmask = 0;
+    uint32_t fmask = 0;
+    for (size_t i = 1; i < XRegisters::NUM; i++) {
+        if (byVal.x & (1u << i))
+            continue;
+        if (useLive? !(regs.x & (1u << i)) : !syncReg(i, syncFlags | S_XREG))
+            continue;
+        xmask |= 1u << i;
+    }
+    const bool syncF = _ctx->opts->syncFRegs();
+    for (size_t i = 0; syncF && i < FRegisters::NUM; i++) {
+        if (byVal.f & (1u << i))
+            continue;
+        if (useLive? !(regs.f & (1u << i)) : !syncReg(i, syncFlags))
+            continue;
+        fmask |= 1u << i;
+    }
 
-        Register& local = getReg(i);
-        Register& global = _ctx->x->getReg(i);
-        // NOTE don't count this read
-        llvm::Value* v = bld->load(local.get());
-        bld->store(v, global.getForWrite());
-    };
+    syncRegs(xmask, fmask, false);
+}
 
-    auto storeFReg = [&](size_t i) {
-        if (!_ctx->opts->syncFRegs())
-            return;
 
-        if (!syncReg(i, syncFlags))
-            return;
+void Function::syncRegs(uint32_t xmask, uint32_t fmask, bool load)
+{
+    Builder* bld = _ctx->bld;
+    xassert(bld);
+    const Types& t = _ctx->t;
+    const RegFile* rf = _ctx->regFile;
+
+    auto sync = [&](Register::Type type, uint32_t mask) {
+        const bool fp = type == Register::T_FLOAT;
+        llvm::Type* ety = fp? t.fp64 : t.i32;
+        const unsigned num = fp? FRegisters::NUM : XRegisters::NUM;
+        const unsigned lanes = SYNC_VEC_BYTES / (fp? 8 : 4);
+
+        auto local = [&](unsigned i) -> Register& {
+            return fp? getFReg(i) : getReg(i);
+        };
+        auto global = [&](unsigned i) -> Register& {
+            return fp? _ctx->f->getReg(i) : _ctx->x->getReg(i);
+        };
+
+        for (unsigned i = 0; i < num; ) {
+            if (!(mask & (1u << i))) {
+                i++;
+                continue;
+            }
+
+            // with the register file, registers that are next to each
+            // other are synced together, without crossing vector
+            // boundaries
+            unsigned n = 1;
+            if (rf) {
+                while (n < lanes && (i + n) % lanes != 0 &&
+                        (mask & (1u << (i + n))))
+                    n++;
+            }
 
-        Register& local = getFReg(i);
-        Register& global = _ctx->f->getReg(i);
-        // NOTE don't count this read
-        llvm::Value* v = bld->load(local.get());
-        bld->store(v, global.getForWrite());
+            // NOTE don't count the accesses to local registers
+            if (n == 1) {
+                if (load) {
+                    llvm::Value* v = bld->load(global(i).getForRead());
+                    bld->store(v, local(i).get());
+                } else {
+                    llvm::Value* v = bld->load(local(i).get());
+                    bld->store(v, global(i).getForWrite());
+                }
+                i++;
+                continue;
+            }
+
+            llvm::Type* vty = llvm::VectorType::get(ety, n);
+            llvm::Value* ptr = load?
+                global(i).getForRead() : global(i).getForWrite();
+            for (unsigned j = 1; j < n; j++) {
+                if (load)
+                    global(i + j).getForRead();
+                else
+                    global(i + j).getForWrite();
+            }
+            ptr = bld->bitOrPointerCast(ptr, vty->getPointerTo());
+            const unsigned align = rf->align(type, i);
+
+            if (load) {
+                llvm::LoadInst* v = bld->load(ptr);
+                v->setAlignment(align);
+                for (unsigned j = 0; j < n; j++)
+                    bld->store(bld->extractElement(v, j), local(i + j).get());
+            } else {
+                llvm::Value* v = llvm::UndefValue::get(vty);
+                for (unsigned j = 0; j < n; j++)
+                    v = bld->insertElement(v,
+                        bld->load(local(i + j).get()), j);
+                llvm::StoreInst* st = bld->store(v, ptr);
+                st->setAlignment(align);
+            }
+            i += n;
+        }
     };
 
-    for (size_t i = 1; i < XRegisters::NUM; i++)
-        storeXReg(i);
-    for (size_t i = 0; i < FRegisters::NUM; i++)
-        storeFReg(i);
+    sync(Register::T_INT, xmask);
+    sync(Register::T_FLOAT, fmask);
 }
 
 
 void Function::freturn()
 {
+    Builder* bld = _ctx->bld;
+    // return through the region's return dispatch
+    if (oneRegion() && !_ctx->inMain) {
+        bld->br(_sec->region()->retBB());
+        return;
+    }
+
     storeRegisters(S_FUNC_RETURN);
-    if (_ctx->inMain)
-        _ctx->bld->ret(_ctx->bld->load(XRegister::A0));
-    else
-        _ctx->bld->retVoid();
+    if (_ctx->inMain) {
+        bld->ret(bld->load(XRegister::A0));
+        return;
+    }
+
+    const SBTSection::RegUsage* sig = this->sig();
+    if (!sig || sig->rets.empty()) {
+        bld->retVoid();
+        return;
+    }
+
+    // return values
+    std::vector<llvm::Value*> vals;
+    for (const SigReg& r : sigRegs(sig->rets)) {
+        Register& local = r.fp? getFReg(r.num) : getReg(r.num);
+        vals.push_back(bld->load(local.getForRead()));
+    }
+    bld->ret(packRets(bld, _f->getReturnType(), vals));
 }
 
 
@@ -632,234 +1049,49 @@ void Function::copyArgv()
     bld->store(&argv, XRegister::A1);
 }
 
-///             ///
-/// SPILL CODE  ///
-///             ///
-
-#define DEBUG_SPILL 0
-#if DEBUG_SPILL
-#define SDBG DBG
-#else
-#define SDBG(a) do { ; } while (0)
-#endif
-
-static bool optStack(Context* ctx)
-{
-    auto regs = ctx->opts->regs();
-    // bool locals = regs == Options::Regs::LOCALS;
-    bool abi = regs == Options::Regs::ABI;
-
-    return abi && ctx->opts->optStack();
-}
-
+///                 ///
+/// STACK SLOT CODE ///
+///                 ///
 
-void Function::spillInit()
+void Function::createStackSlots()
 {
-    if (optStack(_ctx))
+    _stackSlots.clear();
+    if (!_ctx->opts->optStack() || oneRegion())
         return;
 
-    _cfaOffs = INVALID_CFA;
-    _spillMap.clear();
-}
-
-
-static int64_t getConstInt(llvm::Constant* imm)
-{
-    llvm::ConstantInt* ci = llvm::dyn_cast<llvm::ConstantInt>(imm);
-    xassert(ci);
-    return ci->getSExtValue();
-}
-
-
-static llvm::Constant* getOpVal(llvm::Value* op);
-
-static llvm::Constant* getLIVal(llvm::Value* li)
-{
-    // li -> addi (lui r, hi), rhs
-    SDBG(llvm::errs() << "li: "; li->dump());
-    auto* inst = llvm::dyn_cast<llvm::Instruction>(li);
-    xassert(inst && inst->getOpcode() == llvm::Instruction::Add);
-    // lhs = lui
-    auto* lhs = llvm::dyn_cast<llvm::LoadInst>(inst->getOperand(0));
-    // rhs = lo
-    auto* rhs = llvm::dyn_cast<llvm::Constant>(inst->getOperand(1));
-    xassert(lhs && rhs);
-    SDBG(llvm::errs() << "lhs: "; lhs->dump());
-    SDBG(llvm::errs() << "rhs: "; rhs->dump());
-    auto* hi = getOpVal(lhs);
-    SDBG(llvm::errs() << "hi: "; hi->dump());
-    // imm = hi + lo
-    int64_t imm = getConstInt(hi) + getConstInt(rhs);
-    llvm::Type* ty = rhs->getType();
-    return llvm::ConstantInt::get(ty, imm, true);
-}
-
-
-static llvm::Constant* getOpVal(llvm::Value* op)
-{
-    // not a constant, must be an instruction
-    auto* inst = llvm::dyn_cast<llvm::Instruction>(op);
-    SDBG(llvm::errs() << "inst: "; inst->dump());
-    // only Load is supported for now: val = ld ptr
-    xassert(inst && inst->getOpcode() == llvm::Instruction::Load);
-    op = inst->getOperand(0);
-    xassert(op);
-    SDBG(llvm::errs() << "op: "; op->dump());
-    // get the Store inst right before the Load: st val, ptr
-    xassert(op->hasNUsesOrMore(2));
-    llvm::User* uld = nullptr, *ust = nullptr;
-    for (auto user : op->users()) {
-        SDBG(llvm::errs() << "user: "; user->dump());
-        if (user == inst)
-            uld = user;
-        else if (uld) {
-            ust = user;
-            break;
-        }
-    }
-    xassert(uld && ust);
-    SDBG(llvm::errs() << "uld: "; uld->dump());
-    SDBG(llvm::errs() << "ust: "; ust->dump());
-    auto* st = llvm::dyn_cast<llvm::StoreInst>(ust);
-    xassert(st);
-    op = st->getOperand(0);
-    xassert(op);
-    auto* imm = llvm::dyn_cast<llvm::Constant>(op);
-    if (!imm)
-        imm = getLIVal(op);
-    xassert(imm);
-    SDBG(imm->dump());
-    return imm;
-}
-
-
-void Function::setCFAOffs(llvm::Value* v)
-{
-    if (!optStack(_ctx))
+    const std::vector<SBTSection::StackSlot>* slots = _sec->stackSlots(_addr);
+    if (!slots)
         return;
 
-    // SDBG(llvm::errs() << "v: "; v->dump());
-    llvm::Instruction* inst = llvm::dyn_cast<llvm::Instruction>(v);
-    xassert(inst && inst->getOpcode() == llvm::Instruction::Add);
-    SDBG(llvm::errs() << "inst: "; inst->dump());
-    llvm::Value* op = inst->getOperand(1);
-    xassert(op);
-    llvm::Constant* imm = llvm::dyn_cast<llvm::Constant>(op);
-    if (!imm)
-        imm = getOpVal(op);
-    int64_t addr = getConstInt(imm);
-    xassert(_cfaOffs != INVALID_CFA || addr < 0);
-
-    if (_cfaOffs == INVALID_CFA)
-        _cfaOffs = addr;
-    else {
-        // skip restores
-        if (_cfaOffs + addr == 0) {
-            DBGF("SPILL: restore skipped: addr={0}, CFA={1}", addr, _cfaOffs);
-            return;
-        }
-        _cfaOffs += addr;
-    }
-    DBGF("SPILL: addr={0}, CFA={1}", addr, _cfaOffs);
-    xassert(_cfaOffs % 16 == 0 && "SP must always be 16-byte aligned");
-}
-
-
-Function::Spill::Spill(
-    Context* ctx,
-    BasicBlock* bb,
-    int64_t idx,
-    Register::Type t)
-    :
-    _rty(t)
-{
-    Builder* bld = ctx->bld;
-    xassert(bld);
-    xassert(bb);
-    llvm::Type* ty = t == Register::T_INT? ctx->t.i32 : ctx->t.fp64;
-
-    bld->saveInsertBlock();
-    bld->setInsertBlock(bb, true/*begin*/);
-    _var = bld->_alloca(ty, nullptr, "sp" + std::to_string(idx));
-    _i32 = bld->bitOrPointerCast(_var, ctx->t.i32);
-    bld->restoreInsertBlock();
-}
-
+    const Types& t = _ctx->t;
+    Builder* bld = _ctx->bld;
+    for (const SBTSection::StackSlot& slot : *slots) {
+        llvm::Type* ty;
+        if (slot.fp)
+            ty = slot.size == 4? t.fp32 : t.fp64;
+        else
+            ty = llvm::Type::getIntNTy(*_ctx->ctx, slot.size * 8);
 
-static const char* estr(Register::Type t)
-{
-    switch (t) {
-        case Register::Type::T_INT:     return "INT";
-        case Register::Type::T_FLOAT:   return "FLOAT";
+        DBGF("slot: offs={0}, size={1}, fp={2}", slot.offs, slot.size, slot.fp);
+        _stackSlots[slot.offs] = bld->_alloca(ty, nullptr,
+            IRNAME("sp" + std::to_string(-slot.offs)));
     }
 }
 
 
-llvm::Value* Function::getSpilledAddress(llvm::Constant* imm, Register::Type t)
+llvm::Value* Function::stackSlot(uint64_t addr) const
 {
-    if (!optStack(_ctx))
+    if (_stackSlots.empty())
         return nullptr;
 
-    xassert(_cfaOffs != INVALID_CFA);
-    int64_t offs = getConstInt(imm);
-    // get closest multiple of 4
-    if (offs % 4 != 0) {
-        DBGF("WARNING: SPILL: offs({0}) % 4 != 0", offs);
-        offs &= ~3;
-    }
-    int64_t idx = -_cfaOffs - offs;
-    if (idx < 4) {
-        DBGF("WARNING: SPILL: offs={0}, idx({1}) < 4", offs, idx);
+    const int64_t* offs = _sec->stackAccess(addr);
+    if (!offs)
         return nullptr;
-    }
 
-    const Spill* spill;
-    auto it = _spillMap.find(idx);
-    if (it == _spillMap.end()) {
-        DBGF("SPILL: new: offs={0}, idx={1}", offs, idx);
-        auto p = _spillMap.insert({idx, Spill(_ctx, findBB(_addr), idx, t)});
-        spill = &p.first->second;
-    } else {
-        DBGF("SPILL: offs={0}, idx={1}", offs, idx);
-        spill = &it->second;
-        if (t != spill->regType()) {
-            DBGF("WARNING: SPILL: accessing spill data with different type: "
-                 "spill={0}, access={1}",
-                 estr(spill->regType()), estr(t));
-        }
-    }
-    return spill->val();
-
-    /*
-    CFA - 4 = ra
-    CFA - 8 = s0
-    CFA -12 = s1
-    CFA -16 = s2
-    CFA -20 = s3
-    CFA -24 = s4
-    CFA -28 = s5
-    CFA -32 = s6
-    CFA -36 = s7
-    CFA -40 = s8
-    CFA -44 = s9
-    CFA -48 = s10
-    CFA -52 = s11
-    CFA -56 = 16-byte pad
-    CFA -60 = 16-byte pad
-    CFA -64 = 16-byte pad
-    CFA -72 = fs0
-    CFA -80 = fs1
-    CFA -88 = fs2
-    CFA -96 = fs3
-    CFA-104 = fs4
-    CFA-112 = fs5
-    CFA-120 = fs6
-    CFA-128 = fs7
-    CFA-136 = fs8
-    CFA-144 = fs9
-    CFA-152 = fs10
-    CFA-160 = fs11
-    */
+    auto it = _stackSlots.find(*offs);
+    if (it == _stackSlots.end())
+        return nullptr;
+    return it->second;
 }
 
 }
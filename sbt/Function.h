@@ -3,10 +3,12 @@
 
 #include "BasicBlock.h"
 #include "Context.h"
+#include "Decoder.h"
 #include "FRegister.h"
 #include "Map.h"
 #include "Object.h"
 #include "Pointer.h"
+#include "Section.h"
 #include "XRegister.h"
 
 #include <llvm/ADT/StringRef.h>
@@ -18,6 +20,7 @@
 
 
 namespace llvm {
+class AllocaInst;
 class BasicBlock;
 class Function;
 class Instruction;
@@ -26,8 +29,6 @@ class Module;
 
 namespace sbt {
 
-class SBTSection;
-
 class Function
 {
 public:
@@ -55,13 +56,18 @@ public:
         _sec(sec),
         _addr(addr),
         _end(end),
-        _regsMode(_ctx->opts->regs())
-    {}
+        _regsMode(sec? sec->regsMode() : _ctx->opts->regs())
+    {
+        // only guest functions can be part of a region
+        if (!sec && oneRegion())
+            _regsMode = Options::Regs::LOCALS;
+    }
 
     /**
      * Create the function.
      *
-     * @param ft function type
+     * @param ft function type (if null, the type given by the function's
+     *           signature is used, or void() if it has none)
      * @param linkage function linkage
      */
     void create(
@@ -90,6 +96,33 @@ public:
         return _addr;
     }
 
+    // section (null if not a guest function)
+    SBTSection* sec() const
+    {
+        return _sec;
+    }
+
+    /**
+     * Get the function to use when this one is called indirectly, or
+     * when its address is taken.
+     *
+     * Functions with a recovered signature (-func-sigs) get a void()
+     * wrapper, that passes their arguments and return values through the
+     * global register file. Wrappers are only declared here, and are
+     * defined later by genICallWrapper().
+     */
+    llvm::Function* icallFunc();
+
+    // define the wrapper returned by icallFunc(), if it was used
+    void genICallWrapper();
+
+    /**
+     * Call another translated function, passing its arguments and
+     * getting its return values in local registers, if it has a
+     * signature.
+     */
+    void call(Function* f);
+
     // BB helpers
 
     /**
@@ -124,7 +157,8 @@ public:
      */
     BasicBlock* newUBB(uint64_t addr, const std::string& name)
     {
-        const std::string bbname = BasicBlock::getBBName(addr) + "_" + name;
+        const std::string bbname =
+            IRNAME(BasicBlock::getBBName(addr) + "_" + name);
         BasicBlock* beforeBB = lowerBoundBB(addr + Constants::INSTRUCTION_SIZE);
         BasicBlock* bb = new BasicBlock(_ctx, bbname, _f,
             beforeBB? beforeBB->bb() : nullptr);
@@ -235,7 +269,7 @@ public:
      */
     Register& getReg(size_t i)
     {
-        if (locals() || abi()) {
+        if (localRegs()) {
             xassert(_regs);
             return _regs->getReg(i);
         } else
@@ -247,7 +281,7 @@ public:
      */
     Register& getFReg(size_t i)
     {
-        if (locals() || abi()) {
+        if (localRegs()) {
             xassert(_fregs);
             return _fregs->getReg(i);
         } else
@@ -266,8 +300,17 @@ public:
         return _regsMode == Options::Regs::ABI;
     }
 
+    bool live() const {
+        return _regsMode == Options::Regs::LIVE;
+    }
+
+    // translated as part of its section's region
+    bool oneRegion() const {
+        return _regsMode == Options::Regs::ONEREGION;
+    }
+
     bool localRegs() const {
-        return locals() || abi();
+        return locals() || abi() || live() || oneRegion();
     }
 
     /**
@@ -286,13 +329,24 @@ public:
         S_XREG          = 0x80
     };
 
-    // sync local register file
-    void loadRegisters(int syncFlags = 0);
-    void storeRegisters(int syncFlags = 0);
+    /**
+     * Sync local register file.
+     *
+     * @param syncFlags
+     * @param callee function being called, on S_CALL/S_CALL_RETURNED
+     *               (null if unknown)
+     */
+    void loadRegisters(int syncFlags = 0, const Function* callee = nullptr);
+    void storeRegisters(int syncFlags = 0, const Function* callee = nullptr);
     void freturn();
 
-    void setCFAOffs(llvm::Value* v);
-    llvm::Value* getSpilledAddress(llvm::Constant* imm, Register::Type t);
+    /**
+     * Get the host copy of the guest stack slot accessed by the load/store
+     * at the given address (-opt-stack).
+     *
+     * @return null if the slot must be accessed in guest memory
+     */
+    llvm::Value* stackSlot(uint64_t addr) const;
 
     // setup argc/argv
     void copyArgv();
@@ -316,6 +370,17 @@ public:
         _indBBs.push_back(ibb);
     }
 
+    // address read by a jump table load (see SBTSection::JumpTable)
+    void setJumpTableAddr(uint64_t load, llvm::Value* addr) {
+        _jtLoad = load;
+        _jtAddr = addr;
+    }
+
+    // returns null if the load was not translated by this function
+    llvm::Value* jumpTableAddr(uint64_t load) const {
+        return load == _jtLoad? _jtAddr : nullptr;
+    }
+
     void processIndirectBranches();
 
 private:
@@ -337,37 +402,19 @@ private:
 
     Function* _nextf = nullptr;
 
-    std::unique_ptr<XRegisters> _regs;
-    std::unique_ptr<FRegisters> _fregs;
+    // (shared by all functions of a region)
+    std::shared_ptr<XRegisters> _regs;
+    std::shared_ptr<FRegisters> _fregs;
 
     // indirect branches
     std::vector<llvm::IndirectBrInst*> _indBrs;
     std::vector<BasicBlock*> _indBBs;
+    // last jump table load
+    uint64_t _jtLoad = ~0ull;
+    llvm::Value* _jtAddr = nullptr;
 
-    // spill data
-    static const int64_t INVALID_CFA = ~0ll;
-    int64_t _cfaOffs = INVALID_CFA;
-
-
-    class Spill {
-    public:
-        Spill(Context* ctx, BasicBlock* bb, int64_t idx, Register::Type t);
-
-        Register::Type regType() const {
-            return _rty;
-        }
-
-        llvm::Value* val() const {
-            return _i32;
-        }
-
-    private:
-        llvm::Value* _var;
-        llvm::Value* _i32;
-        Register::Type _rty;
-    };
-
-    std::map<int64_t, Spill> _spillMap;
+    // host copies of guest stack slots, by CFA offset (-opt-stack)
+    std::map<int64_t, llvm::AllocaInst*> _stackSlots;
 
     // methods
 
@@ -375,7 +422,25 @@ private:
     llvm::Error start();
     llvm::Error finish();
 
-    void spillInit();
+    // create the BBs of this function that are already known
+    void createBBs();
+
+    // registers to sync, in live mode
+    Decoder::RegSet liveRegs(int syncFlags, const Function* callee) const;
+    // registers passed by value, that must not be synced
+    Decoder::RegSet byValRegs(int syncFlags, const Function* callee) const;
+    // sync the local registers in the masks with the global ones
+    // (vector loads/stores are used with the global register file)
+    void syncRegs(uint32_t xmask, uint32_t fmask, bool load);
+    // max size of a vector register sync
+    static const unsigned SYNC_VEC_BYTES = 32;
+
+    // recovered signature (null if none)
+    const SBTSection::RegUsage* sig() const;
+    llvm::FunctionType* sigType() const;
+
+    // create the host copies of the stack slots that don't escape
+    void createStackSlots();
 };
 
 using FunctionPtr = Pointer<Function>;
@@ -6,14 +6,20 @@
 #include "Caller.h"
 #include "Context.h"
 #include "Disassembler.h"
+#include "Profile.h"
 #include "Register.h"
 #include "Relocation.h"
 #include "SBTError.h"
 #include "Section.h"
+#include "ShadowImage.h"
+#include "Stack.h"
 #include "Syscall.h"
+#include "TBAA.h"
 #include "Translator.h"
 
 #include <llvm/IR/InlineAsm.h>
+#include <llvm/IR/IntrinsicInst.h>
+#include <llvm/MC/MCInst.h>
 #include <llvm/Support/FormatVariadic.h>
 
 // LLVM internal instruction info
@@ -40,7 +46,7 @@ Instruction::Instruction(Context* ctx, uint64_t addr, uint32_t rawInst)
     _ss(new llvm::raw_string_ostream(_s)),
     _os(&*_ss),
 #else
-    _os(&llvm::nulls()),
+    _os(&_ns),
 #endif
     _bld(_ctx->bld)
 {
@@ -62,9 +68,20 @@ llvm::Error Instruction::translate()
     // print address
     *_os << llvm::formatv("{0:X-8}:\t", _addr);
 
-    // disasm
-    size_t size;
-    if (auto err = _ctx->disasm->disasm(_addr, _rawInst, _inst, size)) {
+    // decode
+    // (instructions of pre-decoded sections were already decoded)
+    if (!_ctx->sec->decodedInst(_addr, _inst) &&
+        !Decoder::decode(_rawInst, _inst))
+    {
+        // not an RV32G instruction: use the MC disassembler to tell
+        // invalid encodings apart from unsupported instructions
+        llvm::MCInst mcinst;
+        size_t size;
+        llvm::Error err = _ctx->disasm->disasm(_addr, _rawInst, mcinst, size);
+        if (!err)
+            return ERRORF("unknown instruction opcode: {0}",
+                mcinst.getOpcode());
+
         // handle invalid encoding
         llvm::Error err2 = llvm::handleErrors(std::move(err),
             [&](const InvalidInstructionEncoding& serr) -> llvm::Error {
@@ -86,10 +103,18 @@ llvm::Error Instruction::translate()
         else
             return llvm::Error::success();
     }
+    Decoder::operands(_inst, _ops);
+
+#if SBT_DEBUG
+    // disasm
+    llvm::MCInst mcinst;
+    Decoder::toMCInst(_inst, mcinst);
+    _ctx->disasm->print(_addr, mcinst);
+#endif
 
     llvm::Error err = noError();
 
-    switch (_inst.getOpcode()) {
+    switch (_inst.opcode) {
         // ALU ops
         case RISCV::ADD:
             err = translateALUOp(ADD, AF_NONE);
@@ -299,8 +324,9 @@ unsigned Instruction::getRD(bool out)
 
 unsigned Instruction::getRegNum(unsigned op, bool out)
 {
-    const llvm::MCOperand& r = _inst.getOperand(op);
-    unsigned nr = XRegister::num(r.getReg());
+    const Decoder::Operand& r = _ops[op];
+    xassert(r.kind == Decoder::Operand::XREG);
+    unsigned nr = r.val;
     if (out)
         *_os << _ctx->x->getReg(nr).name() << ", ";
     return nr;
@@ -309,8 +335,9 @@ unsigned Instruction::getRegNum(unsigned op, bool out)
 
 llvm::Value* Instruction::getReg(int op, bool out)
 {
-    const llvm::MCOperand& mcop = _inst.getOperand(op);
-    unsigned nr = XRegister::num(mcop.getReg());
+    const Decoder::Operand& r = _ops[op];
+    xassert(r.kind == Decoder::Operand::XREG);
+    unsigned nr = r.val;
     llvm::Value* v;
     if (nr == 0)
         v = _ctx->c.ZERO;
@@ -328,7 +355,7 @@ llvm::Value* Instruction::getReg(int op, bool out)
 
 llvm::Expected<llvm::Value*> Instruction::getRegOrImm(int op, bool out)
 {
-    const llvm::MCOperand& o = _inst.getOperand(op);
+    const Decoder::Operand& o = _ops[op];
     if (o.isReg())
         return getReg(op, out);
     else if (o.isImm())
@@ -339,7 +366,12 @@ llvm::Expected<llvm::Value*> Instruction::getRegOrImm(int op, bool out)
 
 llvm::Expected<llvm::Constant*> Instruction::getImm(int op, bool out)
 {
-    auto expC = _ctx->reloc->handleRelocation(_addr, out? _os : nullptr);
+#if SBT_DEBUG
+    llvm::raw_ostream* os = out? _os : nullptr;
+#else
+    llvm::raw_ostream* os = nullptr;
+#endif
+    auto expC = _ctx->reloc->handleRelocation(_addr, os);
     if (!expC)
         return expC.takeError();
 
@@ -349,7 +381,8 @@ llvm::Expected<llvm::Constant*> Instruction::getImm(int op, bool out)
         return c;
 
     // case 2: absolute immediate value
-    int64_t imm = _inst.getOperand(op).getImm();
+    xassert(_ops[op].isImm());
+    int64_t imm = _ops[op].val;
     c = _c->i32(imm);
     if (out)
         *_os << llvm::formatv("{0}", imm);
@@ -368,12 +401,6 @@ const char* Instruction::estr(ALUOpAlias e)
 }
 
 
-static bool optStack(Context* ctx)
-{
-    return ctx->opts->optStack();
-}
-
-
 llvm::Error Instruction::translateALUOp(ALUOp op, uint32_t flags)
 {
     bool hasImm = flags & AF_IMM;
@@ -409,16 +436,11 @@ llvm::Error Instruction::translateALUOp(ALUOp op, uint32_t flags)
     } else
         o2 = getReg(2);
 
-    // possible stack reference to spill area
-    /*
-    if (optStack(_ctx) && op == ADD && hasImm &&
-            o1n == XRegister::SP && o != XRegister::SP) {
-        auto* imm = llvm::dyn_cast<llvm::Constant>(o2);
-        if (imm) {
-            v = _bld->getSpilledAddress(imm, Register::T_INT);
-        }
+    // %hi()/%lo() pair: use guest data address directly
+    if (op == ADD && hasImm) {
+        if (llvm::Constant* lo = hiLoPtr(o1))
+            v = llvm::ConstantExpr::getPtrToInt(lo, _t->i32);
     }
-    */
 
     // optimize aliases
     ALUOpAlias opa = A_NONE;
@@ -622,6 +644,184 @@ llvm::Type* Instruction::getLLVMTy(IntType ity) const
 }
 
 
+void Instruction::tagMem(llvm::Instruction* i, unsigned rs1)
+{
+    TBAA* tbaa = _ctx->tbaa;
+    if (!tbaa)
+        return;
+
+    // address relocated to a symbol: we know its section
+    std::string sec = _ctx->reloc->lastSection(_addr);
+    if (!sec.empty())
+        tbaa->tagSec(i, sec);
+    // SP based: guest stack
+    else if (getRegNum(rs1, false) == XRegister::SP)
+        tbaa->tagMem(i, TBAA::STACK);
+    else
+        tbaa->tagMem(i);
+}
+
+
+llvm::Constant* Instruction::hiLoPtr(llvm::Value* rs1)
+{
+    llvm::Constant* hi;
+    llvm::Constant* ptr = _ctx->reloc->lastLo(_addr, hi);
+    auto* ld = llvm::dyn_cast<llvm::LoadInst>(rs1);
+    if (!ptr || !ld)
+        return nullptr;
+
+    // rs1 must have been set to %hi() in the same block
+    if (lastStore(ld) != hi)
+        return nullptr;
+    DBGF("folding %hi/%lo pair @{0:X+8}", _addr);
+    return ptr;
+}
+
+
+llvm::Value* Instruction::lastStore(llvm::LoadInst* ld)
+{
+    // (calls may change it)
+    llvm::BasicBlock* bb = ld->getParent();
+    for (auto it = ld->getIterator(); it != bb->begin(); ) {
+        llvm::Instruction* i = &*--it;
+        if (auto* st = llvm::dyn_cast<llvm::StoreInst>(i)) {
+            if (st->getPointerOperand() == ld->getPointerOperand())
+                return st->getValueOperand();
+        } else if (llvm::isa<llvm::CallInst>(i) &&
+            !llvm::isa<llvm::IntrinsicInst>(i))
+            return nullptr;
+    }
+    return nullptr;
+}
+
+
+unsigned Instruction::xregNum(const llvm::Value* p)
+{
+    for (unsigned i = 1; i < XRegisters::NUM; i++)
+        if (p == _ctx->x->getReg(i).var() || p == _ctx->func->getReg(i).var())
+            return i;
+    return XRegister::ZERO;
+}
+
+
+// get the only global variable that constant c refers to
+static llvm::GlobalVariable* constGlobal(llvm::Constant* c)
+{
+    if (auto* gv = llvm::dyn_cast<llvm::GlobalVariable>(c))
+        return gv;
+    auto* ce = llvm::dyn_cast<llvm::ConstantExpr>(c);
+    if (!ce)
+        return nullptr;
+
+    llvm::GlobalVariable* gv = nullptr;
+    for (llvm::Value* op : ce->operand_values()) {
+        llvm::GlobalVariable* opgv = constGlobal(llvm::cast<llvm::Constant>(op));
+        if (!opgv)
+            continue;
+        if (gv && gv != opgv)
+            return nullptr;
+        gv = opgv;
+    }
+    return gv;
+}
+
+
+llvm::GlobalVariable* Instruction::addrBase(llvm::Value* v, unsigned depth)
+{
+    static const unsigned MAX_DEPTH = 8;
+
+    if (depth > MAX_DEPTH)
+        return nullptr;
+
+    // constant address: shadow section or stack global that it refers to
+    if (auto* c = llvm::dyn_cast<llvm::Constant>(v)) {
+        llvm::GlobalVariable* gv = constGlobal(c);
+        if (gv && (gv == _ctx->stack->var() || _ctx->shadowImage->isShadow(gv)))
+            return gv;
+        return nullptr;
+    }
+
+    // register: base of the last value stored in it
+    if (auto* ld = llvm::dyn_cast<llvm::LoadInst>(v)) {
+        unsigned reg = xregNum(ld->getPointerOperand());
+        if (reg == XRegister::ZERO)
+            return nullptr;
+        if (llvm::Value* st = lastStore(ld))
+            return addrBase(st, depth + 1);
+        // sp always points into the guest stack
+        if (reg == XRegister::SP)
+            return _ctx->stack->var();
+        return nullptr;
+    }
+
+    // pointer arithmetic: base of the pointer operand
+    auto* bo = llvm::dyn_cast<llvm::BinaryOperator>(v);
+    if (!bo || (bo->getOpcode() != llvm::Instruction::Add &&
+        bo->getOpcode() != llvm::Instruction::Sub))
+        return nullptr;
+    llvm::Value* op0 = bo->getOperand(0);
+    llvm::Value* op1 = bo->getOperand(1);
+    // pointer + int or pointer - int
+    // (an operand with unknown base may still be a pointer, and
+    // ptr - ptr is not an address)
+    if (isInt(op1, depth + 1))
+        return addrBase(op0, depth + 1);
+    if (bo->getOpcode() == llvm::Instruction::Add && isInt(op0, depth + 1))
+        return addrBase(op1, depth + 1);
+    return nullptr;
+}
+
+
+bool Instruction::isInt(llvm::Value* v, unsigned depth)
+{
+    static const unsigned MAX_DEPTH = 8;
+
+    if (depth > MAX_DEPTH)
+        return false;
+
+    if (llvm::isa<llvm::ConstantInt>(v))
+        return true;
+
+    // register: last value stored in it
+    if (auto* ld = llvm::dyn_cast<llvm::LoadInst>(v)) {
+        if (xregNum(ld->getPointerOperand()) == XRegister::ZERO)
+            return false;
+        llvm::Value* st = lastStore(ld);
+        return st && isInt(st, depth + 1);
+    }
+
+    // comparison results (slt/sltu)
+    if (llvm::isa<llvm::ICmpInst>(v))
+        return true;
+    if (auto* ci = llvm::dyn_cast<llvm::CastInst>(v))
+        return isInt(ci->getOperand(0), depth + 1);
+
+    // arithmetic on integers only
+    auto* bo = llvm::dyn_cast<llvm::BinaryOperator>(v);
+    return bo &&
+        isInt(bo->getOperand(0), depth + 1) &&
+        isInt(bo->getOperand(1), depth + 1);
+}
+
+
+llvm::Value* Instruction::basePtr(llvm::Value* rs1, llvm::Constant* imm)
+{
+    if (!_ctx->opts->gepAddr())
+        return nullptr;
+
+    llvm::GlobalVariable* base = addrBase(rs1);
+    if (!base)
+        return nullptr;
+    DBGF("base={0}", base->getName());
+
+    // base + (rs1 + imm - base)
+    llvm::Constant* bi = llvm::ConstantExpr::getPtrToInt(base, _t->i32);
+    llvm::Value* offs = _bld->add(_bld->sub(rs1, bi), imm);
+    llvm::Value* ptr = _bld->bitOrPointerCast(base, _t->i8ptr);
+    return _bld->inBoundsGEP(ptr, { offs });
+}
+
+
 llvm::Error Instruction::translateLoad(IntType it)
 {
     switch (it) {
@@ -654,20 +854,30 @@ llvm::Error Instruction::translateLoad(IntType it)
         return expImm.takeError();
     llvm::Constant* imm = expImm.get();
 
-#if 0
-    llvm::Value* v = nullptr;
-    unsigned rs1n = getRegNum(1, false);
-    if (optStack(_ctx) && rs1n == XRegister::SP)
-        v = _bld->getSpilledAddress(imm, Register::T_INT);
-    if (!v)
-        v = _bld->add(rs1, imm);
-#endif
+    // jump table entry: keep its address, to find out its index in
+    // handleIJump()
+    if (_ctx->sec->isJumpTableLoad(_addr))
+        _ctx->func->setJumpTableAddr(_addr, _bld->add(rs1, imm));
 
+    // stack slot kept in host memory, or guest memory address
     llvm::Type* ty = getLLVMTy(it);
-    llvm::Value* ptr = _bld->bitOrPointerCast(rs1, _t->i8ptr);
-    ptr = _bld->gep(ptr, { imm });
-    ptr = _bld->bitOrPointerCast(ptr, ty->getPointerTo());
-    llvm::Value* v = _bld->load(ptr);
+    llvm::Value* ptr = _ctx->func->stackSlot(_addr);
+    bool guest = !ptr;
+    if (guest) {
+        // %hi()/%lo() pair: address guest data directly
+        if (llvm::Constant* lo = hiLoPtr(rs1))
+            ptr = lo;
+        // known base object: inbounds GEP off it
+        else if (!(ptr = basePtr(rs1, imm))) {
+            ptr = _bld->bitOrPointerCast(rs1, _t->i8ptr);
+            ptr = _bld->gep(ptr, { imm });
+        }
+        ptr = _bld->bitOrPointerCast(ptr, ty->getPointerTo());
+    }
+    llvm::LoadInst* ld = _bld->load(ptr);
+    if (guest)
+        tagMem(ld, 1);
+    llvm::Value* v = ld;
 
     // to int32
     switch (it) {
@@ -718,21 +928,25 @@ llvm::Error Instruction::translateStore(IntType it)
         return expImm.takeError();
     llvm::Constant* imm = expImm.get();
 
-#if 0
-    unsigned rs1n = getRegNum(1, false);
-    llvm::Value* v = nullptr;
-    if (optStack(_ctx) && rs1n == XRegister::SP)
-        v = _bld->getSpilledAddress(imm, Register::T_INT);
-    if (!v)
-        v = _bld->add(rs1, imm);
-#endif
-
+    // stack slot kept in host memory, or guest memory address
     llvm::Type* ty = getLLVMTy(it);
-    llvm::Value* ptr = _bld->bitOrPointerCast(rs1, _t->i8ptr);
-    ptr = _bld->gep(ptr, { imm });
-    ptr = _bld->bitOrPointerCast(ptr, ty->getPointerTo());
+    llvm::Value* ptr = _ctx->func->stackSlot(_addr);
+    bool guest = !ptr;
+    if (guest) {
+        // %hi()/%lo() pair: address guest data directly
+        if (llvm::Constant* lo = hiLoPtr(rs1))
+            ptr = lo;
+        // known base object: inbounds GEP off it
+        else if (!(ptr = basePtr(rs1, imm))) {
+            ptr = _bld->bitOrPointerCast(rs1, _t->i8ptr);
+            ptr = _bld->gep(ptr, { imm });
+        }
+        ptr = _bld->bitOrPointerCast(ptr, ty->getPointerTo());
+    }
     rs2 = _bld->truncOrBitCast(rs2, ty);
-    _bld->store(rs2, ptr);
+    llvm::StoreInst* st = _bld->store(rs2, ptr);
+    if (guest)
+        tagMem(st, 1);
 
     return llvm::Error::success();
 }
@@ -859,7 +1073,7 @@ llvm::Error Instruction::translateCSR(CSROp op, bool imm)
     *_os << '\t';
 
     unsigned rd = getRegNum(0);
-    uint64_t csr = _inst.getOperand(1).getImm();
+    uint64_t csr = _ops[1].val;
     *_os << CSR::name(static_cast<CSR::Num>(csr)) << ", ";
     uint64_t src;
     llvm::Value* srcval;
@@ -1006,6 +1220,8 @@ llvm::Error Instruction::translateBranch(BranchType bt)
         DBGF("reloc->isCall()={0}, func={1}",
             _ctx->reloc->isCall(_ctx->addr), !!func);
         // DBG(_ctx->reloc->lastSymVal()->dump());
+        const SBTSection::ICallTargets* ict =
+            func? nullptr : _ctx->sec->icallTargets(_addr);
 
         // target is known
         // NOTE querying the relocator is needed to disambiguate between
@@ -1014,6 +1230,12 @@ llvm::Error Instruction::translateBranch(BranchType bt)
             act = CALL;
             target = _ctx->c.u32(func->addr());
 
+        // target is known from the relocations that give its address
+        } else if (ict && ict->exact) {
+            DBGF("resolved icall: target={0:X+8}", ict->targets.front());
+            act = CALL;
+            target = _ctx->c.u32(ict->targets.front());
+
         // no immediate
         } else if (jimm->isZeroValue()) {
             v = jreg;
@@ -1132,18 +1354,32 @@ llvm::Error Instruction::handleCall(uint64_t target, unsigned linkReg)
 
     // link
     link(linkReg);
+
+    // inside a region: branch to the callee, that returns to the
+    // next BB through the region's return dispatch
+    if (!isExt && f->oneRegion()) {
+        Region* rgn = _ctx->sec->region();
+        _bld->br(rgn->entry(target));
+        if (!isTailCall) {
+            BasicBlock* bbRet = _ctx->func->newUBB(_addr, "ret");
+            rgn->addRetSite(_addr + Constants::INSTRUCTION_SIZE, bbRet);
+            _bld->setInsertBlock(bbRet);
+        }
+        return llvm::Error::success();
+    }
+
     // write regs
     if (sync)
-        _ctx->func->storeRegisters(Function::S_CALL);
+        _ctx->func->storeRegisters(Function::S_CALL, f);
     // call
     if (isExt) {
         Caller caller(_ctx, _bld, f, _ctx->func);
         caller.callExternal();
     } else
-        _bld->call(f->func());
+        _ctx->func->call(f);
     // read regs
     if (sync)
-        _ctx->func->loadRegisters(Function::S_CALL_RETURNED);
+        _ctx->func->loadRegisters(Function::S_CALL_RETURNED, f);
     if (isTailCall)
         _ctx->func->freturn();
 
@@ -1251,6 +1487,42 @@ llvm::Error Instruction::handleICall(llvm::Value* target, unsigned linkReg)
 
     // link
     link(linkReg);
+
+    if (_ctx->profile)
+        _ctx->profile->countICall(_addr, target);
+
+    // possible targets: call them directly, as in handleCall(),
+    // falling back to the generic code below
+    const SBTSection::ICallTargets* ict = _ctx->sec->icallTargets(_addr);
+    BasicBlock* bbICallDone = nullptr;
+    if (ict) {
+        Function* f = _ctx->func;
+        bbICallDone = f->newUBB(_addr, "icall_done");
+
+        for (uint64_t addr : ict->targets) {
+            Function* pf = Function::getByAddr(_ctx, addr);
+            // same as SBTRelocation::handleRelocation()
+            llvm::Value* pv;
+            if (_ctx->opts->useICallerForIIntFuncs())
+                pv = _c->i32(addr);
+            else
+                pv = llvm::ConstantExpr::getPointerCast(
+                    pf->icallFunc(), _t->i32);
+
+            BasicBlock* bbHit = f->newUBB(_addr, "icall_hit");
+            BasicBlock* bbMiss = f->newUBB(_addr, "icall_miss");
+            _bld->condBr(_bld->eq(target, pv), bbHit, bbMiss);
+
+            _bld->setInsertBlock(bbHit);
+            f->storeRegisters(Function::S_CALL, pf);
+            f->call(pf);
+            f->loadRegisters(Function::S_CALL_RETURNED, pf);
+            _bld->br(bbICallDone);
+
+            _bld->setInsertBlock(bbMiss);
+        }
+    }
+
     llvm::Value* ext = leaveFunction(target);
 
     if (_ctx->opts->useICallerForIIntFuncs())
@@ -1293,6 +1565,11 @@ llvm::Error Instruction::handleICall(llvm::Value* target, unsigned linkReg)
     }
 
     enterFunction(ext);
+
+    if (bbICallDone) {
+        _bld->br(bbICallDone);
+        _bld->setInsertBlock(bbICallDone);
+    }
     return llvm::Error::success();
 }
 
@@ -1392,7 +1669,12 @@ llvm::Error Instruction::handleJump(
         BasicBlock* next = func->findBB(nextInstrAddr);
         if (targetBB->addr() == next->addr())
             DBGF("WARNING: conditional branch to next instruction");
-        _bld->condBr(cond, targetBB, next);
+        Profile* prof = _ctx->profile;
+        if (prof)
+            prof->countBranch(_addr, cond);
+        llvm::Value* br = _bld->condBr(cond, targetBB, next);
+        if (prof)
+            prof->setBranchWeights(_addr, llvm::cast<llvm::Instruction>(br));
     } else
         _bld->br(targetBB);
 
@@ -1404,7 +1686,30 @@ llvm::Error Instruction::handleIJump(llvm::Value* target)
 {
     DBGF("NOTE: indirect branch");
 
-    _ctx->func->addIndBr(_bld->indBr(target));
+    Function* f = _ctx->func;
+    const SBTSection::JumpTable* jt = _ctx->sec->jumpTable(_addr);
+    llvm::Value* entry = jt? f->jumpTableAddr(jt->load) : nullptr;
+
+    // jump table: switch on the index of the table entry that was read,
+    // falling back to an indirect branch to any BB
+    if (entry) {
+        DBGF("jump table: {0}+{1:X+8}", jt->sec, jt->offs);
+
+        llvm::Constant* table =
+            _ctx->shadowImage->getAddr(jt->sec, jt->offs);
+        llvm::Value* idx = _bld->srl(_bld->sub(entry, table), _ctx->c.i32(2));
+
+        BasicBlock* bbIJump = f->newUBB(_addr, "ijump");
+        llvm::SwitchInst* sw = _bld->sw(idx, *bbIJump, jt->targets.size());
+        for (size_t i = 0; i < jt->targets.size(); i++) {
+            BasicBlock* bb = f->findBB(jt->targets[i]);
+            if (bb)
+                sw->addCase(_ctx->c.i32(i), bb->bb());
+        }
+        _bld->setInsertBlock(bbIJump);
+    }
+
+    f->addIndBr(_bld->indBr(target));
     return llvm::Error::success();
 }
 
@@ -1414,7 +1719,7 @@ llvm::Error Instruction::translateF()
     namespace RISCV = llvm::RISCV;
 
     llvm::Error err = noError();
-    switch (_inst.getOpcode()) {
+    switch (_inst.opcode) {
         // load
         case RISCV::FLW:
             err = translateFPLoad(F_SINGLE);
@@ -1584,7 +1889,7 @@ llvm::Error Instruction::translateF()
             break;
 
         default:
-            return ERRORF("unknown instruction opcode: {0}", _inst.getOpcode());
+            return ERRORF("unknown instruction opcode: {0}", _inst.opcode);
     }
 
     return err;
@@ -1618,8 +1923,10 @@ unsigned Instruction::getFRD(bool out)
 
 unsigned Instruction::getFRegNum(unsigned op, bool out)
 {
-    const llvm::MCOperand& r = _inst.getOperand(op);
-    unsigned nr = FRegister::num(r.getReg());
+    const Decoder::Operand& r = _ops[op];
+    xassert(r.kind == Decoder::Operand::SREG ||
+        r.kind == Decoder::Operand::DREG);
+    unsigned nr = r.val;
     if (out)
         *_os << _ctx->f->getReg(nr).name() << ", ";
     return nr;
@@ -1628,8 +1935,10 @@ unsigned Instruction::getFRegNum(unsigned op, bool out)
 
 llvm::Value* Instruction::getFReg(int op, FType ty, bool out)
 {
-    const llvm::MCOperand& mcop = _inst.getOperand(op);
-    unsigned nr = FRegister::num(mcop.getReg());
+    const Decoder::Operand& r = _ops[op];
+    xassert(r.kind == Decoder::Operand::SREG ||
+        r.kind == Decoder::Operand::DREG);
+    unsigned nr = r.val;
     llvm::Value* v = fload(nr, ty);
 
     if (out) {
@@ -1762,33 +2071,40 @@ llvm::Error Instruction::translateFPLoad(FType ft)
     *_os << '\t';
 
     unsigned fr = getFRD();
-    unsigned rs1n = getRegNum(1, false);
     llvm::Value* rs1 = getReg(1);
     auto expImm = getImm(2);
     if (!expImm)
         return expImm.takeError();
     llvm::Constant* imm = expImm.get();
 
-    llvm::Value* addr = nullptr;
-    llvm::Value* ptr = nullptr;
-    llvm::Value* v = nullptr;
-
-    if (optStack(_ctx) && rs1n == XRegister::SP)
-        addr = _bld->getSpilledAddress(imm, Register::T_FLOAT);
-    if (!addr)
-        addr = _bld->add(rs1, imm);
-
-    switch (ft) {
-        case F_SINGLE:
-            ptr = _bld->i32ToFP32Ptr(addr);
-            v = _bld->load(ptr);
-            break;
-
-        case F_DOUBLE:
-            ptr = _bld->i32ToFP64Ptr(addr);
-            v = _bld->load(ptr);
-            break;
+    // stack slot kept in host memory, or guest memory address
+    llvm::Value* ptr = _ctx->func->stackSlot(_addr);
+    bool guest = !ptr;
+
+    if (guest) {
+        llvm::Type* pty = ft == F_SINGLE? _t->fp32ptr : _t->fp64ptr;
+        // %hi()/%lo() pair: address guest data directly
+        if (llvm::Constant* lo = hiLoPtr(rs1))
+            ptr = _bld->bitOrPointerCast(lo, pty);
+        // known base object: inbounds GEP off it
+        else if (llvm::Value* bp = basePtr(rs1, imm))
+            ptr = _bld->bitOrPointerCast(bp, pty);
+        else {
+            llvm::Value* addr = _bld->add(rs1, imm);
+            switch (ft) {
+                case F_SINGLE:
+                    ptr = _bld->i32ToFP32Ptr(addr);
+                    break;
+
+                case F_DOUBLE:
+                    ptr = _bld->i32ToFP64Ptr(addr);
+                    break;
+            }
+        }
     }
+    llvm::LoadInst* v = _bld->load(ptr);
+    if (guest)
+        tagMem(v, 1);
 
     fstore(v, fr, ft);
     return llvm::Error::success();
@@ -1808,32 +2124,41 @@ llvm::Error Instruction::translateFPStore(FType ft)
     *_os << '\t';
 
     llvm::Value* fr = getFReg(0, ft);
-    unsigned rs1n = getRegNum(1, false);
     llvm::Value* rs1 = getReg(1);
     auto expImm = getImm(2);
     if (!expImm)
         return expImm.takeError();
     llvm::Constant* imm = expImm.get();
 
-    llvm::Value* addr = nullptr;
-    llvm::Value* ptr = nullptr;
-
-    if (optStack(_ctx) && rs1n == XRegister::SP)
-        addr = _bld->getSpilledAddress(imm, Register::T_FLOAT);
-    if (!addr)
-        addr = _bld->add(rs1, imm);
-
-    switch (ft) {
-        case F_SINGLE:
-            ptr = _bld->i32ToFP32Ptr(addr);
-            break;
-
-        case F_DOUBLE:
-            ptr = _bld->i32ToFP64Ptr(addr);
-            break;
+    // stack slot kept in host memory, or guest memory address
+    llvm::Value* ptr = _ctx->func->stackSlot(_addr);
+    bool guest = !ptr;
+
+    if (guest) {
+        llvm::Type* pty = ft == F_SINGLE? _t->fp32ptr : _t->fp64ptr;
+        // %hi()/%lo() pair: address guest data directly
+        if (llvm::Constant* lo = hiLoPtr(rs1))
+            ptr = _bld->bitOrPointerCast(lo, pty);
+        // known base object: inbounds GEP off it
+        else if (llvm::Value* bp = basePtr(rs1, imm))
+            ptr = _bld->bitOrPointerCast(bp, pty);
+        else {
+            llvm::Value* addr = _bld->add(rs1, imm);
+            switch (ft) {
+                case F_SINGLE:
+                    ptr = _bld->i32ToFP32Ptr(addr);
+                    break;
+
+                case F_DOUBLE:
+                    ptr = _bld->i32ToFP64Ptr(addr);
+                    break;
+            }
+        }
     }
 
-    _bld->store(fr, ptr);
+    llvm::StoreInst* st = _bld->store(fr, ptr);
+    if (guest)
+        tagMem(st, 1);
     return llvm::Error::success();
 }
 
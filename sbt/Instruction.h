@@ -1,15 +1,17 @@
 #ifndef SBT_INSTRUCTION_H
 #define SBT_INSTRUCTION_H
 
+#include "Debug.h"
+#include "Decoder.h"
+
 #include <llvm/IR/Value.h>
-#include <llvm/MC/MCInst.h>
 #include <llvm/Support/Error.h>
 
 #include <cstdint>
 
 namespace llvm {
+class Instruction;
 class LoadInst;
-class MCInst;
 class StoreInst;
 }
 
@@ -50,11 +52,27 @@ private:
     Constants* _c;
     uint64_t _addr;
     uint32_t _rawInst;
-    llvm::MCInst _inst;
+    // decoded instruction and its operands
+    Decoder::Inst _inst;
+    Decoder::Operand _ops[Decoder::MAX_OPERANDS];
     // debug output
+#if SBT_DEBUG
     std::string _s;
     std::unique_ptr<llvm::raw_string_ostream> _ss;
     llvm::raw_ostream* _os;
+#else
+    // discard debug output at compile time on release builds
+    struct NullStream
+    {
+        template <typename T>
+        NullStream& operator<<(const T&)
+        {
+            return *this;
+        }
+    };
+    NullStream _ns;
+    NullStream* _os;
+#endif
     //
     Builder* _bld;
 
@@ -233,6 +251,28 @@ private:
     Function* findFunction(llvm::Constant* c) const;
     llvm::Type* getLLVMTy(IntType ity) const;
 
+    // set alias analysis metadata of guest memory load/store
+    // (rs1 is the base address operand index)
+    void tagMem(llvm::Instruction* i, unsigned rs1);
+    // get the guest data pointer of a %lo() relocated immediate,
+    // if rs1 holds the matching %hi()
+    llvm::Constant* hiLoPtr(llvm::Value* rs1);
+
+    // guest memory base object analysis (-gep-addr)
+
+    // get the value last stored in the register read by ld,
+    // in the same block (null if unknown)
+    llvm::Value* lastStore(llvm::LoadInst* ld);
+    // get the number of the x register whose variable is p (0 if none)
+    unsigned xregNum(const llvm::Value* p);
+    // get the shadow section or stack that address v points into
+    llvm::GlobalVariable* addrBase(llvm::Value* v, unsigned depth = 0);
+    // check if v is known to be a plain integer, that refers to no
+    // guest object (constants and arithmetic on them)
+    bool isInt(llvm::Value* v, unsigned depth = 0);
+    // get rs1 + imm as an inbounds GEP off its base (null if unknown)
+    llvm::Value* basePtr(llvm::Value* rs1, llvm::Constant* imm);
+
     static const char* estr(ALUOpAlias e);
 
 
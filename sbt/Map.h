@@ -1,17 +1,21 @@
 #ifndef SBT_MAP_H
 #define SBT_MAP_H
 
-#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <map>
 #include <type_traits>
 #include <vector>
 
 namespace sbt {
 
-// Map implementation on top of a sorted std::vector.
+// Ordered map with a minimal, map-like interface.
 //
-// LLVM recommends using a sorted vector instead of a
-// std::map for better performance, for several use cases.
-// Thus, this class exposes a map-like interface on top of a sorted vector.
+// Items are kept in a balanced search tree, to make insertion, lookup and
+// lower_bound O(log n). This matters because maps such as functions and
+// BBs by address are built one item at a time and may get very large
+// (100k+ items) on big objects.
+// Pointers to items' values remain valid until the item is erased.
 template <typename K, typename V>
 class Map
 {
@@ -54,9 +58,91 @@ public:
     Value val;
   };
 
+private:
+  typedef std::map<Key, Item> Tree;
+
+  // iterate through items, in key order
+  template <typename TI, typename I>
+  class IterT
+  {
+  public:
+    typedef std::bidirectional_iterator_tag iterator_category;
+    typedef I value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef I* pointer;
+    typedef I& reference;
+
+    IterT() = default;
+
+    IterT(TI it) :
+      _it(it)
+    {}
+
+    // allow iterator to const_iterator conversion
+    template <typename TI2, typename I2>
+    IterT(const IterT<TI2, I2>& other) :
+      _it(other.base())
+    {}
+
+    I& operator*() const
+    {
+      return _it->second;
+    }
+
+    I* operator->() const
+    {
+      return &_it->second;
+    }
+
+    IterT& operator++()
+    {
+      ++_it;
+      return *this;
+    }
+
+    IterT operator++(int)
+    {
+      IterT tmp(*this);
+      ++_it;
+      return tmp;
+    }
+
+    IterT& operator--()
+    {
+      --_it;
+      return *this;
+    }
+
+    IterT operator--(int)
+    {
+      IterT tmp(*this);
+      --_it;
+      return tmp;
+    }
+
+    bool operator==(const IterT& other) const
+    {
+      return _it == other._it;
+    }
+
+    bool operator!=(const IterT& other) const
+    {
+      return _it != other._it;
+    }
+
+    TI base() const
+    {
+      return _it;
+    }
+
+  private:
+    TI _it;
+  };
+
+public:
   typedef std::vector<Item> Vec;
-  typedef typename Vec::const_iterator CIter;
-  typedef typename Vec::iterator Iter;
+  typedef IterT<typename Tree::const_iterator, const Item> CIter;
+  typedef IterT<typename Tree::iterator, Item> Iter;
 
   Map() = default;
 
@@ -68,22 +154,24 @@ public:
   Map& operator=(Map&&) = default;
 
   // construct from vector
-  Map(Vec&& vec) :
-    _data(std::move(vec))
+  Map(Vec&& vec)
   {
-    sort();
+    for (Item& item : vec)
+      upsert(std::move(item.key), std::move(item.val));
   }
 
   // value lookup
   // returns null if not found
   Value* operator[](const Key& key)
   {
-    return lookupVal(this, key);
+    auto it = _data.find(key);
+    return it == _data.end()? nullptr : &it->second.val;
   }
 
   const Value* operator[](const Key& key) const
   {
-    return lookupVal(this, key);
+    auto it = _data.find(key);
+    return it == _data.end()? nullptr : &it->second.val;
   }
 
   // insert/update
@@ -92,74 +180,72 @@ public:
     // static asserts to help with compiler errors
     static_assert(std::is_copy_constructible<Key>::value,
       "key is not copy constructible");
-    static_assert(std::is_copy_assignable<Key>::value,
-      "key is not copy assignable");
     static_assert(std::is_move_constructible<Value>::value,
       "value is not move constructible");
     static_assert(std::is_move_assignable<Value>::value,
       "value is not move assignable");
 
-    Value* dv = lookupVal(this, key);
-    if (dv)
-      *dv = std::move(val);
+    auto it = _data.lower_bound(key);
+    if (it != _data.end() && !(key < it->first))
+      it->second.val = std::move(val);
     else
-      insert(Item(key, std::move(val)));
+      _data.emplace_hint(it, key, Item(key, std::move(val)));
   }
 
   void upsert(Key&& key, Value&& val)
   {
+    static_assert(std::is_copy_constructible<Key>::value,
+      "key is not copy constructible");
     static_assert(std::is_move_constructible<Key>::value,
       "key is not move constructible");
-    static_assert(std::is_move_assignable<Key>::value,
-      "key is not move assignable");
     static_assert(std::is_move_constructible<Value>::value,
       "value is not move constructible");
     static_assert(std::is_move_assignable<Value>::value,
       "value is not move assignable");
 
-    Value* dv = lookupVal(this, key);
-    if (dv)
-      *dv = std::move(val);
-    else
-      insert(Item(std::move(key), std::move(val)));
+    auto it = _data.lower_bound(key);
+    if (it != _data.end() && !(key < it->first))
+      it->second.val = std::move(val);
+    else {
+      // the tree and the item need their own copies of the key
+      Key tkey(key);
+      _data.emplace_hint(it, std::move(tkey),
+        Item(std::move(key), std::move(val)));
+    }
   }
 
   // iterators
 
   CIter begin() const
   {
-    return _data.begin();
+    return CIter(_data.begin());
   }
 
   CIter end() const
   {
-    return _data.end();
+    return CIter(_data.end());
   }
 
   Iter begin()
   {
-    return _data.begin();
+    return Iter(_data.begin());
   }
 
   Iter end()
   {
-    return _data.end();
+    return Iter(_data.end());
   }
 
   // lower_bound
 
   Iter lower_bound(const Key& key)
   {
-    return std::lower_bound(begin(), end(), key,
-      [](const Item& i, const Key& key) {
-        return i.key < key; });
+    return Iter(_data.lower_bound(key));
   }
 
   CIter lower_bound(const Key& key) const
   {
-    return std::lower_bound(begin(), end(), key,
-      [](const Item& i, const Key& key) {
-        return i.IKey < key; });
+    return CIter(_data.lower_bound(key));
   }
 
   //
@@ -174,56 +260,14 @@ public:
     return _data.size();
   }
 
+  // erase all items from it to the end
   void erase(Iter it)
   {
-      _data.erase(it, end());
+    _data.erase(it.base(), _data.end());
   }
 
 private:
-  Vec _data;
-
-  // methods
-
-  // insert (sorted) a new item at the end
-  void insert(Item&& item)
-  {
-      auto it = _data.emplace(_data.end(), std::move(item));
-      std::inplace_merge(_data.begin(), it, _data.end(),
-        [](const Item& i1, const Item& i2){ return i1.key < i2.key; });
-  }
-
-  // sort
-  void sort()
-  {
-    std::sort(_data.begin(), _data.end());
-  }
-
-  // implementation of const and non-const versions of operator[]
-  template <typename T>
-  static auto lookup(T thiz, const Key& key) -> decltype(&thiz->_data[0])
-  {
-    auto& data = thiz->_data;
-    if (data.empty())
-      return nullptr;
-    const Item& dummy = data.front();
-
-    auto it = std::lower_bound(data.begin(), data.end(), dummy,
-      [&key](const Item& i, const Item&){ return i.key < key; });
-    if (it == data.end())
-      return nullptr;
-    else
-      return it->key == key? &*it : nullptr;
-  }
-
-  template <typename T>
-  static auto lookupVal(T thiz, const Key& key) -> decltype(&thiz->_data[0].val)
-  {
-    auto it = lookup(thiz, key);
-    if (it)
-      return &it->val;
-    else
-      return nullptr;
-  }
+  Tree _data;
 };
 
 } // sbt
@@ -40,6 +40,7 @@ void Module::start()
 
 void Module::finish()
 {
+    _shadowImage->finish();
     _ctx->sbtmodule = nullptr;
 }
 
@@ -102,10 +102,30 @@ std::string Section::str() const
 }
 
 
-void CommonSection::symbols(ConstSymbolPtrVec&& s)
+void Section::symbols(ConstSymbolPtrVec&& s)
 {
     _symbols = std::move(s);
 
+    // build address index
+    _symAddrs.clear();
+    _symFirst.clear();
+    for (size_t i = 0; i < _symbols.size(); i++) {
+        uint64_t addr = _symbols[i]->address();
+        xassert((_symAddrs.empty() || _symAddrs.back() <= addr) &&
+            "symbols not sorted by address");
+        if (_symAddrs.empty() || _symAddrs.back() != addr) {
+            _symAddrs.push_back(addr);
+            _symFirst.push_back(i);
+        }
+    }
+    _symFirst.push_back(_symbols.size());
+}
+
+
+void CommonSection::symbols(ConstSymbolPtrVec&& s)
+{
+    Section::symbols(std::move(s));
+
     for (auto& s : _symbols)
         _size += s->commonSize();
 }
@@ -134,16 +154,15 @@ uint64_t LLVMSection::getELFOffset() const
 }
 
 
-ConstSymbolPtrVec Section::lookup(uint64_t addr) const
+ConstSymbolRange Section::lookup(uint64_t addr) const
 {
-    ConstSymbolPtrVec ret;
+    auto it = std::lower_bound(_symAddrs.begin(), _symAddrs.end(), addr);
+    if (it == _symAddrs.end() || *it != addr)
+        return ConstSymbolRange();
 
-    auto it = std::lower_bound(_symbols.begin(), _symbols.end(), addr,
-        [](ConstSymbolPtr sym, uint64_t addr) { return sym->address() < addr; });
-
-    for (; it != _symbols.end() && (*it)->address() == addr; ++it)
-        ret.push_back(*it);
-    return ret;
+    size_t i = it - _symAddrs.begin();
+    size_t first = _symFirst[i];
+    return ConstSymbolRange(&_symbols[first], _symFirst[i + 1] - first);
 }
 
 
@@ -398,16 +417,17 @@ llvm::Error Object::readSymbols()
 
     // read sections
     for (const llvm::object::SectionRef s : _obj->sections()) {
-        SectionPtr sec(new LLVMSection(this, s));
-        ConstSectionPtr ptr(sec);
+        _sectionArena.emplace_back(new LLVMSection(this, s));
+        SectionPtr sec = _sectionArena.back().get();
         // add to maps
-        _ptrToSection.upsert(s.getRawDataRefImpl().p, ConstSectionPtr(ptr));
+        _ptrToSection.upsert(s.getRawDataRefImpl().p, ConstSectionPtr(sec));
         // add to sections vector
         sections.push_back(sec);
     }
 
     // add common section
-    SectionPtr commonSec(new CommonSection(this));
+    _sectionArena.emplace_back(new CommonSection(this));
+    SectionPtr commonSec = _sectionArena.back().get();
     _ptrToSection.upsert(~0ULL, ConstSectionPtr(commonSec));
     sections.push_back(commonSec);
     uint64_t commonOffs = 0;
@@ -415,11 +435,14 @@ llvm::Error Object::readSymbols()
     // read symbols
     std::map<std::string, ConstSymbolPtrVec> sectionToSymbols;
     for (const llvm::object::SymbolRef s : _obj->symbols()) {
-        Symbol* sym = new Symbol(this, s);
-        ConstSymbolPtr ptr(sym);
+        _symbolArena.emplace_back(this, s);
+        Symbol* sym = &_symbolArena.back();
+        ConstSymbolPtr ptr = sym;
         // skip debug symbols
-        if (sym->type() == llvm::object::SymbolRef::ST_Debug)
+        if (sym->type() == llvm::object::SymbolRef::ST_Debug) {
+            _symbolArena.pop_back();
             continue;
+        }
         // add to maps
         _ptrToSymbol.upsert(s.getRawDataRefImpl().p, ConstSymbolPtr(ptr));
 
@@ -503,8 +526,8 @@ llvm::Error Object::readSymbols()
         auto re = s.relocations().end();
         ConstRelocationPtrVec relocs;
         for (; rb != re; ++rb) {
-            ConstRelocationPtr ptr(new LLVMRelocation(this, *rb));
-            relocs.push_back(ptr);
+            _relocArena.emplace_back(this, *rb);
+            relocs.push_back(&_relocArena.back());
         }
         DBGF("{0} relocation(s) found", relocs.size());
         targetSection->setRelocs(std::move(relocs));
@@ -5,15 +5,21 @@
  * This module represents an object file, on top of LLVM object classes,
  * but with extra functionality, specially to lookup symbols and 'navigate'
  * through objects, sections, symbols and relocations.
+ *
+ * Sections, symbols and relocations are owned by their Object, that
+ * allocates them in arenas, and are referred to by plain pointers, that
+ * remain valid for the lifetime of the Object.
  */
 
 #include "Map.h"
 #include "Utils.h"
 
+#include <llvm/ADT/ArrayRef.h>
 #include <llvm/Object/ELFObjectFile.h>
 #include <llvm/Object/ObjectFile.h>
 #include <llvm/Support/Error.h>
 
+#include <deque>
 #include <memory>
 #include <string>
 #include <vector>
@@ -29,15 +35,15 @@ class Section;
 class Symbol;
 
 // pointers
+// (non-owning: all objects below are owned by their Object)
 using ObjectPtr = Object*;
 using ConstObjectPtr = const Object*;
-using RelocationPtr = std::shared_ptr<Relocation>;
-using ConstRelocationPtr = std::shared_ptr<const Relocation>;
-using SymbolPtr = std::shared_ptr<Symbol>;
-using ConstSymbolPtr = std::shared_ptr<const Symbol>;
-using SectionPtr = std::shared_ptr<Section>;
-using ConstSectionPtr = std::shared_ptr<const Section>;
-using ConstSectionWeakPtr = std::weak_ptr<const Section>;
+using RelocationPtr = Relocation*;
+using ConstRelocationPtr = const Relocation*;
+using SymbolPtr = Symbol*;
+using ConstSymbolPtr = const Symbol*;
+using SectionPtr = Section*;
+using ConstSectionPtr = const Section*;
 
 // vectors
 using SectionPtrVec = std::vector<SectionPtr>;
@@ -45,6 +51,9 @@ using ConstSectionPtrVec = std::vector<ConstSectionPtr>;
 using ConstSymbolPtrVec = std::vector<ConstSymbolPtr>;
 using ConstRelocationPtrVec = std::vector<ConstRelocationPtr>;
 
+// views
+using ConstSymbolRange = llvm::ArrayRef<ConstSymbolPtr>;
+
 // maps
 using PtrToSymbolMap = Map<uintptr_t, ConstSymbolPtr>;
 using PtrToSectionMap = Map<uintptr_t, ConstSectionPtr>;
@@ -108,6 +117,11 @@ public:
         return false;
     }
 
+    virtual bool isReadOnly() const
+    {
+        return false;
+    }
+
     // contents
     virtual llvm::Error contents(llvm::StringRef& s) const
     {
@@ -122,15 +136,13 @@ public:
     }
 
     // set symbols (can't be done at construction time)
-    virtual void symbols(ConstSymbolPtrVec&& s)
-    {
-        _symbols = std::move(s);
-    }
+    // (symbols must be sorted by address)
+    virtual void symbols(ConstSymbolPtrVec&& s);
 
     // lookup symbol by address
     ConstSymbolPtr lookupFirst(uint64_t addr) const
     {
-        ConstSymbolPtrVec r = lookup(addr);
+        ConstSymbolRange r = lookup(addr);
         xassert(r.size() < 2);
         if (r.empty())
             return nullptr;
@@ -138,7 +150,10 @@ public:
             return r.front();
     }
 
-    ConstSymbolPtrVec lookup(uint64_t addr) const;
+    // get all symbols at the given address
+    // (the returned range is valid while the section's symbols are
+    //  not changed)
+    ConstSymbolRange lookup(uint64_t addr) const;
 
     // ELF offset
     virtual uint64_t getELFOffset() const
@@ -171,6 +186,13 @@ protected:
     std::string _name;
     ConstSymbolPtrVec _symbols;
     ConstRelocationPtrVec _relocs;
+
+private:
+    // address index: distinct symbol addresses, in ascending order, and
+    // the index of the first symbol at each one of them in _symbols
+    // (plus an extra entry with _symbols.size())
+    std::vector<uint64_t> _symAddrs;
+    std::vector<uint32_t> _symFirst;
 };
 
 
@@ -250,6 +272,12 @@ public:
         return _sec.isBSS();
     }
 
+    bool isReadOnly() const override
+    {
+        return !(llvm::object::ELFSectionRef(_sec).getFlags() &
+            llvm::ELF::SHF_WRITE);
+    }
+
     // contents
     llvm::Error contents(llvm::StringRef& s) const override
     {
@@ -291,10 +319,10 @@ public:
     // section
     ConstSectionPtr section() const
     {
-        return _sec.lock();
+        return _sec;
     }
 
-    void section(ConstSectionWeakPtr s)
+    void section(ConstSectionPtr s)
     {
         _sec = s;
     }
@@ -316,6 +344,12 @@ public:
         return _sym.getValue();
     }
 
+    // size (0 if unknown)
+    uint64_t size() const
+    {
+        return llvm::object::ELFSymbolRef(_sym).getSize();
+    }
+
     // flags
     uint32_t flags() const
     {
@@ -341,7 +375,7 @@ private:
     llvm::object::SymbolRef _sym;
     llvm::StringRef _name;
     Type _type;
-    ConstSectionWeakPtr _sec;
+    ConstSectionPtr _sec = nullptr;
     uint64_t _address = 0;
 };
 
@@ -640,7 +674,7 @@ public:
     {
         const ConstSectionPtr* p = _ptrToSection[s.getRawDataRefImpl().p];
         if (!p)
-            return ConstSectionPtr(nullptr);
+            return nullptr;
         else
             return *p;
     }
@@ -650,7 +684,7 @@ public:
     {
         const ConstSymbolPtr *p = _ptrToSymbol[s.getRawDataRefImpl().p];
         if (!p)
-            return ConstSymbolPtr(nullptr);
+            return nullptr;
         else
             return *p;
     }
@@ -696,6 +730,12 @@ private:
     llvm::object::ObjectFile* _obj = nullptr;
     llvm::StringRef _fileName;
 
+    // arenas
+    // (deques never move their elements when growing)
+    std::vector<std::unique_ptr<Section>> _sectionArena;
+    std::deque<Symbol> _symbolArena;
+    std::deque<LLVMRelocation> _relocArena;
+
     // maps
     PtrToSymbolMap _ptrToSymbol;
     PtrToSectionMap _ptrToSection;
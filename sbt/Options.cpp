@@ -17,6 +17,10 @@ static std::string regs2str(Options::Regs regs)
             return "locals";
         case Options::Regs::ABI:
             return "abi";
+        case Options::Regs::LIVE:
+            return "live";
+        case Options::Regs::ONEREGION:
+            return "oneregion";
     }
     xunreachable("invalid regs");
 }
@@ -38,6 +42,26 @@ void Options::dump() const
     DBGS << "optStack=" << optStack() << nl;
     DBGS << "icallIntOnly=" << icallIntOnly() << nl;
     DBGS << "logFile=" << logFile() << nl;
+    DBGS << "decodeJobs=" << decodeJobs() << nl;
+    DBGS << "cacheDir=" << cacheDir() << nl;
+    DBGS << "stats=" << stats() << nl;
+    DBGS << "checkDecoder=" << checkDecoder() << nl;
+    DBGS << "decoderBench=" << decoderBench() << nl;
+    DBGS << "emitObj=" << emitObj() << nl;
+    DBGS << "xopt=" << xopt() << nl;
+    DBGS << "hostTriple=" << hostTriple() << nl;
+    DBGS << "hostCPU=" << hostCPU() << nl;
+    DBGS << "hostAttrs=" << hostAttrs() << nl;
+    DBGS << "hostPIC=" << hostPIC() << nl;
+    DBGS << "funcSigs=" << funcSigs() << nl;
+    DBGS << "icallPredict=" << icallPredict() << nl;
+    DBGS << "aaMeta=" << aaMeta() << nl;
+    DBGS << "profileGen=" << profileGen() << nl;
+    DBGS << "profileUse=" << profileUse() << nl;
+    DBGS << "splitData=" << splitData() << nl;
+    DBGS << "gepAddr=" << gepAddr() << nl;
+    DBGS << "regFile=" << regFile() << nl;
+    DBGS << "regFileTLS=" << regFileTLS() << nl;
 }
 
 }
@@ -13,7 +13,10 @@ public:
     enum class Regs {
         GLOBALS,
         LOCALS,
-        ABI
+        ABI,
+        LIVE,
+        // all guest functions in a single LLVM function
+        ONEREGION
     };
 
     Options(
@@ -168,6 +171,247 @@ public:
         return *this;
     }
 
+    // number of instruction decoding threads (0 = number of host cores)
+    unsigned decodeJobs() const
+    {
+        return _decodeJobs;
+    }
+
+    Options& setDecodeJobs(unsigned n)
+    {
+        _decodeJobs = n;
+        return *this;
+    }
+
+    // translation cache directory (empty = no cache)
+    const std::string& cacheDir() const
+    {
+        return _cacheDir;
+    }
+
+    Options& setCacheDir(const std::string& dir)
+    {
+        _cacheDir = dir;
+        return *this;
+    }
+
+    // print translation statistics
+    bool stats() const
+    {
+        return _stats;
+    }
+
+    Options& setStats(bool v)
+    {
+        _stats = v;
+        return *this;
+    }
+
+    // check native decoder results against LLVM's MC disassembler
+    bool checkDecoder() const
+    {
+        return _checkDecoder;
+    }
+
+    Options& setCheckDecoder(bool v)
+    {
+        _checkDecoder = v;
+        return *this;
+    }
+
+    // benchmark native and MC decoders on each code section
+    bool decoderBench() const
+    {
+        return _decoderBench;
+    }
+
+    Options& setDecoderBench(bool v)
+    {
+        _decoderBench = v;
+        return *this;
+    }
+
+    // compile translated code to a host object file
+    bool emitObj() const
+    {
+        return _emitObj;
+    }
+
+    Options& setEmitObj(bool v)
+    {
+        _emitObj = v;
+        return *this;
+    }
+
+    // optimize translated code (with emitObj)
+    bool xopt() const
+    {
+        return _xopt;
+    }
+
+    Options& setXOpt(bool v)
+    {
+        _xopt = v;
+        return *this;
+    }
+
+    // host target triple (empty = default target triple)
+    const std::string& hostTriple() const
+    {
+        return _hostTriple;
+    }
+
+    Options& setHostTriple(const std::string& triple)
+    {
+        _hostTriple = triple;
+        return *this;
+    }
+
+    // host CPU
+    const std::string& hostCPU() const
+    {
+        return _hostCPU;
+    }
+
+    Options& setHostCPU(const std::string& cpu)
+    {
+        _hostCPU = cpu;
+        return *this;
+    }
+
+    // host target features
+    const std::string& hostAttrs() const
+    {
+        return _hostAttrs;
+    }
+
+    Options& setHostAttrs(const std::string& attrs)
+    {
+        _hostAttrs = attrs;
+        return *this;
+    }
+
+    // generate position independent host code
+    bool hostPIC() const
+    {
+        return _hostPIC;
+    }
+
+    Options& setHostPIC(bool v)
+    {
+        _hostPIC = v;
+        return *this;
+    }
+
+    // recover guest function signatures, to pass arguments and
+    // return values by value
+    bool funcSigs() const
+    {
+        return _funcSigs;
+    }
+
+    Options& setFuncSigs(bool v)
+    {
+        _funcSigs = v;
+        return *this;
+    }
+
+    // guess the targets of indirect calls that can't be resolved
+    bool icallPredict() const
+    {
+        return _icallPredict;
+    }
+
+    Options& setICallPredict(bool v)
+    {
+        _icallPredict = v;
+        return *this;
+    }
+
+    // attach alias analysis metadata to register and guest memory accesses
+    bool aaMeta() const
+    {
+        return _aaMeta;
+    }
+
+    Options& setAAMeta(bool v)
+    {
+        _aaMeta = v;
+        return *this;
+    }
+
+    // instrument translated code to collect a profile
+    bool profileGen() const
+    {
+        return _profileGen;
+    }
+
+    Options& setProfileGen(bool v)
+    {
+        _profileGen = v;
+        return *this;
+    }
+
+    // profile to optimize translated code with (empty if none)
+    const std::string& profileUse() const
+    {
+        return _profileUse;
+    }
+
+    Options& setProfileUse(const std::string& v)
+    {
+        _profileUse = v;
+        return *this;
+    }
+
+    // split data sections into one global per symbol
+    bool splitData() const
+    {
+        return _splitData;
+    }
+
+    Options& setSplitData(bool v)
+    {
+        _splitData = v;
+        return *this;
+    }
+
+    // express guest addresses as inbounds GEPs off their base objects
+    bool gepAddr() const
+    {
+        return _gepAddr;
+    }
+
+    Options& setGEPAddr(bool v)
+    {
+        _gepAddr = v;
+        return *this;
+    }
+
+    // keep global registers in a single, cache aligned, struct
+    bool regFile() const
+    {
+        return _regFile;
+    }
+
+    Options& setRegFile(bool v)
+    {
+        _regFile = v;
+        return *this;
+    }
+
+    // make the register file thread local
+    bool regFileTLS() const
+    {
+        return _regFileTLS;
+    }
+
+    Options& setRegFileTLS(bool v)
+    {
+        _regFileTLS = v;
+        return *this;
+    }
+
     void dump() const;
 
 private:
@@ -185,6 +429,26 @@ private:
     bool _optStack = false;
     bool _icallIntOnly = false;
     std::string _logFile;
+    unsigned _decodeJobs = 1;
+    std::string _cacheDir;
+    bool _stats = false;
+    bool _checkDecoder = false;
+    bool _decoderBench = false;
+    bool _emitObj = false;
+    bool _xopt = false;
+    std::string _hostTriple;
+    std::string _hostCPU = "generic";
+    std::string _hostAttrs;
+    bool _hostPIC = false;
+    bool _funcSigs = false;
+    bool _icallPredict = false;
+    bool _aaMeta = false;
+    bool _profileGen = false;
+    std::string _profileUse;
+    bool _splitData = false;
+    bool _gepAddr = false;
+    bool _regFile = false;
+    bool _regFileTLS = false;
 };
 
 }
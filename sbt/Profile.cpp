@@ -0,0 +1,418 @@
+#include "Profile.h"
+
+#include "Builder.h"
+#include "Context.h"
+#include "Function.h"
+#include "SBTError.h"
+#include "Section.h"
+#include "Translator.h"
+#include "Utils.h"
+
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/GlobalVariable.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/MDBuilder.h>
+#include <llvm/IR/Module.h>
+#include <llvm/ProfileData/InstrProf.h>
+#include <llvm/ProfileData/ProfileCommon.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Transforms/Utils/ModuleUtils.h>
+
+#include <algorithm>
+#include <limits>
+
+#undef ENABLE_DBGS
+#define ENABLE_DBGS 1
+#include "Debug.h"
+
+namespace sbt {
+
+// (target, count) slots of each indirect call site
+// (must match SBT_PROF_ICALL_SLOTS in Runtime.c)
+static const size_t ICALL_SLOTS = 4;
+
+
+Profile::Profile(Context* ctx, llvm::Error& err)
+    :
+    _ctx(ctx)
+{
+    const Options* opts = _ctx->opts;
+
+    if (opts->profileGen()) {
+        const Types& t = _ctx->t;
+        _counts = new llvm::GlobalVariable(*_ctx->module, t.i64, !CONSTANT,
+            llvm::GlobalValue::ExternalLinkage, nullptr, "sbt_prof_counts");
+        _icalls = new llvm::GlobalVariable(*_ctx->module, t.i32, !CONSTANT,
+            llvm::GlobalValue::ExternalLinkage, nullptr, "sbt_prof_icalls");
+        _icallFunc = llvm::Function::Create(
+            llvm::FunctionType::get(t.voidT, { t.i32ptr, t.i32 }, !VAR_ARG),
+            llvm::Function::ExternalLinkage, "sbt_prof_icall",
+            _ctx->module);
+    }
+
+    if (!opts->profileUse().empty()) {
+        err = load(opts->profileUse());
+        return;
+    }
+    err = llvm::Error::success();
+}
+
+
+Profile::Key Profile::key(uint64_t addr) const
+{
+    xassert(_ctx->sec);
+    return Key(_ctx->sec->section()->name(), addr);
+}
+
+
+unsigned Profile::secIndex(const std::string& sec)
+{
+    auto it = std::find(_secs.begin(), _secs.end(), sec);
+    if (it != _secs.end())
+        return it - _secs.begin();
+    _secs.push_back(sec);
+    return _secs.size() - 1;
+}
+
+
+void Profile::inc(llvm::Value* idx)
+{
+    Builder* bld = _ctx->bld;
+    llvm::Value* ptr = bld->gep(_counts, { idx });
+    llvm::Value* v = bld->load(ptr);
+    v = bld->add(v, _ctx->c.i64(1));
+    bld->store(v, ptr);
+}
+
+
+void Profile::startFunc(uint64_t addr, llvm::Function* f)
+{
+    if (gen()) {
+        inc(_ctx->c.i32(_counters.size()));
+        _counters.push_back({ K_FUNC, secIndex(key(addr).first), addr });
+        return;
+    }
+
+    const uint64_t* count = _funcCounts[key(addr)];
+    if (!count || !f)
+        return;
+    DBGF("addr={0:X+8}, count={1}", addr, *count);
+    f->setEntryCount(*count);
+    if (*count == 0)
+        f->addFnAttr(llvm::Attribute::Cold);
+}
+
+
+void Profile::countBranch(uint64_t addr, llvm::Value* cond)
+{
+    if (!gen())
+        return;
+
+    // taken and not taken counters
+    const Constants& c = _ctx->c;
+    size_t n = _counters.size();
+    inc(_ctx->bld->select(cond, c.i32(n), c.i32(n + 1)));
+
+    unsigned sec = secIndex(key(addr).first);
+    _counters.push_back({ K_TAKEN, sec, addr });
+    _counters.push_back({ K_NOT_TAKEN, sec, addr });
+}
+
+
+void Profile::setBranchWeights(uint64_t addr, llvm::Instruction* br) const
+{
+    const std::pair<uint64_t, uint64_t>* counts = _branchCounts[key(addr)];
+    if (!counts)
+        return;
+
+    // weights are 32-bit wide
+    uint64_t scale = MAX(counts->first, counts->second) /
+        std::numeric_limits<uint32_t>::max() + 1;
+    llvm::MDBuilder mdb(*_ctx->ctx);
+    br->setMetadata(llvm::LLVMContext::MD_prof, mdb.createBranchWeights(
+        counts->first / scale, counts->second / scale));
+}
+
+
+void Profile::countICall(uint64_t addr, llvm::Value* target)
+{
+    if (!gen())
+        return;
+
+    Builder* bld = _ctx->bld;
+    size_t slots = _icallSites.size() * ICALL_SLOTS * 2;
+    llvm::Value* ptr = bld->gep(_icalls, { _ctx->c.i32(slots) });
+    bld->call(_icallFunc, { ptr, target });
+    _icallSites.push_back({ secIndex(key(addr).first), addr });
+}
+
+
+const Profile::Targets* Profile::icallTargets(uint64_t addr) const
+{
+    return _icallTargets[key(addr)];
+}
+
+
+void Profile::finish(const Map<uint64_t, Function*>& funcs)
+{
+    if (gen())
+        genData(funcs);
+    else
+        setSummary();
+}
+
+
+void Profile::genData(const Map<uint64_t, Function*>& funcs)
+{
+    const Types& t = _ctx->t;
+    const Constants& c = _ctx->c;
+    llvm::Module* module = _ctx->module;
+
+    // replace placeholder by a zero initialized array of n elements
+    auto defArray = [&](llvm::GlobalVariable*& ph, size_t n) {
+        llvm::ArrayType* aty = llvm::ArrayType::get(ph->getValueType(),
+            MAX(n, size_t(1)));
+        auto* gv = new llvm::GlobalVariable(*module, aty, !CONSTANT,
+            llvm::GlobalValue::InternalLinkage,
+            llvm::ConstantAggregateZero::get(aty));
+        ph->replaceAllUsesWith(
+            llvm::ConstantExpr::getBitCast(gv, ph->getType()));
+        gv->takeName(ph);
+        ph->eraseFromParent();
+        ph = gv;
+    };
+
+    // read-only table
+    auto table = [&](llvm::Type* ty, const std::vector<llvm::Constant*>& v,
+        const std::string& name)
+    {
+        llvm::ArrayType* aty = llvm::ArrayType::get(ty, v.size());
+        auto* gv = new llvm::GlobalVariable(*module, aty, CONSTANT,
+            llvm::GlobalValue::InternalLinkage,
+            llvm::ConstantArray::get(aty, v), name);
+        return llvm::ConstantExpr::getPointerCast(gv, ty->getPointerTo());
+    };
+
+    defArray(_counts, _counters.size());
+    defArray(_icalls, _icallSites.size() * ICALL_SLOTS * 2);
+
+    // counter keys: kind, section, address
+    std::vector<llvm::Constant*> keys;
+    for (const Counter& cnt : _counters) {
+        keys.push_back(c.u32(cnt.kind));
+        keys.push_back(c.u32(cnt.sec));
+        keys.push_back(c.u32(cnt.addr));
+    }
+
+    // indirect call keys: section, address
+    std::vector<llvm::Constant*> icallKeys;
+    for (const auto& site : _icallSites) {
+        icallKeys.push_back(c.u32(site.first));
+        icallKeys.push_back(c.u32(site.second));
+    }
+
+    // functions that may be called indirectly: call target
+    // (as in Instruction::handleICall()), section, guest address
+    // (with the icaller, targets are guest addresses already)
+    bool icaller = _ctx->opts->useICallerForIIntFuncs();
+    std::vector<llvm::Constant*> ftab;
+    for (const auto& p : funcs) {
+        Function* f = p.val;
+        if (Translator::isExternalFunc(f->addr()) || !f->sec() ||
+            !f->func() || f->oneRegion())
+            continue;
+        if (icaller)
+            ftab.push_back(c.u32(f->addr()));
+        else {
+            // declared wrapper (-func-sigs), or the function itself
+            llvm::Function* hf = module->getFunction(f->name() + ".w");
+            if (!hf)
+                hf = f->func();
+            if (!hf->hasAddressTaken())
+                continue;
+            ftab.push_back(llvm::ConstantExpr::getPointerCast(hf, t.i32));
+        }
+        ftab.push_back(c.u32(secIndex(f->sec()->section()->name())));
+        ftab.push_back(c.u32(f->addr()));
+    }
+
+    // section names
+    std::vector<llvm::Constant*> secs;
+    for (const std::string& sec : _secs) {
+        llvm::Constant* str =
+            llvm::ConstantDataArray::getString(*_ctx->ctx, sec);
+        auto* gv = new llvm::GlobalVariable(*module, str->getType(), CONSTANT,
+            llvm::GlobalValue::PrivateLinkage, str, "sbt_prof_sec");
+        secs.push_back(llvm::ConstantExpr::getPointerCast(gv, t.i8ptr));
+    }
+
+    DBGF("counters={0}, icalls={1}, funcs={2}",
+        _counters.size(), _icallSites.size(), ftab.size() / 3);
+
+    // void sbt_prof_init(secs, n, keys, counts, nicalls, icallKeys, icalls,
+    //                    nfuncs, funcs);
+    llvm::FunctionType* ft = llvm::FunctionType::get(t.voidT, {
+            t.i8ptr->getPointerTo(),
+            t.i32, t.i32ptr, llvm::Type::getInt64PtrTy(*_ctx->ctx),
+            t.i32, t.i32ptr, t.i32ptr,
+            t.i32, t.i32ptr
+        }, !VAR_ARG);
+    llvm::Function* init = llvm::Function::Create(ft,
+        llvm::Function::ExternalLinkage, "sbt_prof_init", module);
+
+    // call it from a module constructor
+    llvm::Function* ctor = llvm::Function::Create(t.voidFunc,
+        llvm::Function::InternalLinkage, "sbt_prof_ctor", module);
+    Builder bldi(_ctx, NO_FIRST);
+    Builder* bld = &bldi;
+    BasicBlock bb(_ctx, "entry", ctor);
+    bld->setInsertBlock(&bb);
+    bld->call(init, {
+        table(t.i8ptr, secs, "sbt_prof_secs"),
+        c.u32(_counters.size()),
+        table(t.i32, keys, "sbt_prof_keys"),
+        llvm::ConstantExpr::getBitCast(_counts,
+            llvm::Type::getInt64PtrTy(*_ctx->ctx)),
+        c.u32(_icallSites.size()),
+        table(t.i32, icallKeys, "sbt_prof_icall_keys"),
+        llvm::ConstantExpr::getBitCast(_icalls, t.i32ptr),
+        c.u32(ftab.size() / 3),
+        table(t.i32, ftab, "sbt_prof_funcs")
+    });
+    bld->retVoid();
+    llvm::appendToGlobalCtors(*module, ctor, 0);
+}
+
+
+void Profile::setSummary()
+{
+    // one record per function: entry count followed by branch counts
+    llvm::InstrProfSummaryBuilder psb(
+        llvm::ProfileSummaryBuilder::DefaultCutoffs);
+    bool empty = true;
+
+    for (llvm::Function& f : *_ctx->module) {
+        auto count = f.getEntryCount();
+        if (!count.hasValue())
+            continue;
+
+        llvm::InstrProfRecord rec;
+        rec.Counts.push_back(count.getCount());
+        for (llvm::BasicBlock& bb : f) {
+            llvm::TerminatorInst* term = bb.getTerminator();
+            uint64_t taken, notTaken;
+            if (term && term->extractProfMetadata(taken, notTaken)) {
+                rec.Counts.push_back(taken);
+                rec.Counts.push_back(notTaken);
+            }
+        }
+        psb.addRecord(rec);
+        empty = false;
+    }
+
+    if (!empty)
+        _ctx->module->setProfileSummary(psb.getSummary()->getMD(*_ctx->ctx));
+}
+
+
+llvm::Error Profile::load(const std::string& path)
+{
+    auto res = llvm::MemoryBuffer::getFile(path);
+    if (!res)
+        return ERRORF("failed to read profile \"{0}\": {1}",
+            path, res.getError().message());
+    _contents = (*res)->getBuffer();
+
+    llvm::SmallVector<llvm::StringRef, 0> lines;
+    llvm::StringRef(_contents).split(lines, '\n');
+
+    size_t ln = 0;
+    for (llvm::StringRef line : lines) {
+        ln++;
+        line = line.trim();
+        if (line.empty() || line.startswith("#"))
+            continue;
+
+        // <kind> <section> <address> ...
+        llvm::SmallVector<llvm::StringRef, 6> f;
+        line.split(f, ' ', -1, false);
+        uint64_t addr, count;
+        if (f.size() < 4 || f[0].size() != 1 || f[2].getAsInteger(16, addr))
+            return ERRORF("{0}:{1}: invalid profile entry", path, ln);
+        Key k(f[1].str(), addr);
+
+        switch (f[0][0]) {
+            // f <section> <address> <count>
+            case K_FUNC:
+                if (f.size() != 4 || f[3].getAsInteger(10, count))
+                    return ERRORF("{0}:{1}: invalid function entry", path, ln);
+                if (uint64_t* p = _funcCounts[k])
+                    *p += count;
+                else
+                    _funcCounts.upsert(k, std::move(count));
+                break;
+
+            // t|n <section> <address> <count>
+            case K_TAKEN:
+            case K_NOT_TAKEN: {
+                if (f.size() != 4 || f[3].getAsInteger(10, count))
+                    return ERRORF("{0}:{1}: invalid branch entry", path, ln);
+                std::pair<uint64_t, uint64_t>* p = _branchCounts[k];
+                if (!p) {
+                    _branchCounts.upsert(k, std::pair<uint64_t, uint64_t>(0, 0));
+                    p = _branchCounts[k];
+                }
+                if (f[0][0] == K_TAKEN)
+                    p->first += count;
+                else
+                    p->second += count;
+                break;
+            }
+
+            // i <section> <address> <target section> <target> <count>
+            case 'i': {
+                uint64_t target;
+                if (f.size() != 6 || f[4].getAsInteger(16, target) ||
+                    f[5].getAsInteger(10, count))
+                    return ERRORF("{0}:{1}: invalid icall entry", path, ln);
+                // only targets in the same section can be called directly
+                if (f[3] != f[1])
+                    break;
+                Targets* p = _icallTargets[k];
+                if (!p) {
+                    _icallTargets.upsert(k, Targets());
+                    p = _icallTargets[k];
+                }
+                auto it = std::find_if(p->begin(), p->end(),
+                    [target](const std::pair<uint64_t, uint64_t>& tc) {
+                        return tc.first == target;
+                    });
+                if (it != p->end())
+                    it->second += count;
+                else
+                    p->push_back({ target, count });
+                break;
+            }
+
+            default:
+                return ERRORF("{0}:{1}: invalid profile entry kind", path, ln);
+        }
+    }
+
+    // hottest targets first
+    for (auto& item : _icallTargets) {
+        std::stable_sort(item.val.begin(), item.val.end(),
+            [](const std::pair<uint64_t, uint64_t>& a,
+                const std::pair<uint64_t, uint64_t>& b)
+            {
+                return a.second > b.second;
+            });
+    }
+
+    DBGF("functions={0}, branches={1}, icalls={2}",
+        _funcCounts.size(), _branchCounts.size(), _icallTargets.size());
+    return llvm::Error::success();
+}
+
+}
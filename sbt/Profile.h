@@ -0,0 +1,151 @@
+#ifndef SBT_PROFILE_H
+#define SBT_PROFILE_H
+
+#include "Map.h"
+
+#include <llvm/Support/Error.h>
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace llvm {
+class Function;
+class GlobalVariable;
+class Instruction;
+class Value;
+}
+
+namespace sbt {
+
+class Context;
+class Function;
+
+/**
+ * Profile guided translation.
+ *
+ * With -profile-gen, the translated code is instrumented to count
+ * function entries and the directions taken by conditional branches, and
+ * to keep a histogram of the targets of each indirect call. The counters
+ * are written by the runtime (sbt_prof_*() in Runtime.c) on exit.
+ *
+ * With -profile-use, the profile is read back, and used to set function
+ * entry counts, branch weights and the profile summary of the module,
+ * to mark never executed functions as cold, and to add the hottest
+ * targets of indirect calls to the ones tried directly.
+ *
+ * Profile entries are keyed by section name and guest address, so a
+ * profile remains valid when the translator or its options change.
+ * Profiles of several runs may be concatenated: the counts of repeated
+ * entries are added.
+ */
+class Profile
+{
+public:
+    // indirect call targets and counts, hottest first
+    using Targets = std::vector<std::pair<uint64_t, uint64_t>>;
+
+    /**
+     * ctor.
+     *
+     * Reads the profile given by -profile-use, if any.
+     *
+     * @param ctx
+     * @param err
+     */
+    Profile(Context* ctx, llvm::Error& err);
+
+    // translation hooks
+    // (addresses are in the section being translated)
+
+    /**
+     * Handle the start of a function: count its entries (-profile-gen),
+     * or set its entry count (-profile-use).
+     *
+     * @param addr function address
+     * @param f LLVM function (null if it's part of a region)
+     */
+    void startFunc(uint64_t addr, llvm::Function* f);
+
+    // count the direction taken by the conditional branch at addr
+    // (-profile-gen)
+    void countBranch(uint64_t addr, llvm::Value* cond);
+    // set the weights of the conditional branch at addr (-profile-use)
+    void setBranchWeights(uint64_t addr, llvm::Instruction* br) const;
+
+    // record the target of the indirect call at addr (-profile-gen)
+    void countICall(uint64_t addr, llvm::Value* target);
+    // get the targets of the indirect call at addr (-profile-use)
+    // (null if it was not executed)
+    const Targets* icallTargets(uint64_t addr) const;
+
+    /**
+     * Finish the translation: define the counters and register them with
+     * the runtime (-profile-gen), or set the profile summary of the module
+     * (-profile-use).
+     *
+     * @param funcs all functions, to map indirect call targets back
+     *              to guest addresses
+     */
+    void finish(const Map<uint64_t, Function*>& funcs);
+
+    // raw profile contents
+    const std::string& contents() const
+    {
+        return _contents;
+    }
+
+private:
+    // section name, guest address
+    using Key = std::pair<std::string, uint64_t>;
+
+    Context* _ctx;
+
+    // -profile-gen
+
+    enum Kind : uint32_t {
+        K_FUNC = 'f',
+        K_TAKEN = 't',
+        K_NOT_TAKEN = 'n'
+    };
+
+    struct Counter {
+        Kind kind;
+        unsigned sec;
+        uint64_t addr;
+    };
+
+    // placeholders, replaced by the real arrays by genData()
+    llvm::GlobalVariable* _counts = nullptr;
+    llvm::GlobalVariable* _icalls = nullptr;
+    llvm::Function* _icallFunc = nullptr;
+    std::vector<Counter> _counters;
+    std::vector<std::pair<unsigned, uint64_t>> _icallSites;
+    std::vector<std::string> _secs;
+
+    // -profile-use
+
+    std::string _contents;
+    Map<Key, uint64_t> _funcCounts;
+    Map<Key, std::pair<uint64_t, uint64_t>> _branchCounts;
+    Map<Key, Targets> _icallTargets;
+
+    // methods
+
+    bool gen() const
+    {
+        return _counts;
+    }
+
+    Key key(uint64_t addr) const;
+    unsigned secIndex(const std::string& sec);
+    void inc(llvm::Value* idx);
+    void genData(const Map<uint64_t, Function*>& funcs);
+    void setSummary();
+    llvm::Error load(const std::string& path);
+};
+
+}
+
+#endif
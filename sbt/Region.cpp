@@ -0,0 +1,91 @@
+#include "Region.h"
+
+#include "Builder.h"
+#include "Context.h"
+#include "Function.h"
+#include "Translator.h"
+
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Instructions.h>
+
+#undef ENABLE_DBGS
+#define ENABLE_DBGS 1
+#include "Debug.h"
+
+namespace sbt {
+
+BasicBlock* Region::newBB(const std::string& name)
+{
+    _bbs.emplace_back(new BasicBlock(_ctx, IRNAME(name), _f));
+    return &*_bbs.back();
+}
+
+
+void Region::setEntry(uint64_t addr, BasicBlock* bb)
+{
+    DBGF("addr={0:X+8}, bb={1}", addr, bb->name());
+    _entries.upsert(addr, std::move(bb));
+
+    // link stub
+    BasicBlock** stub = _stubs[addr];
+    if (!stub)
+        return;
+
+    llvm::IRBuilder<>* builder = _ctx->builder;
+    llvm::BasicBlock* savedBB = builder->GetInsertBlock();
+    Builder bldi(_ctx, NO_FIRST);
+    bldi.setInsertBlock(*stub);
+    bldi.br(bb);
+    builder->SetInsertPoint(savedBB);
+}
+
+
+BasicBlock* Region::entry(uint64_t addr)
+{
+    if (BasicBlock** bb = _entries[addr])
+        return *bb;
+    if (BasicBlock** bb = _stubs[addr])
+        return *bb;
+
+    BasicBlock* bb = newBB(BasicBlock::getBBName(addr) + "_entry");
+    _stubs.upsert(addr, std::move(bb));
+    return bb;
+}
+
+
+void Region::addRetSite(uint64_t addr, BasicBlock* bb)
+{
+    DBGF("addr={0:X+8}, bb={1}", addr, bb->name());
+    retBB();
+    _retSw->addCase(_ctx->c.i32(addr), bb->bb());
+    _retSites++;
+}
+
+
+BasicBlock* Region::retBB()
+{
+    if (_retBB)
+        return _retBB;
+
+    llvm::IRBuilder<>* builder = _ctx->builder;
+    llvm::BasicBlock* savedBB = builder->GetInsertBlock();
+    Builder bldi(_ctx, NO_FIRST);
+    Builder* bld = &bldi;
+
+    // default: invalid return address
+    BasicBlock* bbAbort = newBB("ret_abort");
+    bld->setInsertBlock(bbAbort);
+    bld->call(_ctx->translator->sbtabort()->func());
+    bld->unreachable();
+
+    // switch (RA)
+    _retBB = newBB("ret_dispatch");
+    bld->setInsertBlock(_retBB);
+    llvm::Value* ra = bld->load(_regs->getReg(XRegister::RA).getForRead());
+    _retSw = bld->sw(ra, *bbAbort);
+
+    builder->SetInsertPoint(savedBB);
+    return _retBB;
+}
+
+}
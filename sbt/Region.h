@@ -0,0 +1,124 @@
+#ifndef SBT_REGION_H
+#define SBT_REGION_H
+
+#include "BasicBlock.h"
+#include "FRegister.h"
+#include "Map.h"
+#include "XRegister.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace llvm {
+class Function;
+class SwitchInst;
+}
+
+namespace sbt {
+
+class Context;
+
+/**
+ * All guest functions of a code section, translated into a single
+ * LLVM function (-regs=oneregion).
+ *
+ * The region function is main's, and all guest functions share its local
+ * register file, so registers don't need to be synced on internal calls.
+ * Calls and returns are lowered to branches: a call sets RA and branches
+ * to the callee's entry BB, and a return branches to a dispatch BB, that
+ * switches on RA to the BB that follows each call site.
+ */
+class Region
+{
+public:
+    Region(Context* ctx)
+        :
+        _ctx(ctx)
+    {}
+
+    /**
+     * Set region function and register files (done by main).
+     */
+    void init(
+        llvm::Function* f,
+        std::shared_ptr<XRegisters> regs,
+        std::shared_ptr<FRegisters> fregs)
+    {
+        _f = f;
+        _regs = std::move(regs);
+        _fregs = std::move(fregs);
+    }
+
+    // getters
+
+    llvm::Function* func() const
+    {
+        return _f;
+    }
+
+    const std::shared_ptr<XRegisters>& regs() const
+    {
+        return _regs;
+    }
+
+    const std::shared_ptr<FRegisters>& fregs() const
+    {
+        return _fregs;
+    }
+
+    // number of return sites
+    size_t retSites() const
+    {
+        return _retSites;
+    }
+
+    /**
+     * Set the entry BB of the function at the given address,
+     * when it starts being translated.
+     */
+    void setEntry(uint64_t addr, BasicBlock* bb);
+
+    /**
+     * Get the entry BB of the function at the given address.
+     *
+     * If the function was not translated yet, a stub BB, that is later
+     * linked to its real entry BB, is returned.
+     */
+    BasicBlock* entry(uint64_t addr);
+
+    /**
+     * Add a return site.
+     *
+     * @param addr return address
+     * @param bb BB to continue at, when returning to addr
+     */
+    void addRetSite(uint64_t addr, BasicBlock* bb);
+
+    // get the return dispatch BB
+    BasicBlock* retBB();
+
+private:
+    Context* _ctx;
+    llvm::Function* _f = nullptr;
+    std::shared_ptr<XRegisters> _regs;
+    std::shared_ptr<FRegisters> _fregs;
+
+    // entry BBs of translated functions, by address
+    Map<uint64_t, BasicBlock*> _entries;
+    // stub entry BBs of functions not translated yet, by address
+    Map<uint64_t, BasicBlock*> _stubs;
+    // BBs created by the region
+    std::vector<BasicBlockPtr> _bbs;
+
+    // return dispatch
+    BasicBlock* _retBB = nullptr;
+    llvm::SwitchInst* _retSw = nullptr;
+    size_t _retSites = 0;
+
+    BasicBlock* newBB(const std::string& name);
+};
+
+}
+
+#endif
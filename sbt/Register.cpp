@@ -1,6 +1,13 @@
 #include "Register.h"
 
 #include "Builder.h"
+#include "FRegister.h"
+#include "XRegister.h"
+
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/DerivedTypes.h>
+#include <llvm/IR/GlobalVariable.h>
+#include <llvm/Support/MathExtras.h>
 
 namespace sbt {
 
@@ -38,6 +45,11 @@ Register::Register(
         xassert(bld);
         _r = bld->_alloca(lltype, nullptr, irName);
 
+    // global, in the register file
+    } else if (ctx->regFile) {
+        xassert(!decl);
+        _r = ctx->regFile->reg(type, num);
+
     // global
     } else {
         llvm::GlobalVariable::LinkageTypes linkt =
@@ -47,4 +59,72 @@ Register::Register(
     }
 }
 
+
+Register::Register(const std::string& name, llvm::Value* r)
+    :
+    _name(name),
+    _local(false),
+    _r(r)
+{
+}
+
+
+RegFile::RegFile(Context* ctx, bool tls)
+    :
+    _ctx(ctx)
+{
+    const Types& t = ctx->t;
+    llvm::StructType* ty = llvm::StructType::create({
+            llvm::ArrayType::get(t.i32, XRegisters::NUM),
+            llvm::ArrayType::get(t.fp64, FRegisters::NUM),
+            t.i32
+        }, "rv_regs_t");
+
+    _var = new llvm::GlobalVariable(*ctx->module, ty, !CONSTANT,
+        llvm::GlobalVariable::ExternalLinkage,
+        llvm::ConstantAggregateZero::get(ty), "rv_regs");
+    _var->setAlignment(ALIGN);
+    if (tls)
+        _var->setThreadLocal(true);
+}
+
+
+llvm::Constant* RegFile::reg(Register::Type type, unsigned num) const
+{
+    if (type == Register::T_FLOAT) {
+        xassert(num < FRegisters::NUM);
+        return field({ F, num });
+    } else {
+        xassert(num < XRegisters::NUM);
+        return field({ X, num });
+    }
+}
+
+
+llvm::Constant* RegFile::fcsr() const
+{
+    return field({ FCSR });
+}
+
+
+unsigned RegFile::align(Register::Type type, unsigned num) const
+{
+    uint64_t off;
+    if (type == Register::T_FLOAT)
+        off = XRegisters::NUM * 4 + num * 8;
+    else
+        off = num * 4;
+    return llvm::MinAlign(ALIGN, off);
+}
+
+
+llvm::Constant* RegFile::field(std::vector<unsigned> idx) const
+{
+    std::vector<llvm::Constant*> cidx = { _ctx->c.i32(0) };
+    for (unsigned i : idx)
+        cidx.push_back(_ctx->c.i32(i));
+    return llvm::ConstantExpr::getInBoundsGetElementPtr(
+        _var->getValueType(), _var, cidx);
+}
+
 }
@@ -8,6 +8,8 @@
 #include <vector>
 
 namespace llvm {
+class Constant;
+class GlobalVariable;
 class Value;
 }
 
@@ -45,6 +47,14 @@ public:
         Type type,
         uint32_t flags);
 
+    /**
+     * ctor: register kept at the given address (see RegFile).
+     *
+     * @param name register name (for printing purposes)
+     * @param r register address
+     */
+    Register(const std::string& name, llvm::Value* r);
+
     // reg name
     const std::string& name() const
     {
@@ -57,6 +67,12 @@ public:
         return _r;
     }
 
+    // register variable (not counted as an access)
+    llvm::Value* var() const
+    {
+        return _r;
+    }
+
     llvm::Value* getForRead()
     {
         _read = true;
@@ -134,6 +150,45 @@ private:
 };
 
 
+/**
+ * Global register file kept in a single struct (-reg-file):
+ *
+ * struct { i32 x[32]; double f[32]; i32 fcsr; }
+ *
+ * It's aligned to a cache line, and contiguous ranges of registers are
+ * synced with wide (vector) loads and stores. It may also be thread local
+ * (-reg-file-tls), for multithreaded guests.
+ */
+class RegFile
+{
+public:
+    static const unsigned ALIGN = 64;
+
+    RegFile(Context* ctx, bool tls);
+
+    // get the address of a x (T_INT) or f (T_FLOAT) register
+    llvm::Constant* reg(Register::Type type, unsigned num) const;
+
+    // get the address of fcsr
+    llvm::Constant* fcsr() const;
+
+    // get the known alignment of a x (T_INT) or f (T_FLOAT) register
+    unsigned align(Register::Type type, unsigned num) const;
+
+private:
+    enum Field : unsigned {
+        X,
+        F,
+        FCSR
+    };
+
+    Context* _ctx;
+    llvm::GlobalVariable* _var;
+
+    llvm::Constant* field(std::vector<unsigned> idx) const;
+};
+
+
 class CSR
 {
 public:
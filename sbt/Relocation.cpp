@@ -1,7 +1,6 @@
 #include "Relocation.h"
 
 #include "Builder.h"
-#include "Caller.h"
 #include "Instruction.h"
 #include "Object.h"
 #include "SBTError.h"
@@ -107,9 +106,11 @@ void SBTRelocation::skipRelocation(uint64_t addr)
 void SBTRelocation::addProxyReloc(ConstRelocationPtr reloc,
     Relocation::RType rtype)
 {
-    const LLVMRelocation* llrel = static_cast<const LLVMRelocation*>(&*reloc);
-    ProxyRelocation* hi = new ProxyRelocation(*llrel);
-    ProxyRelocation* lo = new ProxyRelocation(*llrel);
+    const LLVMRelocation* llrel = static_cast<const LLVMRelocation*>(reloc);
+    _proxyArena.emplace_back(*llrel);
+    ProxyRelocation* hi = &_proxyArena.back();
+    _proxyArena.emplace_back(*llrel);
+    ProxyRelocation* lo = &_proxyArena.back();
 
     switch (rtype) {
         case Relocation::PROXY:
@@ -156,12 +157,8 @@ SBTRelocation::handleRelocation(uint64_t addr, llvm::raw_ostream* os)
     switch (reloc->type()) {
         case Relocation::PROXY_HI:
         case llvm::ELF::R_RISCV_HI20:
-            // hi20 = (symbol_address + 0x800) >> 12
             relfn = [this](llvm::Constant* addr) {
-                llvm::Constant* c = llvm::ConstantExpr::getAdd(
-                    addr, _ctx->c.u32(0x800));
-                c = llvm::ConstantExpr::getLShr(c, _ctx->c.u32(12));
-                return c;
+                return hi20(addr);
             };
             break;
 
@@ -202,7 +199,7 @@ SBTRelocation::handleRelocation(uint64_t addr, llvm::raw_ostream* os)
             // hi20 = (symbol_address - hipc + 0x800) & 0xFFFFF000
             relfn = [this, &reloc](llvm::Constant* symaddr) {
                 const ProxyRelocation* pr =
-                    static_cast<const ProxyRelocation*>(reloc.get());
+                    static_cast<const ProxyRelocation*>(reloc);
                 llvm::Constant* hipc = _ctx->c.u32(pr->hiPC());
 
                 llvm::Constant* hi20 = llvm::ConstantExpr::getSub(
@@ -242,6 +239,7 @@ SBTRelocation::handleRelocation(uint64_t addr, llvm::raw_ostream* os)
 
     llvm::Constant* c = nullptr;
     llvm::Constant* lastSymC = nullptr;
+    llvm::Constant* loPtr = nullptr;
 
     // external symbol case: handle data or function
     if (isExt) {
@@ -302,7 +300,7 @@ SBTRelocation::handleRelocation(uint64_t addr, llvm::raw_ostream* os)
             // else return its symbol, that will be properly translated to
             // the to host symbol later
             else {
-                llvm::Value* sym = Caller::getFunctionSymbol(_ctx, f->name());
+                llvm::Value* sym = f->icallFunc();
                 xassert(sym && "Internal function symbol not found!");
                 if (reloc->type() == llvm::ELF::R_RISCV_JAL)
                     c = _ctx->c.i32(saddr);
@@ -348,15 +346,37 @@ SBTRelocation::handleRelocation(uint64_t addr, llvm::raw_ostream* os)
         }
 
         // TODO speed up section lookup for relocations
-        c = llvm::ConstantExpr::getAdd(
-            _ctx->shadowImage->getSection(reloc->secName()),
-            _ctx->c.i32(saddr));
+        c = _ctx->shadowImage->getAddr(
+            reloc->secName(), saddr, reloc->symbol());
+
+        // %lo(): keep the data address, to fold it with its %hi()
+        switch (reloc->type()) {
+            case Relocation::PROXY_LO:
+            case llvm::ELF::R_RISCV_LO12_I:
+            case llvm::ELF::R_RISCV_LO12_S:
+                loPtr = _ctx->shadowImage->getPtr(
+                    reloc->secName(), saddr, reloc->symbol());
+                _lastHi = llvm::ConstantExpr::getShl(
+                    hi20(c), _ctx->c.i32(12));
+                break;
+        }
     }
 
     _lastSymVal = lastSymC? lastSymC : c;
     c = relfn(c);
     // DBG(c->dump());
     _last = reloc;
+    _lastIsSection = !isExt && !isLocalFunc;
+    _lastLoPtr = loPtr;
+    return c;
+}
+
+
+llvm::Constant* SBTRelocation::hi20(llvm::Constant* addr) const
+{
+    // hi20 = (symbol_address + 0x800) >> 12
+    llvm::Constant* c = llvm::ConstantExpr::getAdd(addr, _ctx->c.u32(0x800));
+    c = llvm::ConstantExpr::getLShr(c, _ctx->c.u32(12));
     return c;
 }
 
@@ -375,6 +395,25 @@ llvm::Constant* SBTRelocation::lastSymVal() const
 }
 
 
+std::string SBTRelocation::lastSection(uint64_t addr) const
+{
+    if (_last && _last->offset() == addr && _lastIsSection)
+        return _last->secName();
+    return "";
+}
+
+
+llvm::Constant* SBTRelocation::lastLo(
+    uint64_t addr,
+    llvm::Constant*& hi) const
+{
+    if (!_last || _last->offset() != addr || !_lastLoPtr)
+        return nullptr;
+    hi = _lastHi;
+    return _lastLoPtr;
+}
+
+
 llvm::Constant* SBTRelocation::processSectionReloc(
     ConstRelocationPtr reloc,
     ShadowImage* shadowImage)
@@ -383,7 +422,7 @@ llvm::Constant* SBTRelocation::processSectionReloc(
     bool isFunction = false;
     xassert(reloc->hasSec());
 
-    auto* llrel = static_cast<const LLVMRelocation*>(reloc.get());
+    auto* llrel = static_cast<const LLVMRelocation*>(reloc);
 
     if (reloc->hasSym()) {
         addr += reloc->symAddr();
@@ -415,14 +454,13 @@ llvm::Constant* SBTRelocation::processSectionReloc(
 
     llvm::Constant* c;
     if (isFunction) {
-        Function::getByAddr(_ctx, addr, llrel->section());
-        llvm::Value* sym = Caller::getFunctionSymbol(_ctx, reloc->symName());
+        Function* f = Function::getByAddr(_ctx, addr, llrel->section());
+        llvm::Value* sym = f->icallFunc();
         xassert(sym && "Function symbol not found!");
         c = llvm::cast<llvm::Constant>(sym);
         c = llvm::ConstantExpr::getPointerCast(c, _ctx->t.i32);
     } else
-        c = llvm::ConstantExpr::getAdd(
-            shadowImage->getSection(reloc->secName()), _ctx->c.u32(addr));
+        c = shadowImage->getAddr(reloc->secName(), addr, reloc->symbol());
     return c;
 }
 
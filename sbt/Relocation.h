@@ -9,8 +9,10 @@
 #include <llvm/Support/Error.h>
 #include <llvm/Support/raw_ostream.h>
 
+#include <deque>
 #include <memory>
 #include <queue>
+#include <string>
 
 namespace llvm {
 class Constant;
@@ -82,21 +84,45 @@ public:
     bool isCall(uint64_t addr) const;
     llvm::Constant* lastSymVal() const;
 
+    /**
+     * Get the section targeted by the relocation of the given address,
+     * if it was handled last and refers to a (shadow) section.
+     *
+     * @return section name, or empty string if there is no such relocation.
+     */
+    std::string lastSection(uint64_t addr) const;
+
+    /**
+     * Get the guest data address of the %lo() relocation of the given
+     * address, if it was handled last, and the %hi() value that its base
+     * register must hold for them to be folded.
+     *
+     * @param hi %hi() value, as set by lui
+     * @return pointer to guest data, or null if there is no such relocation.
+     */
+    llvm::Constant* lastLo(uint64_t addr, llvm::Constant*& hi) const;
+
 private:
     Context* _ctx;
     ConstRelocIter _ri;
     ConstRelocIter _re;
     ConstSectionPtr _section;
+    // proxy relocations are owned by this relocator
+    std::deque<ProxyRelocation> _proxyArena;
     std::queue<ConstRelocationPtr> _proxyRelocs;
     mutable ConstRelocationPtr _cur;
     mutable ConstRelocationPtr _curP;
     ConstRelocationPtr _last = nullptr;
     llvm::Constant* _lastSymVal = nullptr;
+    bool _lastIsSection = false;
+    llvm::Constant* _lastLoPtr = nullptr;
+    llvm::Constant* _lastHi = nullptr;
 
     ConstRelocationPtr nextReloc(bool init = false);
     ConstRelocationPtr nextPReloc();
     ConstRelocationPtr getReloc(uint64_t addr);
     void addProxyReloc(ConstRelocationPtr rel, Relocation::RType rtype);
+    llvm::Constant* hi20(llvm::Constant* addr) const;
 
     llvm::Constant* processSectionReloc(
         ConstRelocationPtr reloc,
@@ -2,6 +2,7 @@
 
 #include <signal.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <sys/types.h>
 #include <unistd.h>
 
@@ -147,3 +148,104 @@ int sbt_printf_d(const char *fmt, double d)
 {
     return printf(fmt, d);
 }
+
+
+// profiling (-profile-gen)
+
+// (target, count) slots of each indirect call site
+#define SBT_PROF_ICALL_SLOTS 4
+
+static struct {
+    const char** secs;
+    // counters: kind, section, address
+    uint32_t n;
+    const uint32_t* keys;
+    const uint64_t* counts;
+    // indirect calls: section, address
+    uint32_t nicalls;
+    const uint32_t* icall_keys;
+    const uint32_t* icalls;
+    // indirect call targets: host address, section, guest address
+    uint32_t nfuncs;
+    const uint32_t* funcs;
+} sbt_prof;
+
+
+static void sbt_prof_dump(void)
+{
+    const char* path = getenv("SBT_PROFILE");
+    FILE* fp;
+    uint32_t i, j, k;
+
+    if (!path)
+        path = "sbt.prof";
+    fp = fopen(path, "w");
+    if (!fp) {
+        perror(path);
+        return;
+    }
+
+    fprintf(fp, "# riscv-sbt profile\n");
+    for (i = 0; i < sbt_prof.n; i++) {
+        const uint32_t* key = &sbt_prof.keys[3 * i];
+        fprintf(fp, "%c %s %x %llu\n",
+            (char)key[0], sbt_prof.secs[key[1]], key[2],
+            (unsigned long long)sbt_prof.counts[i]);
+    }
+
+    for (i = 0; i < sbt_prof.nicalls; i++) {
+        const uint32_t* key = &sbt_prof.icall_keys[2 * i];
+        const uint32_t* slot = &sbt_prof.icalls[2 * SBT_PROF_ICALL_SLOTS * i];
+
+        for (j = 0; j < SBT_PROF_ICALL_SLOTS && slot[1]; j++, slot += 2) {
+            // map call target (host function or guest address, with
+            // the icaller) back to guest function
+            // (calls to external functions are skipped)
+            for (k = 0; k < sbt_prof.nfuncs; k++) {
+                const uint32_t* func = &sbt_prof.funcs[3 * k];
+                if (func[0] == slot[0]) {
+                    fprintf(fp, "i %s %x %s %x %u\n",
+                        sbt_prof.secs[key[0]], key[1],
+                        sbt_prof.secs[func[1]], func[2], slot[1]);
+                    break;
+                }
+            }
+        }
+    }
+
+    fclose(fp);
+}
+
+
+void sbt_prof_init(
+    const char** secs,
+    uint32_t n, const uint32_t* keys, const uint64_t* counts,
+    uint32_t nicalls, const uint32_t* icall_keys, const uint32_t* icalls,
+    uint32_t nfuncs, const uint32_t* funcs)
+{
+    sbt_prof.secs = secs;
+    sbt_prof.n = n;
+    sbt_prof.keys = keys;
+    sbt_prof.counts = counts;
+    sbt_prof.nicalls = nicalls;
+    sbt_prof.icall_keys = icall_keys;
+    sbt_prof.icalls = icalls;
+    sbt_prof.nfuncs = nfuncs;
+    sbt_prof.funcs = funcs;
+    atexit(sbt_prof_dump);
+}
+
+
+void sbt_prof_icall(uint32_t* slots, uint32_t target)
+{
+    int i;
+
+    // targets that don't fit are not counted
+    for (i = 0; i < SBT_PROF_ICALL_SLOTS; i++, slots += 2) {
+        if (slots[0] == target || !slots[1]) {
+            slots[0] = target;
+            slots[1]++;
+            return;
+        }
+    }
+}
@@ -1,8 +1,19 @@
 #ifndef SBT_RUNTIME_H
 #define SBT_RUNTIME_H
 
+#include <stdint.h>
+
 int sbt_printf_d(const char*, double);
 
+// profiling (-profile-gen)
+
+void sbt_prof_init(
+    const char** secs,
+    uint32_t n, const uint32_t* keys, const uint64_t* counts,
+    uint32_t nicalls, const uint32_t* icall_keys, const uint32_t* icalls,
+    uint32_t nfuncs, const uint32_t* funcs);
+void sbt_prof_icall(uint32_t* slots, uint32_t target);
+
 // soft float
 
 #ifdef __i386__
@@ -0,0 +1,83 @@
+#include "Scheduler.h"
+
+#include <algorithm>
+#include <thread>
+
+namespace sbt {
+
+Scheduler::Scheduler(unsigned jobs)
+{
+    if (jobs == 0)
+        jobs = std::max(1u, std::thread::hardware_concurrency());
+
+    _workers.reserve(jobs);
+    for (unsigned i = 0; i < jobs; i++)
+        _workers.emplace_back(new Worker);
+}
+
+
+void Scheduler::add(Task&& task)
+{
+    // distribute tasks among workers in a round-robin fashion
+    Worker& w = *_workers[_next];
+    _next = (_next + 1) % _workers.size();
+
+    std::lock_guard<std::mutex> lock(w.mtx);
+    w.tasks.push_back(std::move(task));
+}
+
+
+bool Scheduler::pop(size_t id, Task& task)
+{
+    Worker& w = *_workers[id];
+    std::lock_guard<std::mutex> lock(w.mtx);
+    if (w.tasks.empty())
+        return false;
+
+    task = std::move(w.tasks.back());
+    w.tasks.pop_back();
+    return true;
+}
+
+
+bool Scheduler::steal(size_t id, Task& task)
+{
+    size_t n = _workers.size();
+    for (size_t i = 1; i < n; i++) {
+        Worker& w = *_workers[(id + i) % n];
+        std::lock_guard<std::mutex> lock(w.mtx);
+        if (w.tasks.empty())
+            continue;
+
+        task = std::move(w.tasks.front());
+        w.tasks.pop_front();
+        return true;
+    }
+    return false;
+}
+
+
+void Scheduler::work(size_t id)
+{
+    // no new tasks are added while running,
+    // so we are done when there is nothing left to pop or steal
+    Task task;
+    while (pop(id, task) || steal(id, task))
+        task();
+}
+
+
+void Scheduler::run()
+{
+    std::vector<std::thread> threads;
+    threads.reserve(_workers.size() - 1);
+    for (size_t i = 1; i < _workers.size(); i++)
+        threads.emplace_back(&Scheduler::work, this, i);
+
+    work(0);
+
+    for (auto& t : threads)
+        t.join();
+}
+
+}
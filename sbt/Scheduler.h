@@ -0,0 +1,74 @@
+#ifndef SBT_SCHEDULER_H
+#define SBT_SCHEDULER_H
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace sbt {
+
+/**
+ * Work-stealing task scheduler.
+ *
+ * Tasks are distributed among a fixed number of workers, each one with its
+ * own task deque. A worker consumes tasks from the back of its own deque and,
+ * when it runs out of work, steals tasks from the front of the other
+ * workers' deques. This keeps all threads busy even when task sizes are very
+ * uneven, as is the case of guest functions.
+ *
+ * All tasks must be added before calling run().
+ */
+class Scheduler
+{
+public:
+    using Task = std::function<void()>;
+
+    /**
+     * ctor.
+     *
+     * @param jobs number of worker threads (0 = number of host cores)
+     */
+    Scheduler(unsigned jobs);
+
+    // disallow copy and move
+    Scheduler(const Scheduler&) = delete;
+    Scheduler& operator=(const Scheduler&) = delete;
+
+    // number of workers
+    size_t jobs() const
+    {
+        return _workers.size();
+    }
+
+    // add task
+    void add(Task&& task);
+
+    // run all tasks and wait for them to finish
+    // (the calling thread is used as worker 0)
+    void run();
+
+private:
+    struct Worker
+    {
+        std::mutex mtx;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<Worker>> _workers;
+    size_t _next = 0;
+
+    // methods
+
+    // worker main loop
+    void work(size_t id);
+    // get next task from worker's own deque
+    bool pop(size_t id, Task& task);
+    // steal a task from another worker
+    bool steal(size_t id, Task& task);
+};
+
+}
+
+#endif
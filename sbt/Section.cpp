@@ -1,19 +1,60 @@
 #include "Section.h"
 
 #include "Builder.h"
+#include "Disassembler.h"
+#include "FRegister.h"
 #include "Function.h"
 #include "Instruction.h"
+#include "Module.h"
+#include "Profile.h"
 #include "Relocation.h"
 #include "SBTError.h"
+#include "Scheduler.h"
+#include "ShadowImage.h"
+#include "Syscall.h"
+#include "TranslationCache.h"
+#include "XRegister.h"
 
+#include <llvm/Object/ELF.h>
 #include <llvm/Support/FormatVariadic.h>
 
+// LLVM internal instruction info
+#define GET_INSTRINFO_ENUM
+#include <llvm/Target/RISCV/RISCVGenInstrInfo.inc>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <set>
+
 #undef ENABLE_DBGS
 #define ENABLE_DBGS 1
 #include "Debug.h"
 
 namespace sbt {
 
+// compare MCInsts' opcodes and operands
+static bool sameInst(const llvm::MCInst& a, const llvm::MCInst& b)
+{
+    if (a.getOpcode() != b.getOpcode() ||
+        a.getNumOperands() != b.getNumOperands())
+        return false;
+
+    for (unsigned i = 0; i < a.getNumOperands(); i++) {
+        const llvm::MCOperand& oa = a.getOperand(i);
+        const llvm::MCOperand& ob = b.getOperand(i);
+        if (oa.isReg() != ob.isReg() || oa.isImm() != ob.isImm())
+            return false;
+        if (oa.isReg() && oa.getReg() != ob.getReg())
+            return false;
+        if (oa.isImm() && oa.getImm() != ob.getImm())
+            return false;
+    }
+    return true;
+}
+
+
 llvm::Error SBTSection::translate()
 {
     // skip non code sections
@@ -51,6 +92,85 @@ llvm::Error SBTSection::translate()
     _bytes = llvm::ArrayRef<uint8_t>(
         reinterpret_cast<const uint8_t *>(bytesStr.data()), bytesStr.size());
 
+    if (_ctx->opts->decoderBench())
+        benchDecoder();
+
+    // find all functions first
+    std::vector<Func> funcs = getFuncs();
+
+    // then decode them, in parallel if requested
+    if (auto err = decode(funcs))
+        return err;
+
+    // build the CFG: this finds all BBs and the functions that have no
+    // symbols but are called, before emitting any IR
+    discover(funcs);
+    findJumpTables(funcs);
+    resolveICalls(funcs);
+
+    if (_ctx->opts->regs() == Options::Regs::LIVE || _ctx->opts->funcSigs())
+        analyzeRegs(funcs);
+
+    // translate all functions into main, starting with it
+    if (_ctx->opts->regs() == Options::Regs::ONEREGION) {
+        if (canUseRegion(funcs)) {
+            _regsMode = Options::Regs::ONEREGION;
+            _region.reset(new Region(_ctx));
+            std::stable_partition(funcs.begin(), funcs.end(),
+                [](const Func& func) { return func.name == "main"; });
+        } else if (_ctx->opts->stats())
+            LOGS << llvm::formatv("{0}: oneregion: falling back to locals\n",
+                _section->name());
+    }
+
+    // (in a region, host stack slots would be shared by all
+    //  activations of recursive functions)
+    if (_ctx->opts->optStack() && !_region)
+        findStackSlots(funcs);
+
+    // register all functions before translating them,
+    // to resolve calls to functions ahead of the current one
+    for (const Func& func : funcs) {
+        FunctionPtr f(new Function(_ctx, func.name, this,
+            func.start, func.end));
+        // main is created with a different type, in startMain(),
+        // and region functions use main
+        if (func.name != "main" && !_region)
+            f->create();
+        _ctx->addFunc(std::move(f));
+    }
+
+    // and translate them, in address order
+    // (except for main, in a region)
+    for (const Func& func : funcs) {
+        if (auto err = translate(func))
+            return err;
+    }
+
+    if (_region) {
+        // main owns the region's register file
+        _ctx->funcByName("main")->cleanRegs();
+        if (_ctx->opts->stats())
+            LOGS << llvm::formatv("{0}: oneregion: {1} functions, "
+                "{2} return sites\n",
+                _section->name(), funcs.size(), _region->retSites());
+    }
+
+    _decoded.clear();
+    _jumpTables = Map<uint64_t, JumpTable>();
+    _jumpTableLoads.clear();
+    _icallTargets = Map<uint64_t, ICallTargets>();
+    _stackSlots = Map<uint64_t, std::vector<StackSlot>>();
+    _stackAccesses = Map<uint64_t, int64_t>();
+    _ctx->bld = nullptr;
+    _ctx->sec = nullptr;
+    return llvm::Error::success();
+}
+
+
+std::vector<SBTSection::Func> SBTSection::getFuncs() const
+{
+    std::vector<Func> funcs;
     const ConstSymbolPtrVec& symbols = _section->symbols();
     size_t n = symbols.size();
     Func func;
@@ -67,7 +187,7 @@ llvm::Error SBTSection::translate()
 
         uint64_t symaddr = sym->address();
         if (i == n - 1)
-            end = size;
+            end = _section->size();
         else
             end = symbols[i + 1]->address();
 
@@ -84,9 +204,7 @@ llvm::Error SBTSection::translate()
             if (state == INSIDE_FUNC) {
                 func.end = symaddr;
                 DBGF("function end: {0}@{1:X+8}", func.name, func.end);
-                // translate
-                if (auto err = translate(func))
-                    return err;
+                funcs.push_back(func);
                 state = OUTSIDE_FUNC;
             }
             // function start
@@ -104,22 +222,1470 @@ llvm::Error SBTSection::translate()
     if (state == INSIDE_FUNC) {
         func.end = end;
         DBGF("last function end: {0}@{1:X+8}", func.name, func.end);
-        if (auto err = translate(func))
-            return err;
+        funcs.push_back(func);
     }
 
-    _ctx->bld = nullptr;
-    _ctx->sec = nullptr;
+    return funcs;
+}
+
+
+llvm::Error SBTSection::decode(const std::vector<Func>& funcs)
+{
+    const Disassembler* disasm = _ctx->disasm;
+    const uint64_t isz = Constants::INSTRUCTION_SIZE;
+    const bool check = _ctx->opts->checkDecoder();
+
+    _decoded.clear();
+    _decoded.resize(_bytes.size() / isz);
+    const uint64_t secEnd = _decoded.size() * isz;
+
+    Scheduler sched(_ctx->opts->decodeJobs());
+    DBGF("decoding {0} function(s) using {1} thread(s)",
+        funcs.size(), sched.jobs());
+
+    std::atomic<size_t> mismatches(0);
+
+    // one task per function
+    // (each task writes only to the slots of its own function)
+    for (const Func& func : funcs) {
+        sched.add([this, disasm, isz, secEnd, check, &mismatches, &func]() {
+            uint64_t end = MIN(func.end, secEnd);
+            for (uint64_t addr = func.start; addr < end; addr += isz) {
+                uint32_t rawInst =
+                    *reinterpret_cast<const uint32_t*>(&_bytes[addr]);
+                DecodedInst& di = _decoded[addr / isz];
+                di.valid = Decoder::decode(rawInst, di.inst);
+                if (!di.valid || !check)
+                    continue;
+
+                // validate with the MC disassembler
+                llvm::MCInst native, mc;
+                size_t size;
+                Decoder::toMCInst(di.inst, native);
+                if (!disasm->decode(addr, rawInst, mc, size) ||
+                    !sameInst(native, mc))
+                    mismatches++;
+            }
+        });
+    }
+
+    sched.run();
+
+    // (instructions are translated from the native decoder's output,
+    // there is no MC fallback)
+    if (mismatches)
+        return ERRORF("section {0}: native decoder mismatches: {1}",
+            _section->name(), mismatches.load());
     return llvm::Error::success();
 }
 
 
+void SBTSection::benchDecoder() const
+{
+    const Disassembler* disasm = _ctx->disasm;
+    const uint64_t isz = Constants::INSTRUCTION_SIZE;
+    const size_t n = _bytes.size() / isz;
+    if (n == 0)
+        return;
+    // decode the section repeatedly, to get measurable times
+    const size_t reps = MAX(size_t(1), (1 << 22) / n);
+
+    size_t nativeValid = 0;
+    size_t mcValid = 0;
+    using Clock = std::chrono::steady_clock;
+
+    auto t0 = Clock::now();
+    for (size_t r = 0; r < reps; r++) {
+        for (size_t i = 0; i < n; i++) {
+            uint32_t rawInst =
+                *reinterpret_cast<const uint32_t*>(&_bytes[i * isz]);
+            Decoder::Inst inst;
+            nativeValid += Decoder::decode(rawInst, inst);
+        }
+    }
+
+    auto t1 = Clock::now();
+    for (size_t r = 0; r < reps; r++) {
+        for (size_t i = 0; i < n; i++) {
+            uint32_t rawInst =
+                *reinterpret_cast<const uint32_t*>(&_bytes[i * isz]);
+            llvm::MCInst inst;
+            size_t size;
+            mcValid += disasm->decode(i * isz, rawInst, inst, size);
+        }
+    }
+    auto t2 = Clock::now();
+
+    std::chrono::duration<double> native = t1 - t0;
+    std::chrono::duration<double> mc = t2 - t1;
+    double total = double(n) * reps;
+    LOGS << llvm::formatv("decoder benchmark: section {0}: "
+        "{1} instructions x {2}: native: {3:F0} instrs/s, "
+        "MC: {4:F0} instrs/s, speedup: {5:F1}x, "
+        "decoded: native={6}, MC={7}\n",
+        _section->name(), n, reps,
+        total / native.count(), total / mc.count(),
+        mc.count() / native.count(),
+        nativeValid / reps, mcValid / reps);
+}
+
+
+void SBTSection::discover(std::vector<Func>& funcs)
+{
+    namespace RISCV = llvm::RISCV;
+    const uint64_t isz = Constants::INSTRUCTION_SIZE;
+    const uint64_t secEnd = _decoded.size() * isz;
+
+    // branch/jump targets given by relocations
+    std::map<uint64_t, uint64_t> relTargets = branchRelocs();
+
+    auto getTarget = [&](uint64_t addr, int64_t offs) -> uint64_t {
+        auto it = relTargets.find(addr);
+        if (it != relTargets.end())
+            return it->second;
+        return addr + offs;
+    };
+
+    // targets of JALs with a link register: these become new functions,
+    // that translateInstrs() would otherwise find only when reaching them
+    std::set<uint64_t> calls;
+
+    for (const Func& func : funcs) {
+        uint64_t end = MIN(func.end, secEnd);
+        auto leader = [&](uint64_t addr) {
+            if (addr > func.start && addr < end)
+                _decoded[addr / isz].leader = true;
+        };
+
+        for (uint64_t addr = func.start; addr < end; addr += isz) {
+            // code pointers to this address are patched with
+            // its BB address
+            if (_ctx->shadowImage->hasPendingRelocs(addr, addr + isz))
+                leader(addr);
+
+            const DecodedInst& di = _decoded[addr / isz];
+            if (!di.valid)
+                continue;
+            const Decoder::Inst& inst = di.inst;
+
+            switch (inst.opcode) {
+                case RISCV::BEQ:
+                case RISCV::BNE:
+                case RISCV::BGE:
+                case RISCV::BGEU:
+                case RISCV::BLT:
+                case RISCV::BLTU:
+                    leader(getTarget(addr, inst.imm));
+                    leader(addr + isz);
+                    break;
+
+                case RISCV::JAL: {
+                    uint64_t target = getTarget(addr, inst.imm);
+                    // call/jump to an external function
+                    if (target == Constants::INVALID_ADDR)
+                        break;
+                    if (inst.rd != XRegister::ZERO)
+                        calls.insert(target);
+                    else {
+                        leader(target);
+                        leader(addr + isz);
+                    }
+                    break;
+                }
+
+                // return or indirect jump
+                case RISCV::JALR:
+                    if (inst.rd == XRegister::ZERO)
+                        leader(addr + isz);
+                    break;
+            }
+        }
+    }
+
+    // split functions at called addresses
+    // (named as in Function::getByAddr())
+    std::vector<Func> split;
+    for (const Func& func : funcs) {
+        Func f = func;
+        for (auto it = calls.upper_bound(func.start);
+                it != calls.end() && *it < func.end; ++it)
+        {
+            DBGF("new function at {0:X+8}, called from {1}", *it, func.name);
+            f.end = *it;
+            split.push_back(f);
+            f.name = "f" + llvm::Twine::utohexstr(*it).str();
+            f.start = *it;
+            f.end = func.end;
+        }
+        split.push_back(f);
+    }
+    funcs = std::move(split);
+}
+
+
+std::map<uint64_t, uint64_t> SBTSection::branchRelocs() const
+{
+    std::map<uint64_t, uint64_t> targets;
+    for (ConstRelocationPtr rel : _section->relocs()) {
+        uint64_t type = rel->type();
+        if (type != llvm::ELF::R_RISCV_BRANCH && type != llvm::ELF::R_RISCV_JAL)
+            continue;
+        // the encoded offset of a branch to an external function is
+        // meaningless: don't fall back to it
+        if (rel->isExternal() || !rel->isLocalFunction()) {
+            targets[rel->offset()] = Constants::INVALID_ADDR;
+            continue;
+        }
+        // same as SBTRelocation::handleRelocation()
+        targets[rel->offset()] =
+            rel->hasSym()? rel->symAddr() : rel->addend();
+    }
+    return targets;
+}
+
+
+std::map<uint64_t, ConstRelocationPtr> SBTSection::lo12Relocs() const
+{
+    std::map<uint64_t, ConstRelocationPtr> hi;
+    std::map<uint64_t, ConstRelocationPtr> lo12;
+    for (ConstRelocationPtr rel : _section->relocs()) {
+        switch (rel->type()) {
+            case llvm::ELF::R_RISCV_PCREL_HI20:
+                hi[rel->offset()] = rel;
+                break;
+
+            case llvm::ELF::R_RISCV_LO12_I:
+                lo12[rel->offset()] = rel;
+                break;
+
+            // the symbol of a %pcrel_lo() relocation is the address of
+            // its auipc, whose relocation gives the actual symbol
+            case llvm::ELF::R_RISCV_PCREL_LO12_I:
+                if (rel->hasSym()) {
+                    auto it = hi.find(rel->symAddr());
+                    if (it != hi.end())
+                        lo12[rel->offset()] = it->second;
+                }
+                break;
+        }
+    }
+    return lo12;
+}
+
+
+bool SBTSection::hiLoPair(
+    const Func& func,
+    uint64_t loAddr,
+    ConstRelocationPtr lo) const
+{
+    namespace RISCV = llvm::RISCV;
+    const uint64_t isz = Constants::INSTRUCTION_SIZE;
+
+    uint64_t hiAddr = lastDef(func, loAddr, _decoded[loAddr / isz].inst.rs1);
+    if (hiAddr == Constants::INVALID_ADDR)
+        return false;
+
+    // %pcrel_lo(): lo12Relocs() already gives its auipc's relocation
+    if (lo->type() == llvm::ELF::R_RISCV_PCREL_HI20)
+        return opcode(hiAddr) == RISCV::AUIPC && lo->offset() == hiAddr;
+
+    if (opcode(hiAddr) != RISCV::LUI)
+        return false;
+    const ConstRelocationPtrVec& relocs = _section->relocs();
+    auto it = std::lower_bound(relocs.begin(), relocs.end(), hiAddr,
+        [](ConstRelocationPtr rel, uint64_t addr) {
+            return rel->offset() < addr;
+        });
+    for (; it != relocs.end() && (*it)->offset() == hiAddr; ++it) {
+        ConstRelocationPtr hi = *it;
+        if (hi->type() == llvm::ELF::R_RISCV_HI20)
+            return hi->symbol() == lo->symbol() &&
+                hi->addend() == lo->addend();
+    }
+    return false;
+}
+
+
+uint64_t SBTSection::lastDef(const Func& func, uint64_t addr,
+    unsigned reg) const
+{
+    const uint64_t isz = Constants::INSTRUCTION_SIZE;
+
+    while (addr > func.start && !isBBLeader(addr)) {
+        addr -= isz;
+        const DecodedInst& di = _decoded[addr / isz];
+        if (!di.valid)
+            break;
+        Decoder::RegSet use, def;
+        Decoder::regs(di.inst, use, def);
+        if (def.x & (1u << reg))
+            return addr;
+    }
+    return Constants::INVALID_ADDR;
+}
+
+
+unsigned SBTSection::opcode(uint64_t addr) const
+{
+    size_t i = addr / Constants::INSTRUCTION_SIZE;
+    if (addr == Constants::INVALID_ADDR || !_decoded[i].valid)
+        return 0;
+    return _decoded[i].inst.opcode;
+}
+
+
+ConstRelocationPtr SBTSection::tableLoad(
+    const Func& func,
+    uint64_t ldAddr,
+    const std::map<uint64_t, ConstRelocationPtr>& lo12) const
+{
+    namespace RISCV = llvm::RISCV;
+    const uint64_t isz = Constants::INSTRUCTION_SIZE;
+
+    // look for:
+    //   lui   rB, %hi(table)
+    //   addi  rB, rB, %lo(table)
+    //   add   rP, rI, rB
+    //   lw    rT, offs(rP)
+    if (opcode(ldAddr) != RISCV::LW)
+        return nullptr;
+    const Decoder::Inst& ld = _decoded[ldAddr / isz].inst;
+
+    uint64_t addAddr = lastDef(func, ldAddr, ld.rs1);
+    if (opcode(addAddr) != RISCV::ADD)
+        return nullptr;
+    const Decoder::Inst& add = _decoded[addAddr / isz].inst;
+
+    for (unsigned reg : { add.rs1, add.rs2 }) {
+        uint64_t a = lastDef(func, addAddr, reg);
+        if (opcode(a) != RISCV::ADDI)
+            continue;
+        auto it = lo12.find(a);
+        if (it != lo12.end())
+            return it->second;
+    }
+    return nullptr;
+}
+
+
+uint64_t SBTSection::tableSize(
+    const Func& func,
+    uint64_t ldAddr,
+    const std::map<uint64_t, uint64_t>& relTargets) const
+{
+    namespace RISCV = llvm::RISCV;
+    const uint64_t isz = Constants::INSTRUCTION_SIZE;
+
+    // look for (see tableLoad()):
+    //   li    rN, N
+    //   bltu  rN, rX, default     (or bgeu rX, rN, default)
+    //   ...
+    //   slli  rI, rX, 2
+    //   add   rP, rI, rB
+    //   lw    rT, offs(rP)
+    const Decoder::Inst& ld = _decoded[ldAddr / isz].inst;
+    uint64_t addAddr = lastDef(func, ldAddr, ld.rs1);
+    const Decoder::Inst& add = _decoded[addAddr / isz].inst;
+
+    uint64_t shAddr = Constants::INVALID_ADDR;
+    for (unsigned reg : { add.rs1, add.rs2 }) {
+        uint64_t a = lastDef(func, addAddr, reg);
+        if (opcode(a) == RISCV::SLLI && _decoded[a / isz].inst.imm == 2) {
+            shAddr = a;
+            break;
+        }
+    }
+    if (shAddr == Constants::INVALID_ADDR)
+        return 0;
+    unsigned idx = _decoded[shAddr / isz].inst.rs1;
+    // the index must not change after the bounds check
+    if (lastDef(func, shAddr, idx) != Constants::INVALID_ADDR)
+        return 0;
+
+    // the bounds check is the conditional branch that ends the BB
+    // right before this one, falling through to it
+    uint64_t leader = shAddr;
+    while (leader > func.start && !isBBLeader(leader))
+        leader -= isz;
+    if (leader == func.start)
+        return 0;
+    uint64_t brAddr = leader - isz;
+    unsigned op = opcode(brAddr);
+    if (op != RISCV::BLTU && op != RISCV::BGEU)
+        return 0;
+    const Decoder::Inst& br = _decoded[brAddr / isz].inst;
+    auto it = relTargets.find(brAddr);
+    uint64_t target = it != relTargets.end()? it->second : brAddr + br.imm;
+    if (target == leader)
+        return 0;
+
+    // not taken if idx <= N (bltu) or idx < N (bgeu)
+    unsigned lim;
+    uint64_t n;
+    if (op == RISCV::BLTU && br.rs2 == idx) {
+        lim = br.rs1;
+        n = 1;
+    } else if (op == RISCV::BGEU && br.rs1 == idx) {
+        lim = br.rs2;
+        n = 0;
+    } else
+        return 0;
+
+    uint64_t liAddr = lastDef(func, brAddr, lim);
+    if (opcode(liAddr) != RISCV::ADDI)
+        return 0;
+    const Decoder::Inst& li = _decoded[liAddr / isz].inst;
+    if (li.rs1 != XRegister::ZERO || li.imm < 0)
+        return 0;
+    return n + li.imm;
+}
+
+
+bool SBTSection::tableEntries(
+    ConstRelocationPtr rel,
+    int64_t offs,
+    std::string& sec,
+    uint64_t& tableOffs,
+    std::vector<uint64_t>& entries) const
+{
+    if (rel->isExternal() || !rel->hasSec())
+        return false;
+
+    // the table must be in a data section of this module
+    const SBTSection* tsec = _ctx->sbtmodule->lookupSection(rel->secName());
+    if (!tsec || tsec->section()->isText())
+        return false;
+
+    sec = rel->secName();
+    // same as SBTRelocation::handleRelocation()
+    tableOffs = (rel->hasSym()? rel->symAddr() : 0) + rel->addend() + offs;
+
+    // take the run of code pointers to this section that starts at the
+    // table address
+    const ConstRelocationPtrVec& trels = tsec->section()->relocs();
+    auto it = std::lower_bound(trels.begin(), trels.end(), tableOffs,
+        [](ConstRelocationPtr r, uint64_t offs) {
+            return r->offset() < offs;
+        });
+    for (uint64_t o = tableOffs;
+        it != trels.end() && (*it)->offset() == o;
+        ++it, o += 4)
+    {
+        ConstRelocationPtr erel = *it;
+        if (erel->type() != llvm::ELF::R_RISCV_32 ||
+            !erel->hasSym() || erel->addend() != 0 ||
+            erel->secName() != _section->name())
+            break;
+        entries.push_back(erel->symAddr());
+    }
+    return !entries.empty();
+}
+
+
+void SBTSection::findJumpTables(const std::vector<Func>& funcs)
+{
+    namespace RISCV = llvm::RISCV;
+    const uint64_t isz = Constants::INSTRUCTION_SIZE;
+    const uint64_t secEnd = _decoded.size() * isz;
+
+    std::map<uint64_t, ConstRelocationPtr> lo12 = lo12Relocs();
+    if (lo12.empty())
+        return;
+    std::map<uint64_t, uint64_t> relTargets = branchRelocs();
+
+    for (const Func& func : funcs) {
+        uint64_t end = MIN(func.end, secEnd);
+
+        for (uint64_t addr = func.start; addr < end; addr += isz) {
+            const DecodedInst& di = _decoded[addr / isz];
+            if (!di.valid)
+                continue;
+            const Decoder::Inst& jr = di.inst;
+            // indirect jump, but not a return
+            if (jr.opcode != RISCV::JALR || jr.rd != XRegister::ZERO ||
+                jr.imm != 0 || jr.rs1 == XRegister::RA)
+                continue;
+
+            uint64_t ldAddr = lastDef(func, addr, jr.rs1);
+            ConstRelocationPtr rel = tableLoad(func, ldAddr, lo12);
+            if (!rel)
+                continue;
+
+            JumpTable jt;
+            jt.load = ldAddr;
+            std::vector<uint64_t> entries;
+            if (!tableEntries(rel, _decoded[ldAddr / isz].inst.imm,
+                    jt.sec, jt.offs, entries))
+                continue;
+            // the switch uses the targets found here, instead of the
+            // loaded ones: the table must not change at runtime
+            if (!_ctx->sbtmodule->lookupSection(jt.sec)->
+                    section()->isReadOnly())
+                continue;
+
+            // The relocations give only where the table starts: a table
+            // stored right after it would look like more entries. Take the
+            // size from the bounds check instead, and leave the jump
+            // alone if the two disagree.
+            uint64_t size = tableSize(func, ldAddr, relTargets);
+            if (size == 0 || size > entries.size())
+                continue;
+            entries.resize(size);
+            // (code pointers are patched with BB addresses in
+            // ShadowImage::processPending(), that also makes the targets
+            // BB leaders)
+            bool ok = true;
+            for (uint64_t target : entries) {
+                if (target <= func.start || target >= end ||
+                    !isBBLeader(target)) {
+                    ok = false;
+                    break;
+                }
+            }
+            if (!ok)
+                continue;
+            jt.targets = std::move(entries);
+
+            DBGF("jump table at {0:X+8}: load={1:X+8}, table={2}+{3:X+8}, "
+                "entries={4}",
+                addr, jt.load, jt.sec, jt.offs, jt.targets.size());
+            _jumpTableLoads.insert(jt.load);
+            _jumpTables.upsert(addr, std::move(jt));
+        }
+    }
+}
+
+
+void SBTSection::resolveICalls(const std::vector<Func>& funcs)
+{
+    namespace RISCV = llvm::RISCV;
+    const uint64_t isz = Constants::INSTRUCTION_SIZE;
+    const uint64_t secEnd = _decoded.size() * isz;
+    // more targets than this are not worth testing at each call
+    const size_t MAX_TARGETS = 4;
+
+    std::map<uint64_t, ConstRelocationPtr> lo12 = lo12Relocs();
+
+    // JALRs of auipc/jalr call pairs
+    std::set<uint64_t> calls;
+    for (ConstRelocationPtr rel : _section->relocs()) {
+        uint64_t type = rel->type();
+        if (type == llvm::ELF::R_RISCV_CALL ||
+            type == llvm::ELF::R_RISCV_CALL_PLT)
+            calls.insert(rel->offset() + isz);
+    }
+
+    std::set<uint64_t> starts;
+    for (const Func& func : funcs) {
+        // main has a different type
+        if (func.name != "main")
+            starts.insert(func.start);
+    }
+
+    // add the functions whose addresses are given by a %lo() relocation
+    // (directly or through a table in data) to targets
+    // (returns true if the address is that of a function)
+    auto addTargets = [&](ConstRelocationPtr rel, int64_t offs,
+        std::set<uint64_t>& targets)
+    {
+        // function in this section
+        if (rel->hasSym() && !rel->isExternal() &&
+            rel->secName() == _section->name())
+        {
+            uint64_t addr = rel->symAddr() + rel->addend();
+            if (!starts.count(addr))
+                return false;
+            targets.insert(addr);
+            return true;
+        }
+
+        std::string sec;
+        uint64_t tableOffs;
+        std::vector<uint64_t> entries;
+        if (!tableEntries(rel, offs, sec, tableOffs, entries))
+            return false;
+        for (uint64_t addr : entries) {
+            if (!starts.count(addr))
+                break;
+            targets.insert(addr);
+        }
+        return false;
+    };
+
+    size_t total = 0;
+    size_t totalResolved = 0;
+
+    for (const Func& func : funcs) {
+        uint64_t end = MIN(func.end, secEnd);
+
+        // functions whose addresses are taken anywhere in this function:
+        // with -icall-predict, used when the target of a call can't be
+        // found locally (e.g. when it is loaded outside a loop)
+        std::set<uint64_t> funcTargets;
+        if (_ctx->opts->icallPredict()) {
+            for (auto it = lo12.lower_bound(func.start);
+                it != lo12.end() && it->first < end; ++it)
+                addTargets(it->second, 0, funcTargets);
+        }
+
+        size_t icalls = 0;
+        size_t direct = 0;
+        size_t guarded = 0;
+
+        for (uint64_t addr = func.start; addr < end; addr += isz) {
+            const DecodedInst& di = _decoded[addr / isz];
+            if (!di.valid)
+                continue;
+            const Decoder::Inst& jr = di.inst;
+            // indirect call or jump, but not a return or jump table
+            if (jr.opcode != RISCV::JALR || jr.imm != 0 ||
+                (jr.rd == XRegister::ZERO &&
+                 (jr.rs1 == XRegister::RA || _jumpTables[addr])))
+                continue;
+            // calls through relocations are direct calls
+            if (calls.count(addr))
+                continue;
+
+            ICallTargets ict;
+            std::set<uint64_t> targets;
+            uint64_t defAddr = lastDef(func, addr, jr.rs1);
+            unsigned op = opcode(defAddr);
+            ConstRelocationPtr rel = nullptr;
+            auto lo = lo12.find(defAddr);
+
+            // (rB must hold the matching %hi(), and not, e.g., %hi() + idx)
+            bool hiLo = lo != lo12.end() &&
+                hiLoPair(func, defAddr, lo->second);
+
+            // addi rT, rB, %lo(func): exact
+            if (op == RISCV::ADDI && hiLo) {
+                ict.exact = addTargets(lo->second, 0, targets);
+                if (!ict.exact)
+                    targets.clear();
+            // lw rT, %lo(fptr)(rB): exact, if fptr is read-only,
+            // or else its initial value is a likely target
+            } else if (op == RISCV::LW && hiLo) {
+                std::string sec;
+                uint64_t offs;
+                std::vector<uint64_t> entries;
+                if (tableEntries(lo->second, 0, sec, offs, entries) &&
+                    starts.count(entries.front()))
+                {
+                    targets.insert(entries.front());
+                    ict.exact = _ctx->sbtmodule->lookupSection(sec)->
+                        section()->isReadOnly();
+                }
+            // lw rT, offs(table + idx)
+            } else if ((rel = tableLoad(func, defAddr, lo12)))
+                addTargets(rel, _decoded[defAddr / isz].inst.imm, targets);
+            // unknown
+            else if (jr.rd != XRegister::ZERO)
+                targets = funcTargets;
+
+            // -profile-use: the targets that were really called,
+            // hottest first
+            std::vector<uint64_t> hot;
+            const Profile::Targets* pt = _ctx->profile?
+                _ctx->profile->icallTargets(addr) : nullptr;
+            if (pt && !ict.exact && jr.rd != XRegister::ZERO) {
+                for (const auto& tc : *pt) {
+                    if (tc.second && starts.count(tc.first) &&
+                        hot.size() < MAX_TARGETS)
+                        hot.push_back(tc.first);
+                }
+                if (!hot.empty())
+                    targets = std::set<uint64_t>(hot.begin(), hot.end());
+            }
+
+            icalls++;
+            // only exact targets are used for indirect jumps
+            if (targets.empty() || targets.size() > MAX_TARGETS ||
+                (jr.rd == XRegister::ZERO && !ict.exact))
+                continue;
+
+            if (ict.exact)
+                direct++;
+            else
+                guarded++;
+            if (!hot.empty())
+                ict.targets = std::move(hot);
+            else
+                ict.targets.assign(targets.begin(), targets.end());
+            DBGF("icall at {0:X+8}: {1} {2} targets",
+                addr, ict.targets.size(), ict.exact? "exact" : "possible");
+            _icallTargets.upsert(addr, std::move(ict));
+        }
+
+        total += icalls;
+        totalResolved += direct + guarded;
+        if (_ctx->opts->stats() && icalls)
+            LOGS << llvm::formatv("{0}: resolved {1} of {2} indirect calls "
+                "(direct={3}, guarded={4})\n",
+                func.name, direct + guarded, icalls, direct, guarded);
+    }
+
+    if (_ctx->opts->stats() && total)
+        LOGS << llvm::formatv("{0}: resolved {1} of {2} indirect calls\n",
+            _section->name(), totalResolved, total);
+}
+
+
+bool SBTSection::canUseRegion(const std::vector<Func>& funcs) const
+{
+    namespace RISCV = llvm::RISCV;
+    const uint64_t isz = Constants::INSTRUCTION_SIZE;
+    const uint64_t secEnd = _decoded.size() * isz;
+    // bigger regions take too long to optimize and compile
+    const uint64_t MAX_INSTRS = 16384;
+
+    uint64_t mainAddr = Constants::INVALID_ADDR;
+    uint64_t instrs = 0;
+    std::set<uint64_t> starts;
+    for (const Func& func : funcs) {
+        if (func.name == "main")
+            mainAddr = func.start;
+        starts.insert(func.start);
+        instrs += (MIN(func.end, secEnd) - func.start) / isz;
+    }
+
+    if (mainAddr == Constants::INVALID_ADDR) {
+        DBGF("no main");
+        return false;
+    }
+    if (instrs > MAX_INSTRS) {
+        DBGF("too big: {0} instructions", instrs);
+        return false;
+    }
+
+    // returns jump to the address in RA, so calls must link to it
+    for (const Func& func : funcs) {
+        uint64_t end = MIN(func.end, secEnd);
+        for (uint64_t addr = func.start; addr < end; addr += isz) {
+            const DecodedInst& di = _decoded[addr / isz];
+            if (!di.valid)
+                continue;
+            const Decoder::Inst& inst = di.inst;
+            if ((inst.opcode == RISCV::JAL || inst.opcode == RISCV::JALR) &&
+                inst.rd != XRegister::ZERO && inst.rd != XRegister::RA)
+            {
+                DBGF("link register x{0} at {1:X+8}", inst.rd, addr);
+                return false;
+            }
+        }
+    }
+
+    // functions whose addresses are taken may be called from outside the
+    // region (e.g. by icaller or by external functions, such as qsort()),
+    // so they must be real functions
+    // (main is the region's entry, so it can't be called at all)
+    for (ConstSectionPtr sec : _section->object()->sections()) {
+        if (!sec->isText() && !sec->isData())
+            continue;
+
+        for (ConstRelocationPtr rel : sec->relocs()) {
+            bool isCall;
+            switch (rel->type()) {
+                case llvm::ELF::R_RISCV_CALL:
+                case llvm::ELF::R_RISCV_CALL_PLT:
+                case llvm::ELF::R_RISCV_JAL:
+                    isCall = true;
+                    break;
+
+                case llvm::ELF::R_RISCV_32:
+                case llvm::ELF::R_RISCV_HI20:
+                case llvm::ELF::R_RISCV_LO12_I:
+                case llvm::ELF::R_RISCV_LO12_S:
+                case llvm::ELF::R_RISCV_PCREL_HI20:
+                    isCall = false;
+                    break;
+
+                default:
+                    continue;
+            }
+
+            if (!rel->hasSym() || rel->isExternal() ||
+                rel->secName() != _section->name())
+                continue;
+            uint64_t addr = rel->symAddr() + rel->addend();
+            if (isCall? addr == mainAddr : starts.count(addr) != 0) {
+                DBGF("address of function at {0:X+8} taken in {1}",
+                    addr, sec->name());
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+
+void SBTSection::findStackSlots(const std::vector<Func>& funcs)
+{
+    namespace RISCV = llvm::RISCV;
+    const uint64_t isz = Constants::INSTRUCTION_SIZE;
+    const uint64_t secEnd = _decoded.size() * isz;
+    const uint32_t SP = 1u << XRegister::SP;
+
+    std::map<uint64_t, uint64_t> relTargets = branchRelocs();
+    auto getTarget = [&](uint64_t addr, int64_t offs) -> uint64_t {
+        auto it = relTargets.find(addr);
+        if (it != relTargets.end())
+            return it->second;
+        return addr + offs;
+    };
+
+    // SP relative load/store
+    struct Access {
+        uint64_t addr;
+        StackSlot slot;
+        bool store;
+        // below SP: may be overwritten by callees
+        bool belowSP;
+    };
+
+    // all accesses to a slot
+    struct SlotInfo {
+        StackSlot slot;
+        bool read = false;
+        bool written = false;
+        bool ok = true;
+    };
+
+    size_t totalFuncs = 0;
+    size_t totalSlots = 0;
+
+    for (const Func& func : funcs) {
+        uint64_t end = MIN(func.end, secEnd);
+        // SP - CFA, before the current instruction
+        int64_t spOffs = 0;
+        // lowest SP - CFA seen so far
+        int64_t minOffs = 0;
+        // SP - CFA at the start of each BB
+        std::map<uint64_t, int64_t> bbOffs;
+        bool fallthrough = true;
+        bool valid = true;
+        std::vector<Access> accesses;
+
+        bbOffs[func.start] = 0;
+
+        // SP - CFA must be the same on all paths to a BB
+        auto branch = [&](uint64_t target) {
+            if (target < func.start || target >= end)
+                return true;
+            auto p = bbOffs.insert({target, spOffs});
+            return p.first->second == spOffs;
+        };
+
+        for (uint64_t addr = func.start; addr < end && valid; addr += isz) {
+            if (addr != func.start && isBBLeader(addr)) {
+                auto it = bbOffs.find(addr);
+                if (it == bbOffs.end()) {
+                    // reached by indirect jumps only: assume the SP of
+                    // the function's body
+                    if (!fallthrough)
+                        spOffs = minOffs;
+                    bbOffs[addr] = spOffs;
+                } else if (!fallthrough)
+                    spOffs = it->second;
+                else if (it->second != spOffs) {
+                    DBGF("{0}: SP mismatch at {1:X+8}", func.name, addr);
+                    valid = false;
+                    break;
+                }
+            }
+
+            const DecodedInst& di = _decoded[addr / isz];
+            if (!di.valid) {
+                valid = false;
+                break;
+            }
+            const Decoder::Inst& inst = di.inst;
+            Decoder::RegSet use;
+            Decoder::RegSet def;
+            Decoder::regs(inst, use, def);
+            fallthrough = true;
+
+            unsigned size = 0;
+            bool fp = false;
+            bool store = false;
+            switch (inst.opcode) {
+                case RISCV::SB:
+                    store = true;
+                    // fall through
+                case RISCV::LB:
+                case RISCV::LBU:
+                    size = 1;
+                    break;
+
+                case RISCV::SH:
+                    store = true;
+                    // fall through
+                case RISCV::LH:
+                case RISCV::LHU:
+                    size = 2;
+                    break;
+
+                case RISCV::SW:
+                    store = true;
+                    // fall through
+                case RISCV::LW:
+                    size = 4;
+                    break;
+
+                case RISCV::FSW:
+                    store = true;
+                    // fall through
+                case RISCV::FLW:
+                    size = 4;
+                    fp = true;
+                    break;
+
+                case RISCV::FSD:
+                    store = true;
+                    // fall through
+                case RISCV::FLD:
+                    size = 8;
+                    fp = true;
+                    break;
+
+                // SP adjustment
+                case RISCV::ADDI:
+                    if (inst.rd == XRegister::SP && inst.rs1 == XRegister::SP) {
+                        spOffs += inst.imm;
+                        minOffs = std::min(minOffs, spOffs);
+                        use.x &= ~SP;
+                        def.x &= ~SP;
+                    }
+                    break;
+
+                case RISCV::BEQ:
+                case RISCV::BNE:
+                case RISCV::BGE:
+                case RISCV::BGEU:
+                case RISCV::BLT:
+                case RISCV::BLTU:
+                    valid = branch(getTarget(addr, inst.imm));
+                    break;
+
+                case RISCV::JAL:
+                    if (inst.rd == XRegister::ZERO) {
+                        valid = branch(getTarget(addr, inst.imm));
+                        fallthrough = false;
+                    }
+                    break;
+
+                case RISCV::JALR:
+                    if (inst.rd == XRegister::ZERO)
+                        fallthrough = false;
+                    break;
+            }
+
+            // SP used as base address (but not stored)
+            if (size && inst.rs1 == XRegister::SP &&
+                !(store && !fp && inst.rs2 == XRegister::SP))
+            {
+                int64_t offs = spOffs + inst.imm;
+                accesses.push_back({addr, {offs, size, fp}, store,
+                    offs < spOffs});
+                use.x &= ~SP;
+            }
+
+            // any other use of SP may let the frame escape
+            if ((use.x | def.x) & SP) {
+                DBGF("{0}: SP escapes at {1:X+8}", func.name, addr);
+                valid = false;
+            }
+        }
+
+        if (!valid || accesses.empty())
+            continue;
+
+        // group accesses by slot
+        std::map<int64_t, SlotInfo> slots;
+        for (const Access& a : accesses) {
+            auto p = slots.insert({a.slot.offs, SlotInfo()});
+            SlotInfo& si = p.first->second;
+            if (p.second)
+                si.slot = a.slot;
+            else if (si.slot.size != a.slot.size || si.slot.fp != a.slot.fp)
+                si.ok = false;
+            if (a.belowSP)
+                si.ok = false;
+            if (a.store)
+                si.written = true;
+            else
+                si.read = true;
+        }
+
+        // overlapping slots are accessed in different ways
+        // (e.g. a struct accessed by fields and as a whole)
+        std::vector<SlotInfo*> overlap;
+        int64_t overlapEnd = 0;
+        auto endOverlap = [&]() {
+            if (overlap.size() > 1)
+                for (SlotInfo* si : overlap)
+                    si->ok = false;
+            overlap.clear();
+        };
+        for (auto& p : slots) {
+            SlotInfo& si = p.second;
+            if (overlap.empty() || si.slot.offs >= overlapEnd) {
+                endOverlap();
+                overlapEnd = si.slot.offs + si.slot.size;
+            } else
+                overlapEnd = std::max(overlapEnd,
+                    int64_t(si.slot.offs + si.slot.size));
+            overlap.push_back(&si);
+        }
+        endOverlap();
+
+        // Promote slots in this function's frame that are both written
+        // and read by it. Slots that are only written are probably
+        // outgoing arguments, and slots above the CFA are incoming ones,
+        // that are accessed by other functions too.
+        auto promote = [](const SlotInfo& si) {
+            return si.ok && si.read && si.written &&
+                si.slot.offs + int64_t(si.slot.size) <= 0;
+        };
+
+        std::vector<StackSlot> promoted;
+        for (const auto& p : slots)
+            if (promote(p.second))
+                promoted.push_back(p.second.slot);
+        if (promoted.empty())
+            continue;
+
+        for (const Access& a : accesses)
+            if (promote(slots[a.slot.offs]))
+                _stackAccesses.upsert(a.addr, int64_t(a.slot.offs));
+
+        if (_ctx->opts->stats())
+            LOGS << llvm::formatv("{0}: {1} of {2} stack slots promoted\n",
+                func.name, promoted.size(), slots.size());
+        totalFuncs++;
+        totalSlots += promoted.size();
+        _stackSlots.upsert(func.start, std::move(promoted));
+    }
+
+    if (_ctx->opts->stats() && totalSlots)
+        LOGS << llvm::formatv("{0}: {1} stack slots promoted "
+            "in {2} of {3} functions\n",
+            _section->name(), totalSlots, totalFuncs, funcs.size());
+}
+
+
+void SBTSection::analyzeRegs(const std::vector<Func>& funcs)
+{
+    namespace RISCV = llvm::RISCV;
+    using RegSet = Decoder::RegSet;
+    const uint64_t isz = Constants::INSTRUCTION_SIZE;
+    const uint64_t secEnd = _decoded.size() * isz;
+
+    // all registers but x0
+    RegSet all;
+    all.x = ~1u;
+    all.f = ~0u;
+
+    // registers used by calls to external functions (see Caller)
+    RegSet extUse, extDef;
+    extUse.x = 1u << XRegister::SP;
+    for (unsigned r = XRegister::A0; r <= XRegister::A7; r++)
+        extUse.x |= 1u << r;
+    for (unsigned r = FRegister::FA0; r <= FRegister::FA7; r++)
+        extUse.f |= 1u << r;
+    extDef.x = (1u << XRegister::A0) | (1u << XRegister::A1);
+    extDef.f = 1u << FRegister::FA0;
+
+    // registers used by syscalls (see Syscall)
+    RegSet scUse, scDef;
+    scUse.x = 1u << XRegister::A7;
+    for (size_t i = 1; i < Syscall::MAX_ARGS; i++)
+        scUse.x |= 1u << (XRegister::A0 + i - 1);
+    scDef.x = 1u << XRegister::A0;
+
+    // branch, jump and call relocations, by instruction address
+    // (R_RISCV_CALL relocations are on the AUIPC that precedes the JALR)
+    std::map<uint64_t, ConstRelocationPtr> relocs;
+    for (ConstRelocationPtr rel : _section->relocs()) {
+        switch (rel->type()) {
+            case llvm::ELF::R_RISCV_BRANCH:
+            case llvm::ELF::R_RISCV_JAL:
+                relocs[rel->offset()] = rel;
+                break;
+            case llvm::ELF::R_RISCV_CALL:
+            case llvm::ELF::R_RISCV_CALL_PLT:
+                relocs[rel->offset() + isz] = rel;
+                break;
+        }
+    }
+
+    // control transfer performed by an instruction
+    struct Xfer {
+        enum Kind {
+            NONE,       // falls through
+            ECALL,      // syscall
+            BRANCH,     // conditional branch to target
+            JUMP,       // jump to target
+            CALL,       // call to internal function at target
+            EXT_CALL,   // call to external function
+            RET,        // return
+            IJUMP,      // indirect jump
+            UNKNOWN     // indirect call, unknown target or undecoded instr
+        };
+        Kind kind = NONE;
+        uint64_t target = 0;
+        // false on tail calls
+        bool link = false;
+    };
+
+    auto xfer = [&](uint64_t addr, const DecodedInst& di) {
+        Xfer x;
+        if (!di.valid) {
+            x.kind = Xfer::UNKNOWN;
+            return x;
+        }
+        const Decoder::Inst& inst = di.inst;
+
+        switch (inst.opcode) {
+            case RISCV::ECALL:
+                x.kind = Xfer::ECALL;
+                return x;
+
+            case RISCV::BEQ:
+            case RISCV::BNE:
+            case RISCV::BGE:
+            case RISCV::BGEU:
+            case RISCV::BLT:
+            case RISCV::BLTU:
+                x.kind = Xfer::BRANCH;
+                break;
+
+            case RISCV::JAL:
+            case RISCV::JALR:
+                x.link = inst.rd != XRegister::ZERO;
+                x.kind = x.link? Xfer::CALL : Xfer::JUMP;
+                break;
+
+            default:
+                return x;
+        }
+
+        auto it = relocs.find(addr);
+        if (it != relocs.end()) {
+            ConstRelocationPtr rel = it->second;
+            if (rel->isExternal() && x.kind != Xfer::BRANCH)
+                x.kind = Xfer::EXT_CALL;
+            else if (rel->isExternal() || !rel->isLocalFunction())
+                x.kind = Xfer::UNKNOWN;
+            // same as SBTRelocation::handleRelocation()
+            else {
+                x.target = rel->hasSym()? rel->symAddr() : rel->addend();
+                // jalr with a call relocation
+                if (inst.opcode == RISCV::JALR)
+                    x.kind = Xfer::CALL;
+            }
+        } else if (inst.opcode != RISCV::JALR)
+            x.target = addr + inst.imm;
+        // indirect call
+        else if (x.link)
+            x.kind = Xfer::UNKNOWN;
+        // return (same as Instruction::translateBranch())
+        else if (inst.rs1 == XRegister::RA && inst.imm == 0)
+            x.kind = Xfer::RET;
+        else
+            x.kind = Xfer::IJUMP;
+        return x;
+    };
+
+    // index of the function that contains addr
+    const size_t NONE = ~size_t(0);
+    auto funcAt = [&](uint64_t addr) {
+        auto it = std::upper_bound(funcs.begin(), funcs.end(), addr,
+            [](uint64_t addr, const Func& f) { return addr < f.start; });
+        if (it == funcs.begin())
+            return NONE;
+        --it;
+        return addr < it->end? size_t(it - funcs.begin()) : NONE;
+    };
+
+    // local register usage and call graph
+    struct Node {
+        RegUsage ru;
+        std::vector<size_t> callees;
+    };
+    std::vector<Node> nodes(funcs.size());
+
+    for (size_t i = 0; i < funcs.size(); i++) {
+        const Func& func = funcs[i];
+        Node& n = nodes[i];
+        uint64_t end = MIN(func.end, secEnd);
+
+        auto unknown = [&n, &all]() {
+            n.ru.use |= all;
+            n.ru.def |= all;
+        };
+
+        for (uint64_t addr = func.start; addr < end; addr += isz) {
+            const DecodedInst& di = _decoded[addr / isz];
+            if (di.valid)
+                Decoder::regs(di.inst, n.ru.use, n.ru.def);
+
+            Xfer x = xfer(addr, di);
+            switch (x.kind) {
+                // not decoded or indirect call:
+                // assume it may use any register
+                case Xfer::UNKNOWN:
+                    unknown();
+                    continue;
+
+                case Xfer::ECALL:
+                    n.ru.use |= scUse;
+                    n.ru.def |= scDef;
+                    continue;
+
+                case Xfer::EXT_CALL:
+                    n.ru.use |= extUse;
+                    n.ru.def |= extDef;
+                    continue;
+
+                case Xfer::CALL:
+                    break;
+
+                // jump inside this function
+                case Xfer::JUMP:
+                    if (x.target >= func.start && x.target < func.end)
+                        continue;
+                    break;
+
+                default:
+                    continue;
+            }
+
+            size_t callee = funcAt(x.target);
+            if (callee == NONE)
+                unknown();
+            else if (callee != i)
+                n.callees.push_back(callee);
+        }
+    }
+
+    // add callees' registers, until a fixed point is reached
+    bool changed;
+    do {
+        changed = false;
+        for (Node& n : nodes) {
+            for (size_t c : n.callees) {
+                RegUsage ru = n.ru;
+                ru.use |= nodes[c].ru.use;
+                ru.def |= nodes[c].ru.def;
+                if (ru.use != n.ru.use || ru.def != n.ru.def) {
+                    n.ru = ru;
+                    changed = true;
+                }
+            }
+        }
+    } while (changed);
+
+    // find function signatures
+    if (_ctx->opts->funcSigs()) {
+        RegSet argRegs, retRegs;
+        for (unsigned r = XRegister::A0; r <= XRegister::A7; r++)
+            argRegs.x |= 1u << r;
+        for (unsigned r = FRegister::FA0; r <= FRegister::FA7; r++)
+            argRegs.f |= 1u << r;
+        retRegs.x = (1u << XRegister::A0) | (1u << XRegister::A1);
+        retRegs.f = (1u << FRegister::FA0) | (1u << FRegister::FA1);
+
+        // Return registers that may be written are returned by value.
+        // Callers always get them from the return value, even if the
+        // callee doesn't write them in every path, so they are also
+        // read when the function returns.
+        // (main keeps its C signature)
+        for (size_t i = 0; i < funcs.size(); i++) {
+            RegUsage& ru = nodes[i].ru;
+            if (funcs[i].name != "main") {
+                ru.rets = ru.def;
+                ru.rets &= retRegs;
+            }
+        }
+
+        // registers live at function entry
+        std::vector<RegSet> entryLive(funcs.size());
+        // registers live before each instruction of current function
+        std::vector<RegSet> live;
+
+        // compute liveness of function i, by iterating over its
+        // instructions backwards until a fixed point is reached
+        auto liveness = [&](size_t i) {
+            const Func& func = funcs[i];
+            uint64_t end = MIN(func.end, secEnd);
+            if (func.start >= end)
+                return nodes[i].ru.rets;
+            size_t n = (end - func.start) / isz;
+            const RegSet& exitLive = nodes[i].ru.rets;
+            live.assign(n, RegSet());
+
+            auto inFunc = [&](uint64_t addr) {
+                return addr >= func.start && addr < end &&
+                    (addr - func.start) % isz == 0;
+            };
+            // falling through the end of the function returns
+            auto liveAt = [&](uint64_t addr) {
+                return addr < end? live[(addr - func.start) / isz] : exitLive;
+            };
+
+            bool changed;
+            do {
+                changed = false;
+                for (size_t k = n; k-- > 0; ) {
+                    uint64_t addr = func.start + k * isz;
+                    const DecodedInst& di = _decoded[addr / isz];
+                    RegSet use, def;
+                    if (di.valid)
+                        Decoder::regs(di.inst, use, def);
+
+                    // live after instruction
+                    RegSet out;
+                    Xfer x = xfer(addr, di);
+                    switch (x.kind) {
+                        case Xfer::NONE:
+                            out = liveAt(addr + isz);
+                            break;
+
+                        case Xfer::ECALL:
+                            out = liveAt(addr + isz);
+                            use |= scUse;
+                            break;
+
+                        case Xfer::BRANCH:
+                            if (!inFunc(x.target)) {
+                                out = all;
+                                break;
+                            }
+                            out = liveAt(addr + isz);
+                            out |= liveAt(x.target);
+                            break;
+
+                        case Xfer::JUMP:
+                            out = inFunc(x.target)? liveAt(x.target) : all;
+                            break;
+
+                        case Xfer::CALL: {
+                            size_t c = funcAt(x.target);
+                            if (c == NONE) {
+                                out = all;
+                                break;
+                            }
+                            out = x.link? liveAt(addr + isz) : exitLive;
+                            out &= ~nodes[c].ru.rets;
+                            out |= entryLive[c];
+                            break;
+                        }
+
+                        case Xfer::EXT_CALL:
+                            out = x.link? liveAt(addr + isz) : exitLive;
+                            out |= extUse;
+                            break;
+
+                        case Xfer::RET:
+                            out = exitLive;
+                            break;
+
+                        case Xfer::IJUMP:
+                        case Xfer::UNKNOWN:
+                            out = all;
+                            break;
+                    }
+
+                    // live before instruction
+                    out &= ~def;
+                    out |= use;
+                    if (out != live[k]) {
+                        live[k] = out;
+                        changed = true;
+                    }
+                }
+            } while (changed);
+            return live[0];
+        };
+
+        // repeat until callees' entry liveness stops changing
+        do {
+            changed = false;
+            for (size_t i = 0; i < funcs.size(); i++) {
+                RegSet in = liveness(i);
+                if (in != entryLive[i]) {
+                    entryLive[i] = in;
+                    changed = true;
+                }
+            }
+        } while (changed);
+
+        for (size_t i = 0; i < funcs.size(); i++) {
+            RegUsage& ru = nodes[i].ru;
+            if (funcs[i].name != "main") {
+                ru.args = entryLive[i];
+                ru.args &= argRegs;
+            }
+        }
+    }
+
+    // save results
+    // (FNV-1a hash)
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    auto mix = [&hash](uint64_t v) {
+        hash ^= v;
+        hash *= 0x100000001B3ULL;
+    };
+    auto mixRegs = [&mix](const RegSet& regs) {
+        mix(regs.x | uint64_t(regs.f) << 32);
+    };
+    for (size_t i = 0; i < funcs.size(); i++) {
+        const RegUsage& ru = nodes[i].ru;
+        DBGF("{0}: use=[{1:X-8}, {2:X-8}], def=[{3:X-8}, {4:X-8}], "
+            "args=[{5:X-8}, {6:X-8}], rets=[{7:X-8}, {8:X-8}]",
+            funcs[i].name, ru.use.x, ru.use.f, ru.def.x, ru.def.f,
+            ru.args.x, ru.args.f, ru.rets.x, ru.rets.f);
+
+        _regUsage.upsert(funcs[i].start, RegUsage(ru));
+        mix(funcs[i].start);
+        mixRegs(ru.use);
+        mixRegs(ru.def);
+        mixRegs(ru.args);
+        mixRegs(ru.rets);
+    }
+    _regUsageHash = hash;
+}
+
+
 llvm::Error SBTSection::translate(const Func& func)
 {
-    Function* f = new Function(_ctx, func.name, this, func.start, func.end);
-    FunctionPtr fp(f);
-    _ctx->addFunc(std::move(fp));
-    return translate(f);
+    // registered by translate(), before any function was translated
+    // (calls to it may have already been resolved)
+    Function** fp = (*_ctx->_funcByAddr)[func.start];
+    if (!fp || (*fp)->name() != func.name)
+        return ERRORF("function {0} at {1:X+8} was not registered",
+            func.name, func.start);
+    Function* f = *fp;
+
+    // functions in a region depend on each other,
+    // so they can't be cached individually
+    TranslationCache* cache = _ctx->cache;
+    if (!cache || _region)
+        return translate(f);
+
+    // reuse previous translation, if possible
+    std::string key = cache->key(this, func.name, func.start, func.end);
+    auto expHit = cache->load(key, f, func.start, func.end);
+    if (!expHit)
+        return expHit.takeError();
+    if (expHit.get())
+        return llvm::Error::success();
+
+    cache->beginRecord();
+    if (auto err = translate(f))
+        return err;
+    return cache->endRecord(key, f);
 }
 
 
@@ -2,20 +2,59 @@
 #define SBT_SECTION_H
 
 #include "Context.h"
+#include "Decoder.h"
+#include "Map.h"
 #include "Object.h"
+#include "Region.h"
+
+#include <llvm/MC/MCInst.h>
+
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
 
 namespace sbt {
 
 class SBTSection
 {
 public:
+    // registers read and written by a function, including its callees
+    struct RegUsage {
+        Decoder::RegSet use;
+        Decoder::RegSet def;
+        // signature (-func-sigs only):
+        // argument registers, that the function may read before writing
+        Decoder::RegSet args;
+        // return registers, that the function may write
+        Decoder::RegSet rets;
+    };
+
+    // jump table, used by an indirect jump
+    struct JumpTable {
+        // address of the load that reads the jump target from the table
+        uint64_t load;
+        // table address: section name and offset
+        std::string sec;
+        uint64_t offs;
+        // jump targets, by table index
+        std::vector<uint64_t> targets;
+    };
+
     SBTSection(
         Context* ctx,
         ConstSectionPtr sec)
         :
         _ctx(ctx),
-        _section(sec)
-    {}
+        _section(sec),
+        _regsMode(ctx->opts->regs())
+    {
+        // set by translate(), if the section can be translated
+        // as a single region
+        if (_regsMode == Options::Regs::ONEREGION)
+            _regsMode = Options::Regs::LOCALS;
+    }
 
     llvm::Error translate();
 
@@ -38,10 +77,144 @@ public:
 
     llvm::Error translate(Function* func);
 
+    /**
+     * Get pre-decoded instruction.
+     *
+     * @param addr instruction address
+     * @param inst [output] decoded instruction
+     *
+     * @return false if the instruction at addr was not decoded by the
+     *         native decoder (in this case, the Disassembler must be used).
+     */
+    bool decodedInst(uint64_t addr, Decoder::Inst& inst) const
+    {
+        size_t i = addr / Constants::INSTRUCTION_SIZE;
+        if (i >= _decoded.size() || !_decoded[i].valid)
+            return false;
+        inst = _decoded[i].inst;
+        return true;
+    }
+
+    /**
+     * Check if a basic block starts at the given address,
+     * according to the CFG discovery pass.
+     *
+     * Note that function start addresses are not marked as BB leaders.
+     */
+    bool isBBLeader(uint64_t addr) const
+    {
+        size_t i = addr / Constants::INSTRUCTION_SIZE;
+        return i < _decoded.size() && _decoded[i].leader;
+    }
+
+    /**
+     * Get register usage of the function that starts at the given address,
+     * computed by the register usage analysis
+     * (-regs=live or -func-sigs only).
+     *
+     * @return null if unknown
+     */
+    const RegUsage* regUsage(uint64_t addr) const
+    {
+        return _regUsage[addr];
+    }
+
+    // hash of all register usage info, for the translation cache
+    uint64_t regUsageHash() const
+    {
+        return _regUsageHash;
+    }
+
+    /**
+     * Get the jump table used by the indirect jump at the given address.
+     *
+     * @return null if unknown
+     */
+    const JumpTable* jumpTable(uint64_t addr) const
+    {
+        return _jumpTables[addr];
+    }
+
+    // does the load at the given address read a jump table entry?
+    bool isJumpTableLoad(uint64_t addr) const
+    {
+        return _jumpTableLoads.count(addr);
+    }
+
+    // possible targets of an indirect call (or jump)
+    struct ICallTargets {
+        std::vector<uint64_t> targets;
+        // the target is known for sure
+        // (in this case, there is a single target)
+        bool exact = false;
+    };
+
+    /**
+     * Get the possible targets of the indirect call at the given address.
+     *
+     * @return null if unknown
+     */
+    const ICallTargets* icallTargets(uint64_t addr) const
+    {
+        return _icallTargets[addr];
+    }
+
+    // guest stack slot, that can be replaced by a host one (-opt-stack)
+    struct StackSlot {
+        // offset from the CFA (the value of SP at function entry)
+        int64_t offs;
+        // size, in bytes
+        unsigned size;
+        // accessed by floating point loads/stores
+        bool fp;
+    };
+
+    /**
+     * Get the promotable stack slots of the function that starts at the
+     * given address.
+     *
+     * @return null if none
+     */
+    const std::vector<StackSlot>* stackSlots(uint64_t addr) const
+    {
+        return _stackSlots[addr];
+    }
+
+    /**
+     * Get the CFA offset of the promotable stack slot accessed by the
+     * load/store at the given address.
+     *
+     * @return null if the load/store doesn't access such a slot
+     */
+    const int64_t* stackAccess(uint64_t addr) const
+    {
+        return _stackAccesses[addr];
+    }
+
+    /**
+     * Get the register translation mode of the functions in this section.
+     *
+     * This is the same as in Options, except for -regs=oneregion,
+     * that falls back to locals in sections that can't be translated as
+     * a single region.
+     */
+    Options::Regs regsMode() const
+    {
+        return _regsMode;
+    }
+
+    // region (-regs=oneregion only, null otherwise)
+    Region* region() const
+    {
+        return _region.get();
+    }
+
 private:
     Context* _ctx;
     ConstSectionPtr _section;
     uint64_t _nextFuncAddr = 0;
+    Options::Regs _regsMode;
+    std::unique_ptr<Region> _region;
 
     llvm::ArrayRef<uint8_t> _bytes;
 
@@ -51,6 +224,94 @@ private:
         uint64_t end;
     };
 
+    // pre-decoded instructions, indexed by address / INSTRUCTION_SIZE
+    struct DecodedInst {
+        Decoder::Inst inst;
+        bool valid = false;
+        // does a BB start here?
+        bool leader = false;
+    };
+    std::vector<DecodedInst> _decoded;
+
+    // register usage, by function address
+    Map<uint64_t, RegUsage> _regUsage;
+    uint64_t _regUsageHash = 0;
+
+    // jump tables, by indirect jump address
+    Map<uint64_t, JumpTable> _jumpTables;
+    std::set<uint64_t> _jumpTableLoads;
+    // indirect call targets, by call address
+    Map<uint64_t, ICallTargets> _icallTargets;
+    // promotable stack slots, by function address
+    Map<uint64_t, std::vector<StackSlot>> _stackSlots;
+    // CFA offsets of the slots accessed by loads/stores, by their address
+    Map<uint64_t, int64_t> _stackAccesses;
+
+    // find function boundaries, using symbol info
+    std::vector<Func> getFuncs() const;
+    // decode all functions in parallel
+    // (with -check-decoder, fail if the native decoder and the MC
+    // disassembler disagree)
+    llvm::Error decode(const std::vector<Func>& funcs);
+    // compare native and MC decoders' speed
+    void benchDecoder() const;
+    // find BB leaders and functions introduced by calls
+    void discover(std::vector<Func>& funcs);
+    // find the jump tables used by indirect jumps
+    void findJumpTables(const std::vector<Func>& funcs);
+    // find the functions that each indirect call may reach,
+    // by following the relocations that give their addresses
+    void resolveICalls(const std::vector<Func>& funcs);
+    // check if all functions can be translated as a single region
+    bool canUseRegion(const std::vector<Func>& funcs) const;
+    // find the stack slots of each function that never escape,
+    // and can thus be kept in host memory
+    void findStackSlots(const std::vector<Func>& funcs);
+
+    // helpers for the passes above
+
+    // branch/jump targets given by relocations, by branch address
+    // (in relocatable objects, the encoded offsets are usually zero)
+    // (Constants::INVALID_ADDR if not a local function)
+    std::map<uint64_t, uint64_t> branchRelocs() const;
+    // %lo() relocations, by address
+    std::map<uint64_t, ConstRelocationPtr> lo12Relocs() const;
+    // find the last instruction before addr, in the same BB,
+    // that writes to the given register
+    // (returns INVALID_ADDR if not found)
+    uint64_t lastDef(const Func& func, uint64_t addr, unsigned reg) const;
+    // check if the base register of the %lo() instruction at loAddr was
+    // set, in the same BB, by the matching lui %hi()/auipc %pcrel_hi()
+    bool hiLoPair(
+        const Func& func,
+        uint64_t loAddr,
+        ConstRelocationPtr lo) const;
+    // opcode of a pre-decoded instruction (0 if invalid)
+    unsigned opcode(uint64_t addr) const;
+    // if the given load reads an entry of a table, that is indexed as
+    // table + idx, return the %lo(table) relocation
+    ConstRelocationPtr tableLoad(
+        const Func& func,
+        uint64_t ldAddr,
+        const std::map<uint64_t, ConstRelocationPtr>& lo12) const;
+    // number of entries of the table read by the given load, given by the
+    // bounds check on its index (0 if not found)
+    uint64_t tableSize(
+        const Func& func,
+        uint64_t ldAddr,
+        const std::map<uint64_t, uint64_t>& relTargets) const;
+    // get the code pointers of a table in data, given by a %lo() relocation
+    // plus offset
+    bool tableEntries(
+        ConstRelocationPtr rel,
+        int64_t offs,
+        std::string& sec,
+        uint64_t& tableOffs,
+        std::vector<uint64_t>& entries) const;
+    // find the registers used by each function and its callees,
+    // and the signature of each function
+    void analyzeRegs(const std::vector<Func>& funcs);
+
     llvm::Error translate(const Func& func);
 };
 
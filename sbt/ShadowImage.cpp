@@ -6,6 +6,9 @@
 #include "Object.h"
 #include "Relocation.h"
 #include "SBTError.h"
+#include "TranslationCache.h"
+
+#include <llvm/Support/FormatVariadic.h>
 
 #include <algorithm>
 #include <vector>
@@ -26,7 +29,6 @@ void ShadowImage::build()
         ConstSectionPtr sec;
         std::vector<uint8_t> vec;
         const ConstRelocationPtrVec& relocs;
-        llvm::GlobalVariable* gv = nullptr;
 
         Work(ConstSectionPtr sec, std::vector<uint8_t>&& vec,
             const ConstRelocationPtrVec& relocs)
@@ -50,24 +52,29 @@ void ShadowImage::build()
         return llvm::ConstantExpr::getPointerCast(gv, _ctx->t.i32);
     };
 
+    std::map<std::string, std::set<uint64_t>> splits;
+    if (_ctx->opts->splitData())
+        splits = splitPoints();
+
     for (ConstSectionPtr sec : _obj->sections()) {
         // skip non text/data sections
         if (!sec->isText() && !sec->isData() && !sec->isBSS() && !sec->isCommon())
             continue;
 
         llvm::StringRef bytes;
-        std::string z;
+        uint64_t size;
         uint64_t align;
+        bool zero = sec->isBSS() || sec->isCommon();
         // .bss/.common
-        if (sec->isBSS() || sec->isCommon()) {
-            z = std::string(sec->size(), 0);
-            bytes = z;
+        if (zero) {
+            size = sec->size();
             align = 8;
         // others
         } else {
             // read contents
             if (sec->contents(bytes))
                 XABORTF("failed to get section [{0}] contents", sec->name());
+            size = bytes.size();
             align = sec->section().getAlignment();
         }
 
@@ -75,40 +82,72 @@ void ShadowImage::build()
         while (addr % align != 0)
             addr++;
         DBGF("{0}@{1:X+8}-{2:X+8}, align={3}",
-                sec->name(), addr, addr + bytes.size(), align);
-        addr += bytes.size();
+                sec->name(), addr, addr + size, align);
+        addr += size;
 
         const ConstRelocationPtrVec& relocs = sec->relocs();
-        std::vector<uint8_t> vec(bytes.size());
-        std::copy(bytes.begin(), bytes.end(), vec.begin());
-        llvm::Constant* cda;
-        llvm::Type* aty;
-        llvm::GlobalVariable* gv;
-        Work* work = nullptr;
-
+        // read-only data: let LLVM fold loads from it
+        bool constant = !sec->isText() && sec->isReadOnly();
         // check if section needs to be relocated
         // Note: text sections are relocated during translation
-        if (!relocs.empty() && !sec->isText()) {
-            xassert(vec.size() % sizeof(uint32_t) == 0);
-            uint64_t elems = vec.size() / sizeof(uint32_t);
-            cda = nullptr;
-            aty = llvm::ArrayType::get(_ctx->t.i32, elems);
-            workVec.push_back(Work(sec, std::move(vec), relocs));
-            work = &workVec.back();
-        } else {
-            cda = llvm::ConstantDataArray::get(*_ctx->ctx, vec);
-            aty = cda->getType();
+        bool reloc = !zero && !relocs.empty() && !sec->isText();
+        if (reloc) {
+            xassert(size % sizeof(uint32_t) == 0);
+            workVec.push_back(Work(sec,
+                std::vector<uint8_t>(bytes.begin(), bytes.end()), relocs));
         }
 
-        // create the ShadowImage
-        gv = new llvm::GlobalVariable(
-            *_ctx->module, aty, !CONSTANT,
-            llvm::GlobalValue::ExternalLinkage, cda,
-            gvname(sec->name()));
-        gv->setAlignment(align);
-        if (work)
-            work->gv = gv;
-        _sections[sec->name()] = toI32(gv);
+        // get pieces' bounds
+        std::set<uint64_t> bounds = { 0, size };
+        auto sit = splits.find(sec->name());
+        if (sit != splits.end())
+            bounds.insert(sit->second.begin(), sit->second.end());
+
+        std::vector<Piece>& pieces = _sections[sec->name()];
+        for (auto it = bounds.begin(); std::next(it) != bounds.end(); ++it) {
+            uint64_t start = *it;
+            uint64_t end = *std::next(it);
+            uint64_t len = end - start;
+            llvm::Constant* cda;
+            llvm::Type* aty;
+
+            // .bss/.common: zeroinitializer, to place it in host's .bss
+            // (instead of a byte array, that would bloat the IR and binary)
+            if (zero) {
+                aty = llvm::ArrayType::get(_ctx->t.i8, len);
+                cda = llvm::ConstantAggregateZero::get(aty);
+            // set by relocation, below
+            } else if (reloc) {
+                aty = llvm::ArrayType::get(_ctx->t.i32, len / sizeof(uint32_t));
+                cda = nullptr;
+            } else {
+                llvm::ArrayRef<uint8_t> vec(bytes.bytes_begin() + start, len);
+                cda = llvm::ConstantDataArray::get(*_ctx->ctx, vec);
+                aty = cda->getType();
+            }
+
+            // create the ShadowImage
+            std::string name = sec->name();
+            if (bounds.size() > 2) {
+                std::string sym;
+                for (ConstSymbolPtr s : sec->lookup(start))
+                    if (s->size()) {
+                        sym = s->name().str();
+                        break;
+                    }
+                if (sym.empty())
+                    sym = llvm::formatv("{0:X-}", start).str();
+                name += "." + sym;
+            }
+            auto* gv = new llvm::GlobalVariable(
+                *_ctx->module, aty, constant,
+                llvm::GlobalValue::ExternalLinkage, cda,
+                gvname(name));
+            // keep guest alignment
+            gv->setAlignment(start? MIN(align, start & -start) : align);
+            pieces.push_back(Piece{start, end, gv, toI32(gv)});
+            _gvs.insert(gv);
+        }
     }
 
     // now process sections that need relocation,
@@ -117,10 +156,127 @@ void ShadowImage::build()
         // relocate
         SBTRelocation reloc(_ctx,
             work.relocs.begin(), work.relocs.end(), work.sec);
-        llvm::GlobalVariable* gv = work.gv;
         llvm::Constant* c = reloc.relocateSection(work.vec, this);
-        gv->setInitializer(c);
+
+        for (const Piece& p : _sections[work.sec->name()]) {
+            std::vector<llvm::Constant*> cvec;
+            for (uint64_t i = p.start; i < p.end; i += sizeof(uint32_t))
+                cvec.push_back(c->getAggregateElement(i / sizeof(uint32_t)));
+            auto* aty = llvm::cast<llvm::ArrayType>(p.gv->getValueType());
+            p.gv->setInitializer(llvm::ConstantArray::get(aty, cvec));
+        }
+    }
+}
+
+
+std::map<std::string, std::set<uint64_t>> ShadowImage::splitPoints() const
+{
+    std::map<std::string, std::set<uint64_t>> splits;
+
+    // split data sections at their sized symbols' bounds
+    for (ConstSectionPtr sec : _obj->sections()) {
+        if (sec->isText() || (!sec->isData() && !sec->isBSS()))
+            continue;
+
+        std::set<uint64_t> points;
+        // end of last symbol
+        uint64_t end = 0;
+        bool ok = true;
+        for (ConstSymbolPtr sym : sec->symbols()) {
+            uint64_t start = sym->address();
+            uint64_t size = sym->size();
+            if (!size)
+                continue;
+            // aliases are fine, but overlapping symbols are not
+            if (points.count(start) && end == start + size)
+                continue;
+            if (start < end || start + size > sec->size()) {
+                ok = false;
+                break;
+            }
+            points.insert(start);
+            points.insert(start + size);
+            end = start + size;
+        }
+
+        // relocated sections are arrays of words
+        if (ok && !sec->isBSS() && !sec->relocs().empty()) {
+            for (uint64_t p : points)
+                if (p % sizeof(uint32_t) != 0) {
+                    ok = false;
+                    break;
+                }
+        }
+
+        if (ok && !points.empty())
+            splits[sec->name()] = std::move(points);
+    }
+
+    // every reference must be to one of the symbols, and stay inside it
+    for (ConstSectionPtr s : _obj->sections()) {
+        for (ConstRelocationPtr reloc : s->relocs()) {
+            if (!reloc->hasSec())
+                continue;
+            auto it = splits.find(reloc->secName());
+            if (it == splits.end())
+                continue;
+
+            ConstSymbolPtr sym = reloc->symbol();
+            int64_t addend = reloc->addend();
+            if (!sym || !sym->size() || !it->second.count(sym->address()) ||
+                addend < 0 || uint64_t(addend) > sym->size())
+            {
+                DBGF("not splitting {0}: {1}", it->first, reloc->str());
+                splits.erase(it);
+            }
+        }
     }
+
+    for (const auto& p : splits)
+        DBGF("splitting {0} in {1} piece(s)", p.first, p.second.size() + 1);
+    return splits;
+}
+
+
+const ShadowImage::Piece& ShadowImage::piece(
+    const std::string& sec,
+    uint64_t addr,
+    ConstSymbolPtr sym) const
+{
+    auto it = _sections.find(sec);
+    xassert(it != _sections.end() && "Section not found in ShadowImage!");
+    const std::vector<Piece>& pieces = it->second;
+    if (pieces.size() == 1)
+        return pieces.front();
+
+    // relative to a symbol: use its piece, even if addr is at its end
+    uint64_t key = sym? sym->address() : addr;
+    auto pit = std::upper_bound(pieces.begin(), pieces.end(), key,
+        [](uint64_t a, const Piece& p) { return a < p.start; });
+    xassert(pit != pieces.begin());
+    return *--pit;
+}
+
+
+llvm::Constant* ShadowImage::getAddr(
+    const std::string& sec,
+    uint64_t addr,
+    ConstSymbolPtr sym) const
+{
+    const Piece& p = piece(sec, addr, sym);
+    return llvm::ConstantExpr::getAdd(p.addr, _ctx->c.u32(addr - p.start));
+}
+
+
+llvm::Constant* ShadowImage::getPtr(
+    const std::string& sec,
+    uint64_t addr,
+    ConstSymbolPtr sym) const
+{
+    const Piece& p = piece(sec, addr, sym);
+    llvm::Constant* c = llvm::ConstantExpr::getPointerCast(p.gv, _ctx->t.i8ptr);
+    return llvm::ConstantExpr::getGetElementPtr(_ctx->t.i8, c,
+        _ctx->c.i32(addr - p.start));
 }
 
 void ShadowImage::addPending(PendingReloc&& prel)
@@ -139,6 +295,13 @@ void ShadowImage::addPending(PendingReloc&& prel)
 }
 
 
+bool ShadowImage::hasPendingRelocs(uint64_t begin, uint64_t end) const
+{
+    auto it = _pendingRelocs.lower_bound(begin);
+    return it != _pendingRelocs.end() && it->first < end;
+}
+
+
 BasicBlock* ShadowImage::processPending(
     uint64_t addr,
     BasicBlock* bb)
@@ -148,6 +311,10 @@ BasicBlock* ShadowImage::processPending(
         return bb;
     PendingReloc prel = pit->second;
 
+    // patching the shadow image is a side effect that can't be cached
+    if (_ctx->cache)
+        _ctx->cache->noStore();
+
     BasicBlock* nbb;
     if (bb->addr() != addr) {
         DBGF("spliting BB@{0:X+8}", addr);
@@ -161,19 +328,40 @@ BasicBlock* ShadowImage::processPending(
     llvm::Constant* bai = llvm::ConstantExpr::getPointerCast(ba, _ctx->t.i32);
 
     for (const auto& sec : prel.secs) {
-        llvm::Constant* c = getSection(sec.name);
-        xassert(c->getNumOperands() == 1);
-        llvm::Value* v = c->getOperand(0);
-        auto* gv = llvm::cast<llvm::GlobalVariable>(v);
-        llvm::Constant* init = gv->getInitializer();
-        xassert(init);
-        auto* aty = llvm::cast<llvm::ArrayType>(init->getType());
-        xassert(aty->getElementType() == _ctx->t.i32);
         unsigned op = sec.offs / 4;
         xassert(sec.offs % 4 == 0);
-        xassert(op < aty->getNumElements());
         DBGF("section={0}, offs={1:X+8}, op={2}, sym={3}",
             sec.name, sec.offs, op, prel.sym.name);
+        _patches[sec.name].push_back(Patch{op, bai});
+    }
+    _pendingRelocs.erase(pit);
+
+    _ctx->func->addIndBB(nbb);
+    return nbb;
+}
+
+
+void ShadowImage::finish()
+{
+    // get the global of each patch
+    std::map<llvm::GlobalVariable*, std::vector<Patch>> gvPatches;
+    for (const auto& p : _patches) {
+        for (const Patch& patch : p.second) {
+            const Piece& pc = piece(p.first, patch.op * sizeof(uint32_t));
+            unsigned op = patch.op - pc.start / sizeof(uint32_t);
+            gvPatches[pc.gv].push_back(Patch{op, patch.val});
+        }
+    }
+
+    for (const auto& p : gvPatches) {
+        llvm::GlobalVariable* gv = p.first;
+        const std::vector<Patch>& patches = p.second;
+
+        llvm::Constant* init = gv->getInitializer();
+        xassert(init);
+        auto* aty = llvm::cast<llvm::ArrayType>(init->getType());
+        xassert(aty->getElementType() == _ctx->t.i32);
+        DBGF("global={0}, patches={1}", gv->getName(), patches.size());
 
         std::vector<llvm::Constant*> cvec;
         cvec.reserve(aty->getNumElements());
@@ -185,13 +373,14 @@ BasicBlock* ShadowImage::processPending(
                 cvec.push_back(cda->getElementAsConstant(i));
         else
             xunreachable("Unknown constant array type!");
-        cvec[op] = bai;
+
+        for (const Patch& patch : patches) {
+            xassert(patch.op < cvec.size());
+            cvec[patch.op] = patch.val;
+        }
         gv->setInitializer(llvm::ConstantArray::get(aty, cvec));
     }
-    _pendingRelocs.erase(pit);
-
-    _ctx->func->addIndBB(nbb);
-    return nbb;
+    _patches.clear();
 }
 
 
@@ -2,13 +2,15 @@
 #define SBT_SHADOWIMAGE_H
 
 #include "Context.h"
+#include "Object.h"
 
 #include <map>
-#include <unordered_map>
+#include <set>
 #include <vector>
 
 namespace llvm {
 class Constant;
+class GlobalVariable;
 }
 
 namespace sbt {
@@ -40,35 +42,98 @@ struct PendingReloc {
         secs({ Section{secName, secOffs} })
     {}
 };
-using PendingRelocsMap = std::unordered_map<uint64_t, PendingReloc>;
+// (ordered by address, to make range queries cheap)
+using PendingRelocsMap = std::map<uint64_t, PendingReloc>;
 using PendingRelocsIter = PendingRelocsMap::iterator;
 
 
+/**
+ * Guest sections' contents, as LLVM globals.
+ *
+ * Read-only data sections are constant, to let LLVM fold loads from them.
+ * With -split-data, data sections are also split at symbol boundaries,
+ * into one global per symbol, so that unused or never written ones may be
+ * optimized individually. This is done only when all references to the
+ * section are through its symbols, with offsets that stay inside them,
+ * as it changes the relative position of guest objects.
+ */
 class ShadowImage
 {
 public:
     ShadowImage(Context* ctx, const Object* obj);
 
-    llvm::Constant* getSection(const std::string& name) const {
-        auto it = _sections.find(name);
-        xassert(it != _sections.end() && "Section not found in ShadowImage!");
-        return it->second;
-    }
+    /**
+     * Get the host address of a guest address.
+     *
+     * @param sec section name
+     * @param addr address in section
+     * @param sym symbol that addr is relative to (if any)
+     * @return host address (i32)
+     */
+    llvm::Constant* getAddr(
+        const std::string& sec,
+        uint64_t addr,
+        ConstSymbolPtr sym = nullptr) const;
+
+    // same as above, but as an i8 pointer into the section's global
+    llvm::Constant* getPtr(
+        const std::string& sec,
+        uint64_t addr,
+        ConstSymbolPtr sym = nullptr) const;
 
     BasicBlock* processPending(uint64_t addr, BasicBlock* bb);
     void addPending(PendingReloc&& prel);
 
+    // is gv one of the sections' globals?
+    bool isShadow(const llvm::GlobalVariable* gv) const
+    {
+        return _gvs.count(gv);
+    }
+
+    // apply all patches made by processPending() to the sections
+    void finish();
+
     bool noPendingRelocs() const {
         return _pendingRelocs.empty();
     }
 
+    // are there pending relocations to addresses in [begin, end)?
+    bool hasPendingRelocs(uint64_t begin, uint64_t end) const;
+
 private:
+    // part of a section, with its own global
+    // (sections that are not split have a single piece)
+    struct Piece {
+        uint64_t start;
+        uint64_t end;
+        llvm::GlobalVariable* gv;
+        // host address (i32)
+        llvm::Constant* addr;
+    };
+
     Context* _ctx;
     const Object* _obj;
-    std::map<std::string, llvm::Constant*> _sections;
+    // pieces of each section, ordered by address
+    std::map<std::string, std::vector<Piece>> _sections;
+    std::set<const llvm::GlobalVariable*> _gvs;
     PendingRelocsMap _pendingRelocs;
 
+    // resolved pending relocations, by section
+    // (rebuilding the section initializer on each one would be quadratic)
+    struct Patch {
+        unsigned op;
+        llvm::Constant* val;
+    };
+    std::map<std::string, std::vector<Patch>> _patches;
+
     void build();
+    // get the sections that can be split, with their split points
+    std::map<std::string, std::set<uint64_t>> splitPoints() const;
+    // get the piece that holds addr
+    const Piece& piece(
+        const std::string& sec,
+        uint64_t addr,
+        ConstSymbolPtr sym = nullptr) const;
 };
 
 }
@@ -4,26 +4,22 @@
 #include "Context.h"
 
 #include <llvm/IR/Constants.h>
+#include <llvm/IR/DerivedTypes.h>
 #include <llvm/IR/GlobalVariable.h>
 
-#include <string>
-
 namespace sbt {
 
 Stack::Stack(Context* ctx, size_t sz)
     :
     _size(sz)
 {
-    std::string bytes(_size, 'S');
-
-    llvm::ArrayRef<uint8_t> byteArray(
-        reinterpret_cast<const uint8_t*>(bytes.data()), _size);
-
-    llvm::Constant* cda = llvm::ConstantDataArray::get(*ctx->ctx, byteArray);
+    // zeroinitializer, to place the stack in host's .bss
+    llvm::ArrayType* aty = llvm::ArrayType::get(ctx->t.i8, _size);
+    llvm::Constant* zero = llvm::ConstantAggregateZero::get(aty);
 
     _stack = new llvm::GlobalVariable(
-        *ctx->module, cda->getType(), !CONSTANT,
-            llvm::GlobalValue::ExternalLinkage, cda, "Stack");
+        *ctx->module, aty, !CONSTANT,
+            llvm::GlobalValue::ExternalLinkage, zero, "Stack");
 
     // set stack end pointer
 
@@ -0,0 +1,77 @@
+#include "TBAA.h"
+
+#include "Context.h"
+
+#include <llvm/IR/Instruction.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/MDBuilder.h>
+#include <llvm/IR/Metadata.h>
+
+#undef ENABLE_DBGS
+#define ENABLE_DBGS 1
+#include "Debug.h"
+
+namespace sbt {
+
+TBAA::TBAA(Context* ctx)
+    :
+    _ctx(ctx)
+{
+    llvm::MDBuilder mdb(*_ctx->ctx);
+    _root = mdb.createTBAARoot("sbt");
+
+    _tags[XREG] = newTag("xreg", _root);
+    _tags[FREG] = newTag("freg", _root);
+    _tags[FCSR] = newTag("fcsr", _root);
+
+    _memType = mdb.createTBAAScalarTypeNode("mem", _root);
+    _tags[MEM] = mdb.createTBAAStructTagNode(_memType, _memType, 0);
+    _tags[STACK] = newTag("stack", _memType);
+}
+
+
+llvm::MDNode* TBAA::newTag(const std::string& name, llvm::MDNode* parent)
+{
+    llvm::MDBuilder mdb(*_ctx->ctx);
+    llvm::MDNode* type = mdb.createTBAAScalarTypeNode(name, parent);
+    return mdb.createTBAAStructTagNode(type, type, 0);
+}
+
+
+void TBAA::addReg(llvm::Value* reg, Kind kind)
+{
+    xassert(kind < MEM && "invalid register kind");
+    llvm::MDNode* tag = _tags[kind];
+    _regs.upsert(reg, std::move(tag));
+}
+
+
+void TBAA::tagReg(llvm::Instruction* i, llvm::Value* ptr) const
+{
+    // f registers may be accessed through a float pointer cast
+    llvm::MDNode* const* tag = _regs[ptr->stripPointerCasts()];
+    if (tag)
+        i->setMetadata(llvm::LLVMContext::MD_tbaa, *tag);
+}
+
+
+void TBAA::tagMem(llvm::Instruction* i, Kind kind)
+{
+    xassert(kind >= MEM && "invalid memory kind");
+    i->setMetadata(llvm::LLVMContext::MD_tbaa, _tags[kind]);
+}
+
+
+void TBAA::tagSec(llvm::Instruction* i, const std::string& sec)
+{
+    llvm::MDNode** tag = _secTags[sec];
+    if (!tag) {
+        DBGF("sec={0}", sec);
+        llvm::MDNode* t = newTag("mem" + sec, _memType);
+        _secTags.upsert(sec, std::move(t));
+        tag = _secTags[sec];
+    }
+    i->setMetadata(llvm::LLVMContext::MD_tbaa, *tag);
+}
+
+}
@@ -0,0 +1,78 @@
+#ifndef SBT_TBAA_H
+#define SBT_TBAA_H
+
+#include "Map.h"
+
+#include <string>
+
+namespace llvm {
+class Instruction;
+class MDNode;
+class Value;
+}
+
+namespace sbt {
+
+class Context;
+
+/**
+ * Alias analysis (TBAA) metadata (-aa-meta).
+ *
+ * Guest memory is accessed through pointers built from guest register
+ * values, so, without extra information, LLVM must assume that any guest
+ * store may change any emulated register. Here, each kind of storage gets
+ * its own TBAA type, all under the same root:
+ *
+ * - x registers, f registers and fcsr
+ * - guest memory, with the guest stack and each shadow section below it
+ *
+ * Guest memory accesses whose target is not known are tagged as guest
+ * memory, and thus may alias the stack and any section, but never a
+ * register. Accesses that are not tagged may alias anything.
+ */
+class TBAA
+{
+public:
+    enum Kind {
+        XREG,
+        FREG,
+        FCSR,
+        // guest memory
+        MEM,
+        // guest stack
+        STACK
+    };
+
+    TBAA(Context* ctx);
+
+    /**
+     * Set the kind of a global register variable,
+     * to tag the loads and stores that use it.
+     */
+    void addReg(llvm::Value* reg, Kind kind);
+
+    // tag load/store, if ptr is a global register
+    void tagReg(llvm::Instruction* i, llvm::Value* ptr) const;
+
+    // tag guest memory load/store
+    void tagMem(llvm::Instruction* i, Kind kind = MEM);
+
+    // tag guest memory load/store known to access the given section
+    void tagSec(llvm::Instruction* i, const std::string& sec);
+
+private:
+    Context* _ctx;
+    llvm::MDNode* _root;
+    llvm::MDNode* _memType;
+    llvm::MDNode* _tags[STACK + 1];
+    // section tags, created on demand
+    Map<std::string, llvm::MDNode*> _secTags;
+    // global registers
+    Map<const llvm::Value*, llvm::MDNode*> _regs;
+
+    llvm::MDNode* newTag(const std::string& name, llvm::MDNode* parent);
+};
+
+}
+
+#endif
@@ -0,0 +1,497 @@
+#include "TranslationCache.h"
+
+#include "Context.h"
+#include "Function.h"
+#include "Profile.h"
+#include "SBTError.h"
+#include "Section.h"
+#include "ShadowImage.h"
+#include "Translator.h"
+
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/IR/Metadata.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IR/Verifier.h>
+#include <llvm/Linker/Linker.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/FormatVariadic.h>
+#include <llvm/Support/MD5.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+#include <llvm/Transforms/Utils/ValueMapper.h>
+
+#include <algorithm>
+
+#undef ENABLE_DBGS
+#define ENABLE_DBGS 1
+#include "Debug.h"
+
+namespace sbt {
+
+// named metadata used to store cache entry info
+static const char* KEY_MD = "sbt.cache.key";
+static const char* DEPS_MD = "sbt.cache.deps";
+
+// dependency kinds
+static const char* DEP_FUNC = "func";
+static const char* DEP_IS_FUNC = "isfunc";
+static const char* DEP_IMPORT = "import";
+
+
+static void update(llvm::MD5& h, uint64_t v)
+{
+    uint8_t b[8];
+    for (int i = 0; i < 8; i++)
+        b[i] = v >> (8 * i);
+    h.update(llvm::ArrayRef<uint8_t>(b));
+}
+
+
+static void update(llvm::MD5& h, llvm::StringRef s)
+{
+    update(h, s.size());
+    h.update(s);
+}
+
+
+static std::string digest(llvm::MD5& h)
+{
+    llvm::MD5::MD5Result res;
+    h.final(res);
+    return res.digest().str();
+}
+
+
+TranslationCache::TranslationCache(
+    Context* ctx,
+    const std::string& dir,
+    llvm::Error& err)
+    :
+    _ctx(ctx),
+    _dir(dir)
+{
+    if (auto ec = llvm::sys::fs::create_directories(_dir)) {
+        err = ERRORF("failed to create cache directory \"{0}\": {1}",
+            _dir, ec.message());
+        return;
+    }
+
+    // hash everything that may affect the translation of any function
+    const Options* opts = _ctx->opts;
+    llvm::MD5 h;
+    update(h, VERSION);
+    update(h, SBT_DEBUG);
+    update(h, static_cast<uint64_t>(opts->regs()));
+    update(h, opts->useLibC());
+    update(h, opts->stackSize());
+    update(h, opts->syncFRegs());
+    update(h, opts->syncOnExternalCalls());
+    update(h, opts->commentedAsm());
+    update(h, opts->symBoundsCheck());
+    update(h, opts->enableFCSR());
+    update(h, opts->enableFCVTValidation());
+    update(h, opts->hardFloatABI());
+    update(h, opts->optStack());
+    update(h, opts->icallIntOnly());
+    update(h, opts->funcSigs());
+    update(h, opts->icallPredict());
+    update(h, opts->aaMeta());
+    update(h, opts->splitData());
+    update(h, opts->gepAddr());
+    update(h, opts->regFile());
+    update(h, opts->regFileTLS());
+
+    // profile used to translate all functions
+    if (const Profile* prof = _ctx->profile)
+        update(h, prof->contents());
+
+    // imported function types come from libc.bc
+    const std::string& libcBC = _ctx->c.libCBC();
+    if (!libcBC.empty()) {
+        auto res = llvm::MemoryBuffer::getFile(libcBC);
+        if (res)
+            update(h, (*res)->getBuffer());
+    }
+
+    _base = digest(h);
+    err = llvm::Error::success();
+}
+
+
+std::string TranslationCache::path(const std::string& key) const
+{
+    return _dir + "/" + key + ".bc";
+}
+
+
+std::string TranslationCache::key(
+    const SBTSection* sec,
+    const std::string& name,
+    uint64_t start,
+    uint64_t end) const
+{
+    llvm::MD5 h;
+    update(h, _base);
+    update(h, sec->section()->name());
+    update(h, name);
+    update(h, start);
+    update(h, end);
+
+    // register usage and signatures of this function and its callees
+    if (_ctx->opts->regs() == Options::Regs::LIVE || _ctx->opts->funcSigs())
+        update(h, sec->regUsageHash());
+
+    // indirect call targets and jump tables,
+    // that may come from data relocations
+    for (uint64_t addr = start; addr < end;
+        addr += Constants::INSTRUCTION_SIZE)
+    {
+        if (const SBTSection::ICallTargets* ict = sec->icallTargets(addr)) {
+            update(h, addr);
+            update(h, ict->exact);
+            for (uint64_t target : ict->targets)
+                update(h, target);
+        }
+
+        if (const SBTSection::JumpTable* jt = sec->jumpTable(addr)) {
+            update(h, addr);
+            update(h, jt->load);
+            update(h, jt->sec);
+            update(h, jt->offs);
+            for (uint64_t target : jt->targets)
+                update(h, target);
+        }
+    }
+
+    // raw bytes
+    const llvm::ArrayRef<uint8_t> bytes = sec->bytes();
+    uint64_t bend = std::min<uint64_t>(end, bytes.size());
+    if (start < bend)
+        h.update(bytes.slice(start, bend - start));
+
+    // relocations
+    // (sorted by offset)
+    const ConstRelocationPtrVec& relocs = sec->section()->relocs();
+    auto it = std::lower_bound(relocs.begin(), relocs.end(), start,
+        [](const ConstRelocationPtr& rel, uint64_t addr) {
+            return rel->offset() < addr;
+        });
+    for (; it != relocs.end() && (*it)->offset() < end; ++it) {
+        const ConstRelocationPtr& rel = *it;
+        update(h, rel->str());
+        update(h, rel->isLocalFunction());
+        update(h, rel->isExternal());
+        if (rel->hasSym())
+            update(h, rel->symAddr());
+    }
+
+    return digest(h);
+}
+
+
+void TranslationCache::beginRecord()
+{
+    _recording = true;
+    _noStore = false;
+    _deps.clear();
+    _seenAddrs.clear();
+    _seenImports.clear();
+}
+
+
+void TranslationCache::addDep(Dep&& dep)
+{
+    _deps.push_back(std::move(dep));
+}
+
+
+void TranslationCache::recordFunc(uint64_t addr, const Function* f)
+{
+    // external function addresses are checked by replaying the imports
+    if (!_recording || _noStore || Translator::isExternalFunc(addr))
+        return;
+    if (!_seenAddrs.insert({DEP_FUNC, addr}).second)
+        return;
+    addDep(Dep{DEP_FUNC, addr, f? f->name() : "", ""});
+}
+
+
+void TranslationCache::recordIsFunc(uint64_t addr, bool isFunc)
+{
+    if (!_recording || _noStore)
+        return;
+    if (!_seenAddrs.insert({DEP_IS_FUNC, addr}).second)
+        return;
+    addDep(Dep{DEP_IS_FUNC, addr, isFunc? "1" : "0", ""});
+}
+
+
+void TranslationCache::recordImport(
+    const std::string& func,
+    uint64_t addr,
+    const std::string& xfunc)
+{
+    if (!_recording || _noStore)
+        return;
+    if (!_seenImports.insert(func).second)
+        return;
+    addDep(Dep{DEP_IMPORT, addr, func, xfunc});
+}
+
+
+bool TranslationCache::checkDeps(
+    const std::vector<Dep>& deps,
+    uint64_t start,
+    uint64_t end)
+{
+    // a function starting inside this one would split it
+    auto fmap = _ctx->_funcByAddr;
+    auto it = fmap->lower_bound(start + Constants::INSTRUCTION_SIZE);
+    if (it != fmap->end() && it->key < end) {
+        DBGF("function {0} inside range", it->val->name());
+        return false;
+    }
+
+    // pending relocations would patch this function's BBs
+    if (_ctx->shadowImage->hasPendingRelocs(start, end)) {
+        DBGF("pending relocations inside range");
+        return false;
+    }
+
+    for (const Dep& dep : deps) {
+        if (dep.kind == DEP_FUNC) {
+            Function* f = _ctx->funcByAddr(dep.addr, !ASSERT_NOT_NULL);
+            if ((f? f->name() : "") != dep.name) {
+                DBGF("function at {0:X+8} changed", dep.addr);
+                return false;
+            }
+        } else if (dep.kind == DEP_IS_FUNC) {
+            bool isFunc = Function::isFunction(_ctx, dep.addr);
+            if (isFunc != (dep.name == "1")) {
+                DBGF("isFunction({0:X+8}) changed", dep.addr);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+
+llvm::Expected<bool> TranslationCache::load(
+    const std::string& key,
+    Function* f,
+    uint64_t start,
+    uint64_t end)
+{
+    auto miss = [this]() {
+        _misses++;
+        return false;
+    };
+
+    // function already defined (e.g. duplicate local symbol names)
+    llvm::Function* lf = _ctx->module->getFunction(f->name());
+    if (lf && !lf->isDeclaration())
+        return miss();
+
+    auto res = llvm::MemoryBuffer::getFile(path(key));
+    if (!res)
+        return miss();
+
+    // a bad entry is just a miss: it will be overwritten
+    auto expMod = llvm::parseBitcodeFile(**res, *_ctx->ctx);
+    if (!expMod) {
+        llvm::consumeError(expMod.takeError());
+        return miss();
+    }
+    std::unique_ptr<llvm::Module> mod = std::move(*expMod);
+
+    auto getStr = [](const llvm::MDNode* n, unsigned i) {
+        auto* s = llvm::dyn_cast<llvm::MDString>(n->getOperand(i));
+        return s? s->getString() : llvm::StringRef();
+    };
+
+    llvm::NamedMDNode* keyMD = mod->getNamedMetadata(KEY_MD);
+    if (!keyMD || keyMD->getNumOperands() != 1 ||
+        getStr(keyMD->getOperand(0), 0) != key)
+        return miss();
+
+    std::vector<Dep> deps;
+    if (llvm::NamedMDNode* depsMD = mod->getNamedMetadata(DEPS_MD)) {
+        for (const llvm::MDNode* n : depsMD->operands()) {
+            if (n->getNumOperands() != 4)
+                return miss();
+            Dep dep;
+            dep.kind = getStr(n, 0);
+            if (getStr(n, 1).getAsInteger(10, dep.addr))
+                return miss();
+            dep.name = getStr(n, 2);
+            dep.xfunc = getStr(n, 3);
+            deps.push_back(std::move(dep));
+        }
+        depsMD->eraseFromParent();
+    }
+    keyMD->eraseFromParent();
+
+    if (!checkDeps(deps, start, end))
+        return miss();
+
+    // replay imports, in the same order as the original translation
+    // (if anything differs now, translating the function again performs
+    //  exactly the same imports, so nothing is lost)
+    for (const Dep& dep : deps) {
+        if (dep.kind != DEP_IMPORT)
+            continue;
+        auto expAddr = _ctx->translator->import(dep.name);
+        if (!expAddr)
+            return expAddr.takeError();
+        if (expAddr.get().first != dep.addr ||
+            expAddr.get().second != dep.xfunc)
+        {
+            DBGF("import {0} changed", dep.name);
+            return miss();
+        }
+    }
+
+    if (llvm::Linker::linkModules(*_ctx->module, std::move(mod)))
+        return ERRORF("failed to link cached function {0}", f->name());
+    f->create();
+
+    DBGF("{0}: cache hit", f->name());
+    _hits++;
+    return true;
+}
+
+
+llvm::Error TranslationCache::endRecord(const std::string& key, Function* f)
+{
+    _recording = false;
+    if (_noStore) {
+        DBGF("{0}: not cacheable", f->name());
+        return llvm::Error::success();
+    }
+    return store(key, f);
+}
+
+
+namespace {
+
+// declare the globals referenced by the cached function in its module,
+// so that they are resolved by the linker when the entry is loaded
+class DeclMaterializer : public llvm::ValueMaterializer
+{
+public:
+    DeclMaterializer(llvm::Module* mod) :
+        _mod(mod)
+    {}
+
+    llvm::Value* materialize(llvm::Value* v) override
+    {
+        auto* gv = llvm::dyn_cast<llvm::GlobalValue>(v);
+        if (!gv)
+            return nullptr;
+
+        // local symbols can't be resolved across modules
+        if (gv->hasLocalLinkage())
+            _hasLocals = true;
+
+        if (auto* f = llvm::dyn_cast<llvm::Function>(gv)) {
+            llvm::Function* nf = llvm::Function::Create(
+                f->getFunctionType(), llvm::Function::ExternalLinkage,
+                f->getName(), _mod);
+            nf->setAttributes(f->getAttributes());
+            nf->setCallingConv(f->getCallingConv());
+            return nf;
+        }
+
+        if (auto* var = llvm::dyn_cast<llvm::GlobalVariable>(gv))
+            return new llvm::GlobalVariable(*_mod, var->getValueType(),
+                var->isConstant(), llvm::GlobalValue::ExternalLinkage,
+                nullptr, var->getName());
+
+        // aliases/ifuncs are never referenced by translated code
+        _hasLocals = true;
+        return nullptr;
+    }
+
+    bool hasLocals() const
+    {
+        return _hasLocals;
+    }
+
+private:
+    llvm::Module* _mod;
+    bool _hasLocals = false;
+};
+
+}
+
+
+llvm::Error TranslationCache::store(const std::string& key, Function* f)
+{
+    llvm::LLVMContext& ctx = *_ctx->ctx;
+    llvm::Function* of = f->func();
+    xassert(of);
+
+    // clone the function alone into a new module
+    llvm::Module mod(f->name(), ctx);
+    llvm::Function* nf = llvm::Function::Create(of->getFunctionType(),
+        of->getLinkage(), of->getName(), &mod);
+
+    llvm::ValueToValueMapTy vmap;
+    vmap[of] = nf;
+    auto nargIt = nf->arg_begin();
+    for (auto& arg : of->args()) {
+        nargIt->setName(arg.getName());
+        vmap[&arg] = &*nargIt++;
+    }
+
+    llvm::SmallVector<llvm::ReturnInst*, 8> rets;
+    DeclMaterializer mat(&mod);
+    llvm::CloneFunctionInto(nf, of, vmap, true/*ModuleLevelChanges*/, rets,
+        ""/*NameSuffix*/, nullptr/*CodeInfo*/, nullptr/*TypeMapper*/, &mat);
+
+    if (mat.hasLocals() || llvm::verifyFunction(*nf)) {
+        DBGF("{0}: failed to extract function", f->name());
+        return llvm::Error::success();
+    }
+
+    // entry info
+    mod.getOrInsertNamedMetadata(KEY_MD)->addOperand(
+        llvm::MDNode::get(ctx, { llvm::MDString::get(ctx, key) }));
+
+    llvm::NamedMDNode* depsMD = mod.getOrInsertNamedMetadata(DEPS_MD);
+    for (const Dep& dep : _deps)
+        depsMD->addOperand(llvm::MDNode::get(ctx, {
+            llvm::MDString::get(ctx, dep.kind),
+            llvm::MDString::get(ctx, std::to_string(dep.addr)),
+            llvm::MDString::get(ctx, dep.name),
+            llvm::MDString::get(ctx, dep.xfunc)}));
+
+    // write to a temporary file first and then rename it,
+    // to never leave partially written entries behind
+    const std::string entry = path(key);
+    llvm::SmallString<128> tmp;
+    int fd;
+    if (auto ec = llvm::sys::fs::createUniqueFile(
+            entry + ".%%%%%%.tmp", fd, tmp))
+        return ERRORF("failed to create cache file: {0}", ec.message());
+    {
+        llvm::raw_fd_ostream os(fd, true/*shouldClose*/);
+        llvm::WriteBitcodeToFile(mod, os);
+        os.flush();
+        if (os.has_error()) {
+            os.clear_error();
+            llvm::sys::fs::remove(tmp);
+            return ERRORF("failed to write cache file {0}", tmp.str());
+        }
+    }
+    if (auto ec = llvm::sys::fs::rename(tmp, entry))
+        return ERRORF("failed to rename cache file: {0}", ec.message());
+
+    DBGF("{0}: stored", f->name());
+    _stores++;
+    return llvm::Error::success();
+}
+
+}
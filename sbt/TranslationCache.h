@@ -0,0 +1,145 @@
+#ifndef SBT_TRANSLATIONCACHE_H
+#define SBT_TRANSLATIONCACHE_H
+
+#include <llvm/Support/Error.h>
+
+#include <cstdint>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace sbt {
+
+class Context;
+class Function;
+class SBTSection;
+
+/**
+ * On-disk cache of translated functions.
+ *
+ * Each entry holds the translated IR of a single guest function, stored as
+ * bitcode, and is addressed by a hash of everything that may affect its
+ * translation: function name and bounds, raw bytes, relocations,
+ * translation options and translator version.
+ *
+ * A function's translation may also depend on the state of the translator
+ * at the time it was translated, such as which other functions were already
+ * known and which fake addresses were assigned to imported functions.
+ * These queries are recorded with the entry and checked again before
+ * reusing it. Functions whose translation changes other parts of the module
+ * (e.g. by creating new functions or patching the shadow image) are never
+ * stored.
+ */
+class TranslationCache
+{
+public:
+    // bump this on every change that affects the generated code
+    static const unsigned VERSION = 7;
+
+    /**
+     * ctor.
+     *
+     * @param ctx
+     * @param dir cache directory (created if it does not exist)
+     * @param err
+     */
+    TranslationCache(Context* ctx, const std::string& dir, llvm::Error& err);
+
+    /**
+     * Get cache key of a guest function.
+     *
+     * @param sec section that contains the function
+     * @param name function name
+     * @param start function address
+     * @param end address of first byte after function's last byte
+     */
+    std::string key(
+        const SBTSection* sec,
+        const std::string& name,
+        uint64_t start,
+        uint64_t end) const;
+
+    /**
+     * Look up function in cache and, if found and still valid,
+     * link it into the module being translated.
+     *
+     * @return true on cache hit
+     */
+    llvm::Expected<bool> load(
+        const std::string& key,
+        Function* f,
+        uint64_t start,
+        uint64_t end);
+
+    // start recording the queries made by the function being translated
+    void beginRecord();
+    // stop recording and store the translated function, if possible
+    llvm::Error endRecord(const std::string& key, Function* f);
+
+    // query recording
+
+    void recordFunc(uint64_t addr, const Function* f);
+    void recordIsFunc(uint64_t addr, bool isFunc);
+    void recordImport(
+        const std::string& func,
+        uint64_t addr,
+        const std::string& xfunc);
+
+    // current function must not be stored
+    void noStore()
+    {
+        _noStore = true;
+    }
+
+    // statistics
+
+    size_t hits() const
+    {
+        return _hits;
+    }
+
+    size_t misses() const
+    {
+        return _misses;
+    }
+
+    size_t stores() const
+    {
+        return _stores;
+    }
+
+private:
+    struct Dep {
+        std::string kind;
+        uint64_t addr;
+        std::string name;
+        std::string xfunc;
+    };
+
+    Context* _ctx;
+    std::string _dir;
+    // hash of translator version and options
+    std::string _base;
+
+    bool _recording = false;
+    bool _noStore = false;
+    std::vector<Dep> _deps;
+    std::set<std::pair<std::string, uint64_t>> _seenAddrs;
+    std::set<std::string> _seenImports;
+
+    size_t _hits = 0;
+    size_t _misses = 0;
+    size_t _stores = 0;
+
+    // methods
+
+    std::string path(const std::string& key) const;
+    void addDep(Dep&& dep);
+    bool checkDeps(const std::vector<Dep>& deps, uint64_t start, uint64_t end);
+    llvm::Error store(const std::string& key, Function* f);
+};
+
+}
+
+#endif
@@ -7,10 +7,13 @@
 #include "FRegister.h"
 #include "Instruction.h"
 #include "Module.h"
+#include "Profile.h"
 #include "SBTError.h"
 #include "ShadowImage.h"
 #include "Stack.h"
 #include "Syscall.h"
+#include "TBAA.h"
+#include "TranslationCache.h"
 #include "Utils.h"
 #include "XRegister.h"
 
@@ -30,6 +33,8 @@
 #include <llvm/Support/TargetRegistry.h>
 #include <llvm/Support/TargetSelect.h>
 
+#include <algorithm>
+#include <chrono>
 #include <map>
 
 #undef ENABLE_DBGS
@@ -70,11 +75,29 @@ llvm::Error Translator::start()
     // setup context
 
     // global register file
+    if (_opts.regFile()) {
+        _regFile.reset(new RegFile(_ctx, _opts.regFileTLS()));
+        _ctx->regFile = &*_regFile;
+    }
     _ctx->x = new XRegisters(_ctx, XRegisters::NONE);
     _ctx->f = new FRegisters(_ctx, FRegisters::NONE);
-    _ctx->fcsr = new Register(_ctx,
-        CSR::FCSR, "fcsr", "rv_fcsr",
-        Register::T_INT, Register::NONE);
+    if (_regFile)
+        _ctx->fcsr = new Register("fcsr", _regFile->fcsr());
+    else
+        _ctx->fcsr = new Register(_ctx,
+            CSR::FCSR, "fcsr", "rv_fcsr",
+            Register::T_INT, Register::NONE);
+
+    // alias analysis metadata
+    if (_opts.aaMeta()) {
+        _tbaa.reset(new TBAA(_ctx));
+        _ctx->tbaa = &*_tbaa;
+        for (size_t i = 1; i < XRegisters::NUM; i++)
+            _tbaa->addReg(_ctx->x->getReg(i).get(), TBAA::XREG);
+        for (size_t i = 0; i < FRegisters::NUM; i++)
+            _tbaa->addReg(_ctx->f->getReg(i).get(), TBAA::FREG);
+        _tbaa->addReg(_ctx->fcsr->get(), TBAA::FCSR);
+    }
 
     // stack
     _ctx->stack = new Stack(_ctx, _opts.stackSize());
@@ -111,6 +134,29 @@ llvm::Error Translator::start()
     _a2s.reset(expA2S.get());
     _ctx->a2s = &*_a2s;
 
+    // profile
+    if (_opts.profileGen() || !_opts.profileUse().empty()) {
+        auto expProf = sbt::create<Profile*>(_ctx);
+        if (!expProf)
+            return expProf.takeError();
+        _profile.reset(expProf.get());
+        _ctx->profile = &*_profile;
+    }
+
+    // translation cache
+    // (source code comments come from a2s, that is not part of cache keys,
+    //  and profile counters are numbered in translation order)
+    if (!_opts.cacheDir().empty() &&
+        !(_opts.commentedAsm() && !_opts.a2s().empty()) &&
+        !_opts.profileGen())
+    {
+        auto expCache = sbt::create<TranslationCache*>(_ctx, _opts.cacheDir());
+        if (!expCache)
+            return expCache.takeError();
+        _cache.reset(expCache.get());
+        _ctx->cache = &*_cache;
+    }
+
     return llvm::Error::success();
 }
 
@@ -165,12 +211,29 @@ llvm::Error Translator::finish()
     genIsExternal();
     if (!_opts.hardFloatABI())
         genICaller();
+
+    if (_profile)
+        _profile->finish(_funcByAddr);
+
+    // define the wrappers of functions with signatures
+    // that are called indirectly
+    if (_opts.funcSigs()) {
+        for (const auto& p : _funcByAddr) {
+            Function* f = p.val;
+            if (!isExternalFunc(f->addr()))
+                f->genICallWrapper();
+        }
+    }
     return llvm::Error::success();
 }
 
 
 Syscall& Translator::syscall()
 {
+    // the handler is generated only once, by its first user
+    if (_ctx->cache)
+        _ctx->cache->noStore();
+
     // create handler on first use (if any)
     if (!_sc) {
         _sc.reset(new Syscall(_ctx));
@@ -183,6 +246,10 @@ Syscall& Translator::syscall()
 
 void Translator::initCounters()
 {
+    // counters are initialized only once, by their first user
+    if (_ctx->cache)
+        _ctx->cache->noStore();
+
     if (_initCounters) {
         llvm::Function* f = llvm::Function::Create(_ctx->t.voidFunc,
             llvm::Function::ExternalLinkage, "counters_init", _ctx->module);
@@ -211,6 +278,8 @@ llvm::Error Translator::translate()
         DBGS << ' ' << f;
     DBGS << nl << "output file: " << _outputFile << nl;
 
+    auto t0 = std::chrono::steady_clock::now();
+
     if (auto err = start())
         return err;
 
@@ -225,6 +294,19 @@ llvm::Error Translator::translate()
     if (auto err = finish())
         return err;
 
+    if (_cache)
+        LOGS << llvm::formatv("translation cache: hits={0}, misses={1}, "
+            "stores={2}\n", _cache->hits(), _cache->misses(), _cache->stores());
+
+    if (_opts.stats()) {
+        std::chrono::duration<double> secs =
+            std::chrono::steady_clock::now() - t0;
+        size_t n = _ctx->translatedInstrs;
+        LOGS << llvm::formatv("translated {0} instructions in {1:F3}s "
+            "({2:F0} instructions/s)\n",
+            n, secs.count(), n / secs.count());
+    }
+
     return llvm::Error::success();
 }
 
@@ -242,7 +324,9 @@ llvm::Expected<std::pair<uint64_t, std::string>>
 Translator::import(const std::string& func)
 {
     using RetT = llvm::Expected<std::pair<uint64_t, std::string>>;
-    auto make_ret = [](uint64_t addr, const std::string& xfunc) {
+    auto make_ret = [this, &func](uint64_t addr, const std::string& xfunc) {
+        if (_ctx->cache)
+            _ctx->cache->recordImport(func, addr, xfunc);
         return RetT(std::pair<uint64_t, std::string>(addr, xfunc));
     };
 
@@ -259,7 +343,13 @@ Translator::import(const std::string& func)
         return make_ret((*f)->addr(), xfunc);
 
     // load libc module
+    //
+    // Only the symbol table and the declarations are needed here, to get
+    // the type of imported functions, so load it lazily, without
+    // materializing any function bodies or metadata.
     if (!_lcModule) {
+        auto t0 = std::chrono::steady_clock::now();
+
         const auto& libcBC = _ctx->c.libCBC();
         if (libcBC.empty())
             return ERROR("libc.bc file not found");
@@ -267,13 +357,20 @@ Translator::import(const std::string& func)
         auto res = llvm::MemoryBuffer::getFile(libcBC);
         if (!res)
             return llvm::errorCodeToError(res.getError());
-        llvm::MemoryBufferRef buf = **res;
 
         llvm::LLVMContext* ctx = _ctx->ctx;
-        auto expMod = llvm::parseBitcodeFile(buf, *ctx);
+        auto expMod = llvm::getOwningLazyBitcodeModule(std::move(*res), *ctx,
+            /*ShouldLazyLoadMetadata*/ true);
         if (!expMod)
             return expMod.takeError();
         _lcModule = std::move(*expMod);
+
+        if (_opts.stats()) {
+            std::chrono::duration<double> secs =
+                std::chrono::steady_clock::now() - t0;
+            LOGS << llvm::formatv("loaded {0} in {1:F6}s\n",
+                libcBC, secs.count());
+        }
     }
 
     // lookup function
@@ -314,18 +411,150 @@ void Translator::genICaller()
 
     // prepare
     const Constants& c = _ctx->c;
+    const Types& t = _ctx->t;
+    const uint64_t isz = Constants::INSTRUCTION_SIZE;
     Builder bldi(_ctx, NO_FIRST);
     Builder* bld = &bldi;
     llvm::Function* ic = _iCaller.func();
+    llvm::FunctionType* icType = ic->getFunctionType();
     llvm::Argument& target = *ic->arg_begin();
 
+    // Guest addresses are mapped to host functions by 2 dispatch tables,
+    // indexed by (target - base) / 4:
+    // - internal functions, starting at the lowest internal function address
+    // - external function thunks, starting at FIRST_EXT_FUNC_ADDR
+    // Addresses with no function have null entries.
+    uint64_t intBase = Constants::INVALID_ADDR;
+    uint64_t intLast = 0;
+    for (const auto& p : _funcByAddr) {
+        uint64_t addr = p.val->addr();
+        if (isExternalFunc(addr))
+            continue;
+        intBase = std::min(intBase, addr);
+        intLast = std::max(intLast, addr);
+    }
+    size_t nInt = intBase <= intLast? (intLast - intBase) / isz + 1 : 0;
+    size_t nExt = (_extFuncAddr - FIRST_EXT_FUNC_ADDR) / isz;
+
+    llvm::PointerType* intTy = t.voidFunc->getPointerTo();
+    llvm::PointerType* extTy = icType->getPointerTo();
+    std::vector<llvm::Constant*> intFuncs(nInt,
+        llvm::ConstantPointerNull::get(intTy));
+    std::vector<llvm::Constant*> extFuncs(nExt,
+        llvm::ConstantPointerNull::get(extTy));
+    std::vector<FunctionPtr> thunks;
+
+    for (const auto& p : _funcByAddr) {
+        Function* f = p.val;
+        uint64_t addr = f->addr();
+        DBGF("function={0}, addr={1:X+8}", f->name(), addr);
+        xassert(addr != Constants::INVALID_ADDR);
+
+        // XXX skip main for now
+        if (f->name() == "main")
+            continue;
+
+        if (!isExternalFunc(addr)) {
+            // region functions are never called indirectly
+            // (see SBTSection::canUseRegion())
+            if (f->oneRegion())
+                continue;
+            intFuncs[(addr - intBase) / isz] =
+                llvm::ConstantExpr::getBitCast(f->icallFunc(), intTy);
+            continue;
+        }
+
+        // external function thunk: same type as icaller
+        FunctionPtr thunk(new Function(_ctx, "rv32_icall_" + f->name()));
+        thunk->create(icType, llvm::Function::InternalLinkage);
+        llvm::Function* th = thunk->func();
+        BasicBlock bb(_ctx, "entry", th);
+        bld->setInsertBlock(&bb);
+
+        Caller caller(_ctx, bld, f, &*thunk);
+
+        // get args
+        std::vector<llvm::Value*> args;
+        auto argit = th->arg_begin();
+        ++argit;    // skip target
+
+        // set args
+        for (size_t i = 0; i < caller.getNumWordArgs(); i++, ++argit)
+            args.push_back(&*argit);
+
+        caller.setRetInGlobal(true);
+        caller.setArgs(&args);
+        caller.callExternal();
+        bld->retVoid();
+
+        extFuncs[(addr - FIRST_EXT_FUNC_ADDR) / isz] = th;
+        thunks.push_back(std::move(thunk));
+    }
+
+    auto table = [&](const std::string& name, llvm::PointerType* ty,
+        const std::vector<llvm::Constant*>& funcs)
+    {
+        llvm::ArrayType* aty = llvm::ArrayType::get(ty, funcs.size());
+        return new llvm::GlobalVariable(
+            *_ctx->module, aty, CONSTANT,
+            llvm::GlobalValue::InternalLinkage,
+            llvm::ConstantArray::get(aty, funcs), name);
+    };
+    llvm::GlobalVariable* intTable =
+        table("rv32_icall_table", intTy, intFuncs);
+    llvm::GlobalVariable* extTable =
+        table("rv32_icall_ext_table", extTy, extFuncs);
+
     // basic blocks
     BasicBlock bbBeg(_ctx, "begin", ic);
+    BasicBlock bbInt(_ctx, "int", ic);
+    BasicBlock bbIntCall(_ctx, "int_call", ic);
+    BasicBlock bbExt(_ctx, "ext", ic);
+    BasicBlock bbExtCall(_ctx, "ext_call", ic);
     BasicBlock bbDfl(_ctx, "default", ic);
 
-    // begin: switch
+    // begin: select table
     bld->setInsertBlock(&bbBeg);
-    llvm::SwitchInst* sw = bld->sw(&target, bbDfl, _funMap.size());
+    llvm::Value* ext = bld->uge(&target, c.u32(FIRST_EXT_FUNC_ADDR));
+    bld->condBr(ext, &bbExt, &bbInt);
+
+    // lookup: bounds check and load table entry, that may be null
+    auto lookup = [&](uint64_t base, size_t n, llvm::GlobalVariable* tbl,
+        BasicBlock* bbCall)
+    {
+        llvm::Value* offs = bld->sub(&target, c.u32(base));
+        llvm::Value* inRange = bld->ult(offs, c.u32(n * isz));
+        llvm::Value* aligned =
+            bld->eq(bld->_and(offs, c.u32(isz - 1)), c.ZERO);
+        BasicBlock bbLoad(_ctx, "load", ic, bbCall->bb());
+        bld->condBr(bld->_and(inRange, aligned), &bbLoad, &bbDfl);
+
+        bld->setInsertBlock(&bbLoad);
+        llvm::Value* idx = bld->srl(offs, c.u32(2));
+        llvm::Value* fptr = bld->load(bld->gep(tbl, { c.ZERO, idx }));
+        llvm::Value* null = llvm::ConstantPointerNull::get(
+            llvm::cast<llvm::PointerType>(fptr->getType()));
+        bld->condBr(bld->ne(fptr, null), bbCall, &bbDfl);
+
+        bld->setInsertBlock(bbCall);
+        return fptr;
+    };
+
+    // internal function: call it directly
+    bld->setInsertBlock(&bbInt);
+    llvm::Value* fptr = lookup(
+        nInt? intBase : 0, nInt, intTable, &bbIntCall);
+    bld->call(fptr);
+    bld->retVoid();
+
+    // external function: call its thunk, with icaller's args
+    bld->setInsertBlock(&bbExt);
+    fptr = lookup(FIRST_EXT_FUNC_ADDR, nExt, extTable, &bbExtCall);
+    std::vector<llvm::Value*> args;
+    for (llvm::Argument& arg : ic->args())
+        args.push_back(&arg);
+    bld->call(fptr, args);
+    bld->retVoid();
 
     // default: abort
 
@@ -362,51 +591,6 @@ void Translator::genICaller()
     // abort
     bld->call(_sbtabort->func());
     bld->retVoid();
-
-    // cases
-    // case fun: arg = realFunAddress;
-    for (const auto& p : _funcByAddr) {
-        Function* f = p.val;
-        uint64_t addr = f->addr();
-        DBGF("function={0}, addr={1:X+8}", f->name(), addr);
-        xassert(addr != Constants::INVALID_ADDR);
-
-        std::string caseStr = "case_" + f->name();
-        BasicBlock dest(_ctx, caseStr, ic, bbDfl.bb());
-        bld->setInsertBlock(&dest);
-
-        // XXX skip main for now
-        if (f->name() == "main") {
-            bld->br(bbDfl);
-            bld->setInsertBlock(&bbBeg);
-            sw->addCase(c.i32(addr), dest.bb());
-            continue;
-        }
-
-        if (!isExternalFunc(addr)) {
-            bld->call(f->func());
-        } else {
-            Caller caller(_ctx, bld, f, &_iCaller);
-
-            // get args
-            std::vector<llvm::Value*> args;
-            auto argit = ic->arg_begin();
-            ++argit;    // skip target
-
-            // set args
-            for (size_t i = 0; i < caller.getNumWordArgs(); i++, ++argit)
-                args.push_back(&*argit);
-
-            caller.setRetInGlobal(true);
-            caller.setArgs(&args);
-            caller.callExternal();
-
-        }
-
-        bld->retVoid();
-        bld->setInsertBlock(&bbBeg);
-        sw->addCase(c.i32(addr), dest.bb());
-    }
 }
 
 
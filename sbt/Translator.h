@@ -138,6 +138,7 @@ private:
     // import() stuff
     static const uint64_t FIRST_EXT_FUNC_ADDR = 0xFFFF0000;
     uint64_t _extFuncAddr = FIRST_EXT_FUNC_ADDR;
+    // libc module (lazily loaded: declarations only)
     std::unique_ptr<llvm::Module> _lcModule;
 
     // syscall handler
@@ -152,6 +153,18 @@ private:
     //
     std::unique_ptr<AddressToSource> _a2s;
 
+    // translation cache
+    std::unique_ptr<TranslationCache> _cache;
+
+    // global register file struct
+    std::unique_ptr<RegFile> _regFile;
+
+    // alias analysis metadata
+    std::unique_ptr<TBAA> _tbaa;
+
+    // profile
+    std::unique_ptr<Profile> _profile;
+
     // methods
 
     llvm::Error start();
@@ -1,5 +1,6 @@
 #include "sbt.h"
 
+#include "CodeGen.h"
 #include "Constants.h"
 #include "Debug.h"
 #include "Object.h"
@@ -27,8 +28,10 @@ void SBT::init()
 
     // init LLVM targets
     llvm::InitializeAllTargetInfos();
+    llvm::InitializeAllTargets();
     llvm::InitializeAllTargetMCs();
     llvm::InitializeAllAsmParsers();
+    llvm::InitializeAllAsmPrinters();
     llvm::InitializeAllDisassemblers();
 }
 
@@ -47,6 +50,7 @@ SBT::SBT(
     llvm::Error& err)
     :
     _outputFile(outputFile),
+    _opts(opts),
     _context(new llvm::LLVMContext),
     _module(new llvm::Module("main", *_context)),
     _builder(new llvm::IRBuilder<>(*_context)),
@@ -62,6 +66,11 @@ SBT::SBT(
         _translator->addInputFile(file);
     }
     _translator->setOpts(opts);
+
+#if !SBT_DEBUG
+    // value names are only useful to debug the translator
+    _context->setDiscardValueNames(true);
+#endif
 }
 
 
@@ -72,7 +81,12 @@ llvm::Error SBT::run()
 
     // check if generated bitcode is valid
     // (this outputs very helpful messages about the invalid bitcode parts)
-    if (llvm::verifyModule(*_module, &DBGS)) {
+#if SBT_DEBUG
+    llvm::raw_ostream* os = &DBGS;
+#else
+    llvm::raw_ostream* os = &llvm::nulls();
+#endif
+    if (llvm::verifyModule(*_module, os)) {
         _module->dump();
         return ERROR2(InvalidBitcode, "translation produced invalid bitcode!");
     }
@@ -88,12 +102,23 @@ void SBT::dump() const
 }
 
 
-void SBT::write()
+llvm::Error SBT::write()
 {
+    if (_opts.emitObj()) {
+        auto expCG = create<CodeGen*>(&_opts);
+        if (!expCG)
+            return expCG.takeError();
+        std::unique_ptr<CodeGen> cg(expCG.get());
+        return cg->emitObj(&*_module, _outputFile);
+    }
+
     std::error_code ec;
     llvm::raw_fd_ostream os(_outputFile, ec, llvm::sys::fs::F_None);
+    if (ec)
+        return llvm::errorCodeToError(ec);
     WriteBitcodeToFile(*_module, os);
     os.flush();
+    return llvm::Error::success();
 }
 
 
@@ -178,7 +203,8 @@ int main(int argc, char* argv[])
 
     cl::opt<std::string> regsOpt(
         "regs",
-        cl::desc("Register translation mode: globals|locals|abi (default=globals)"),
+        cl::desc("Register translation mode: globals|locals|abi|live|oneregion "
+            "(default=globals)"),
         cl::init("globals"));
 
     cl::opt<bool> dontUseLibCOpt(
@@ -220,13 +246,97 @@ int main(int argc, char* argv[])
     cl::opt<bool> softFloatABIOpt("soft-float-abi",
         cl::desc("Use soft-float ABI"));
 
-    cl::opt<bool> optStackOpt("opt-stack", cl::desc("Optimize stack accesses"));
+    cl::opt<bool> optStackOpt("opt-stack",
+        cl::desc("Keep the guest stack slots that don't escape, such as "
+            "callee-saved register spills, in host local variables"));
 
     cl::opt<std::string> logFileOpt("log", cl::desc("Log file path"));
 
     cl::opt<bool> icallIntOnlyOpt("icall-int-only",
         cl::desc("Assume that all icalls are to internal functions"));
 
+    cl::opt<unsigned> decodeJobsOpt("decode-jobs",
+        cl::desc("Number of threads used to decode the functions of each "
+            "section; IR is still emitted serially "
+            "(0 = number of host cores, default=1)"),
+        cl::init(1));
+
+    cl::opt<std::string> cacheDirOpt("cache-dir",
+        cl::desc("Cache translated functions in this directory, "
+            "to speed up the retranslation of unchanged functions"));
+
+    cl::opt<bool> statsOpt("stats",
+        cl::desc("Print translation statistics"));
+
+    cl::opt<bool> checkDecoderOpt("check-decoder",
+        cl::desc("Check the native instruction decoder against "
+            "LLVM's disassembler"));
+
+    cl::opt<bool> decoderBenchOpt("decoder-bench",
+        cl::desc("Measure native and LLVM instruction decoding speed "
+            "on each code section"));
+
+    cl::opt<bool> emitObjOpt("emit-obj",
+        cl::desc("Optimize and compile translated code to a host object "
+            "file, instead of writing bitcode"));
+
+    cl::opt<bool> xoptOpt("xopt",
+        cl::desc("Optimize translated code (with -emit-obj)"));
+
+    cl::opt<std::string> hostTripleOpt("host-triple",
+        cl::desc("Host target triple (with -emit-obj, default=32-bit "
+            "variant of LLVM's default target triple, e.g. i686 on x86_64)"));
+
+    cl::opt<std::string> hostCPUOpt("host-cpu",
+        cl::desc("Host CPU (with -emit-obj)"),
+        cl::init("generic"));
+
+    cl::opt<std::string> hostAttrsOpt("host-attrs",
+        cl::desc("Host target features, such as +avx (with -emit-obj)"));
+
+    cl::opt<bool> hostPICOpt("host-pic",
+        cl::desc("Generate position independent host code (with -emit-obj)"));
+
+    cl::opt<bool> funcSigsOpt("func-sigs",
+        cl::desc("Recover guest function signatures and translate functions "
+            "with real arguments and return values "
+            "(requires -regs=locals|abi|live)"));
+
+    cl::opt<bool> icallPredictOpt("icall-predict",
+        cl::desc("Also guess the targets of indirect calls that can't be "
+            "resolved statically, from the functions whose addresses are "
+            "taken by the caller"));
+
+    cl::opt<bool> aaMetaOpt("aa-meta",
+        cl::desc("Attach alias analysis (TBAA) metadata that tells the "
+            "emulated registers, the guest stack and each guest data "
+            "section apart"));
+
+    cl::opt<bool> profileGenOpt("profile-gen",
+        cl::desc("Instrument translated code to count function entries, "
+            "branch directions and indirect call targets, and to write "
+            "them to a profile on exit ($SBT_PROFILE, default=sbt.prof)"));
+
+    cl::opt<std::string> profileUseOpt("profile-use",
+        cl::desc("Optimize translated code with a profile written by "
+            "-profile-gen code"));
+
+    cl::opt<bool> splitDataOpt("split-data",
+        cl::desc("Split guest data sections into one global per symbol, "
+            "when all references to them are through symbols"));
+
+    cl::opt<bool> gepAddrOpt("gep-addr",
+        cl::desc("Address guest memory with inbounds GEPs off the shadow "
+            "section or stack that the base register points to, "
+            "when it is known"));
+
+    cl::opt<bool> regFileOpt("reg-file",
+        cl::desc("Keep global registers in a single cache aligned struct, "
+            "syncing contiguous registers with vector loads/stores"));
+
+    cl::opt<bool> regFileTLSOpt("reg-file-tls",
+        cl::desc("Make the register file thread local (requires -reg-file)"));
+
     // enable debug code
     cl::opt<bool> debugOpt("debug", cl::desc("Enable debug code"));
 
@@ -265,17 +375,48 @@ int main(int argc, char* argv[])
         regs = sbt::Options::Regs::LOCALS;
     else if (regsOpt == "abi")
         regs = sbt::Options::Regs::ABI;
+    else if (regsOpt == "live")
+        regs = sbt::Options::Regs::LIVE;
+    else if (regsOpt == "oneregion")
+        regs = sbt::Options::Regs::ONEREGION;
     else {
         llvm::errs() << c.BIN_NAME << ": invalid -regs value\n";
         return EXIT_FAILURE;
     }
 
+    // -func-sigs
+    if (funcSigsOpt && (regs == sbt::Options::Regs::GLOBALS ||
+            regs == sbt::Options::Regs::ONEREGION))
+    {
+        llvm::errs() << c.BIN_NAME << ": -func-sigs requires local registers "
+            "(-regs=locals|abi|live)\n";
+        return EXIT_FAILURE;
+    }
+
+    // -profile-gen
+    if (profileGenOpt && !profileUseOpt.empty()) {
+        llvm::errs() << c.BIN_NAME << ": -profile-gen and -profile-use "
+            "can't be used together\n";
+        return EXIT_FAILURE;
+    }
+    if (profileGenOpt && dontUseLibCOpt) {
+        llvm::errs() << c.BIN_NAME << ": -profile-gen requires libC\n";
+        return EXIT_FAILURE;
+    }
+
+    // -reg-file-tls
+    if (regFileTLSOpt && !regFileOpt) {
+        llvm::errs() << c.BIN_NAME << ": -reg-file-tls requires -reg-file\n";
+        return EXIT_FAILURE;
+    }
+
     // set output file
     std::string outputFile;
     if (outputFileOpt.empty()) {
         outputFile = inputFiles.front();
         // remove file extension
-        outputFile = outputFile.substr(0, outputFile.find_last_of('.')) + ".bc";
+        outputFile = outputFile.substr(0, outputFile.find_last_of('.')) +
+            (emitObjOpt? ".host.o" : ".bc");
     } else
         outputFile = outputFileOpt;
 
@@ -295,7 +436,27 @@ int main(int argc, char* argv[])
         .setHardFloatABI(!softFloatABIOpt)
         .setOptStack(optStackOpt)
         .setICallIntOnly(icallIntOnlyOpt)
-        .setLogFile(logFileOpt);
+        .setLogFile(logFileOpt)
+        .setDecodeJobs(decodeJobsOpt)
+        .setCacheDir(cacheDirOpt)
+        .setStats(statsOpt)
+        .setCheckDecoder(checkDecoderOpt)
+        .setDecoderBench(decoderBenchOpt)
+        .setEmitObj(emitObjOpt)
+        .setXOpt(xoptOpt)
+        .setHostTriple(hostTripleOpt)
+        .setHostCPU(hostCPUOpt)
+        .setHostAttrs(hostAttrsOpt)
+        .setHostPIC(hostPICOpt)
+        .setFuncSigs(funcSigsOpt)
+        .setICallPredict(icallPredictOpt)
+        .setAAMeta(aaMetaOpt)
+        .setProfileGen(profileGenOpt)
+        .setProfileUse(profileUseOpt)
+        .setSplitData(splitDataOpt)
+        .setGEPAddr(gepAddrOpt)
+        .setRegFile(regFileOpt)
+        .setRegFileTLS(regFileTLSOpt);
 
     sbt::Logger::get(opts.logFile());
     auto exp = sbt::create<sbt::SBT>(inputFiles, outputFile, opts);
@@ -308,8 +469,10 @@ int main(int argc, char* argv[])
     // dump resulting IR
     // sbt.dump();
 
-    // write IR to output file
-    sbt.write();
+    // write IR (or host object) to output file
+    // (invalid IR is written anyway, as it helps debugging)
+    if (!hasErrors || !opts.emitObj())
+        hasErrors |= sbt::handleError(sbt.write());
 
     return hasErrors? EXIT_FAILURE : EXIT_SUCCESS;
 }
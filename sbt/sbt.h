@@ -2,6 +2,7 @@
 #define SBT_SBT_H
 
 #include "Context.h"
+#include "Options.h"
 
 #include <llvm/Support/CommandLine.h>
 #include <llvm/Support/Error.h>
@@ -12,7 +13,6 @@
 namespace sbt {
 
 class Translator;
-class Options;
 
 class SBT
 {
@@ -41,13 +41,15 @@ public:
   void dump() const;
 
   // write generated IR to output file
-  void write();
+  // (or host object code, if enabled in options)
+  llvm::Error write();
 
   // generate syscall handler
   llvm::Error genSCHandler();
 
 private:
   std::string _outputFile;
+  Options _opts;
   std::unique_ptr<llvm::LLVMContext> _context;
   std::unique_ptr<llvm::Module> _module;
   std::unique_ptr<llvm::IRBuilder<>> _builder;
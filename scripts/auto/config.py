@@ -94,7 +94,29 @@ class Sbt:
         #        "-enable-fcsr",
         #        "-enable-fcvt-validation")
         self.share_dir = DIR.toolchain + "/share/riscv-sbt"
-        self.modes = ["globals", "locals", "abi"]
+        self.modes = ["globals", "locals", "abi", "live", "oneregion"]
+        # test modes for translator options that change the generated code
+        # (name: (register mode, translator flags))
+        self.opt_modes = {
+            "emitobj":  ("locals",  ["-emit-obj"]),
+            "sigs":     ("abi",     ["-func-sigs"]),
+            "ipredict": ("globals", ["-icall-predict"]),
+            "optstack": ("locals",  ["-opt-stack"]),
+            "aameta":   ("globals", ["-aa-meta"]),
+            "split":    ("globals", ["-split-data"]),
+            "gepaddr":  ("locals",  ["-gep-addr"]),
+            "regfile":  ("locals",  ["-reg-file"]),
+        }
+
+    def all_modes(self):
+        return self.modes + list(self.opt_modes.keys())
+
+    def mode_flags(self, mode):
+        """ translator flags for mode """
+        if mode in self.opt_modes:
+            regs, flags = self.opt_modes[mode]
+            return ["-regs=" + regs] + flags
+        return ["-regs=" + mode]
 
     def nat_obj(self, arch, name, clink):
         is_rv32 = arch == RV32 or arch == RV32_LINUX
@@ -317,8 +317,8 @@ class GenMake:
 
 
     def xlate(self, am, _in, out):
-        flags = '--sbtflags " -regs={}"'.format(am.mode)
-        for flag in self.sbtflags:
+        flags = "--sbtflags"
+        for flag in SBT.mode_flags(am.mode) + self.sbtflags:
             flags = flags + ' " {}"'.format(flag)
         xflags = self.append_cc(am.narch, self.xflags)
 
@@ -861,7 +861,7 @@ if __name__ == "__main__":
     parser.add_argument("--printf", "-p", action="store_true",
         help="print formatted .csv file contents")
     parser.add_argument("--modes", "-m", type=str, nargs='+',
-        choices=RV32_MODES + SBT.modes, default=SBT_MODES)
+        choices=RV32_MODES + SBT.all_modes(), default=SBT_MODES)
     parser.add_argument("--columns", "-c", type=int, nargs='+',
         choices=ALL_COLUMNS, default=ALL_COLUMNS)
     parser.add_argument("--xform", "-x", action="store_true",
@@ -890,6 +890,10 @@ if __name__ == "__main__":
     if opts.rv32:
         opts.perf_libc = False
         ALL_MODES = RV32_MODES
+    # translator option modes: .csv has the given modes only
+    elif [mode for mode in opts.modes if mode not in SBT_MODES]:
+        ALL_MODES = ["native"] + [mode for mode in opts.modes
+                if mode != "native"]
     else:
         ALL_MODES = SBT_MODES
 
@@ -1,7 +1,7 @@
 #!/usr/bin/env python3
 
 from auto.build import Builder, BuildOpts, LLVMBuilder
-from auto.config import DIR, RV32_LINUX, SBT
+from auto.config import DIR, LLC_PIC, RV32_LINUX, SBT, X86
 from auto.utils import cat, chsuf, mkdir_if_needed, path, shell
 
 import argparse
@@ -12,13 +12,21 @@ class Translator:
 
 
     def _translate_obj(self, dir, obj, out):
-        """ .o -> .bc """
+        """ .o -> .bc (or host .o, with -emit-obj) """
 
         opts = self.opts
         arch = opts.arch
         ipath = path(dir, obj)
         opath = path(dir, out)
         flags = cat(SBT.flags, opts.sbtflags)
+        if self._emit_obj():
+            if opts.xopt:
+                flags = cat(flags, "-xopt")
+            # default host is the (32-bit) x86 one
+            if arch != X86:
+                flags = cat(flags, "-host-triple", arch.triple)
+            if LLC_PIC in arch.llcflags:
+                flags = cat(flags, "-host-pic")
 
         if opts.xdbg:
             # strip arch prefix
@@ -44,6 +52,10 @@ class Translator:
         shell(cmd)
 
 
+    def _emit_obj(self):
+        return "-emit-obj" in self.opts.sbtflags.split()
+
+
     def translate(self):
         """ .o -> bin """
 
@@ -52,6 +64,14 @@ class Translator:
         dstdir = opts.dstdir
         out = opts.out
 
+        # translate and compile obj to host .o, in process
+        if self._emit_obj():
+            o = out + ".o"
+            self._translate_obj(dstdir, obj, o)
+            bld = Builder(opts)
+            bld._link(dstdir, dstdir, [o], out)
+            return
+
         bc = out + ".bc"
         s = out + ".s"
 
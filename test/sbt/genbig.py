@@ -0,0 +1,78 @@
+#!/usr/bin/env python3
+
+# Generate a big RV32 assembly file, with lots of functions and basic blocks,
+# to benchmark the translator itself (not the translated code).
+
+import argparse
+import sys
+
+FUNC = """\
+.global f{i}
+.type f{i},@function
+f{i}:
+    mv s1, ra
+    li t0, {n}
+1:
+    addi t0, t0, -1
+    beqz a0, 2f
+    addi a0, a0, 1
+2:
+    bnez t0, 1b
+{call}\
+    mv ra, s1
+    ret
+
+"""
+
+MAIN = """\
+.global main
+.type main,@function
+main:
+    mv s2, ra
+    li a0, 0
+    call f0
+    mv ra, s2
+    li a0, 0
+    ret
+"""
+
+# function with code pointers to each of its BBs stored in data,
+# as in jump tables
+PTRS = """\
+.global ptrs
+.type ptrs,@function
+ptrs:
+{bbs}\
+    ret
+
+.data
+.align 2
+ptrs_table:
+{words}
+.text
+
+"""
+
+def gen(out, nfuncs, nptrs):
+    out.write(".text\n\n")
+    for i in range(nfuncs):
+        call = "    call f{}\n".format(i + 1) if i + 1 < nfuncs else ""
+        out.write(FUNC.format(i=i, n=i % 8 + 1, call=call))
+    if nptrs:
+        bbs = "".join(["ptr{}:\n    addi a0, a0, {}\n".format(i, i % 8)
+            for i in range(nptrs)])
+        words = "\n".join(["    .word ptr{}".format(i)
+            for i in range(nptrs)])
+        out.write(PTRS.format(bbs=bbs, words=words))
+    out.write(MAIN)
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(
+        description="generate big RV32 assembly file")
+    parser.add_argument("nfuncs", type=int, help="number of functions")
+    parser.add_argument("--code-ptrs", type=int, default=0,
+        help="number of code pointers stored in data")
+    args = parser.parse_args()
+
+    gen(sys.stdout, args.nfuncs, args.code_ptrs)
@@ -92,7 +92,8 @@ class Tests():
         self.srcdir = path(DIR.top, "test/sbt")
         self.dstdir = path(DIR.build, "test/sbt")
         self.sbtdir = path(DIR.top, "sbt")
-        self.modes = SBT.modes
+        # register modes and translator option modes
+        self.modes = SBT.all_modes()
         self.txt = ''
 
 
@@ -193,7 +194,7 @@ x86-fp128-run:
                 bins.append(ARM.add_prefix(name))
 
             farch, narch = RV32_LINUX, ARM
-            for mode in SBT.modes:
+            for mode in self.modes:
                 am = ArchAndMode(farch, narch, mode)
                 bins.append(am.bin(name))
 
@@ -216,7 +217,10 @@ x86-fp128-run:
                 bflags=bflags, sbtflags=sbtflags),
             self._module("printf", "printf.c", rflags=rflags,
                 bflags=bflags, sbtflags=sbtflags),
-            self._module("ex", "ex.c", rflags=rflags, bflags=bflags, dbg=False)
+            self._module("ex", "ex.c", rflags=rflags, bflags=bflags, dbg=False),
+            self._module("icall", "icall.c",
+                bflags='--cflags="-DN=100" ' + bflags, rflags=rflags,
+                sbtflags=sbtflags)
         ]
 
         names = []
@@ -394,11 +398,12 @@ rv32tests_status:
                 return ["-soft-float-abi"]
             return []
 
+        # register modes only
         def modes(test):
             if test in ["jal", "jalr"]:
                 return ["globals", "locals"]
             else:
-                return None
+                return SBT.modes
 
         for test in tests:
             name = test
@@ -432,9 +437,14 @@ rv32tests-clean:
     def gen_epilogue(self):
         fmtdata = {
             "top":      DIR.top,
+            "build":    TOOLS.build,
             "srcdir":   self.srcdir,
             "dstdir":   self.dstdir,
             "measure":  path(DIR.auto, "measure.py"),
+            "xlate":    TOOLS.xlate,
+            "run":      TOOLS.run,
+            "as":       RV32_LINUX._as,
+            "as_flags": RV32_LINUX.as_flags,
             "arm-copy": "ssh-copy" if GOPTS.ssh_copy() else "adb-copy"
         }
 
@@ -449,11 +459,101 @@ basic-test:
 setmsr:
 \tsudo {top}/scripts/setmsr.sh
 
+### translation cache (-cache-dir)
+
+CACHE_DIR := {dstdir}/cache
+CACHE_XLATE := riscv-sbt -cache-dir $(CACHE_DIR) -o {dstdir}/rv32-mm-cache.bc
+
+{dstdir}/rv32-mm-rows5.o: {srcdir}/mm.c
+\t{build} --arch rv32-linux --srcdir {srcdir} --dstdir {dstdir} mm.c \
+    -o rv32-mm-rows5 --cflags="-DROWS=5" --sbtobjs=runtime --dbg
+
+.PHONY: cache-test
+cache-test: rv32-mm {dstdir}/rv32-mm-rows5.o
+\trm -rf $(CACHE_DIR)
+\t# first translation: stores only
+\t$(CACHE_XLATE) {dstdir}/rv32-mm.o | grep "translation cache: hits=0, .*stores=[1-9]"
+\t# same input and options: hits
+\t$(CACHE_XLATE) {dstdir}/rv32-mm.o | grep "translation cache: hits=[1-9]"
+\t# other options: misses
+\t$(CACHE_XLATE) -regs=locals {dstdir}/rv32-mm.o | grep "translation cache: hits=0,"
+\t# other input: misses
+\t$(CACHE_XLATE) {dstdir}/rv32-mm-rows5.o | grep "translation cache: hits=0,"
+
 ### matrix multiply test
 
 mmm:
 \t{measure} --no-perf --no-csv {dstdir} mm
 
+### indirect call microbenchmark (sort comparators, bit count function table)
+
+icallm:
+\t{measure} --no-perf --no-csv {dstdir} icall
+
+### profile guided translation round trip (-profile-gen, -profile-use)
+
+PROF_XLATE := {xlate} --arch x86 --srcdir {srcdir} --dstdir {dstdir} \
+    rv32-icall.o --sbtobjs=runtime
+PROF_RUN := {run} --arch x86 --dir {dstdir}
+PROF := {dstdir}/rv32-icall.prof
+
+.PHONY: profile-test
+profile-test: rv32-icall rv32-icall-run
+\trm -f $(PROF)
+\t$(PROF_XLATE) -o rv32-x86-icall-profgen \
+    --sbtflags " -regs=globals -profile-gen"
+\tSBT_PROFILE=$(PROF) $(PROF_RUN) rv32-x86-icall-profgen \
+    -o rv32-x86-icall-profgen.out
+\tdiff {dstdir}/rv32-icall.out {dstdir}/rv32-x86-icall-profgen.out
+\tgrep -q "^i " $(PROF)
+\t$(PROF_XLATE) -o rv32-x86-icall-profuse \
+    --sbtflags " -regs=globals -profile-use $(PROF)"
+\t$(PROF_RUN) rv32-x86-icall-profuse -o rv32-x86-icall-profuse.out
+\tdiff {dstdir}/rv32-icall.out {dstdir}/rv32-x86-icall-profuse.out
+\t# the profile must have been applied
+\tgrep -q "function_entry_count" {dstdir}/rv32-x86-icall-profuse.ll
+\tgrep -q "branch_weights" {dstdir}/rv32-x86-icall-profuse.ll
+
+### translator startup time (hello world)
+
+.PHONY: xlate-startup
+xlate-startup: hello
+\tbash -c "time riscv-sbt -stats -o {dstdir}/rv32-hello-startup.bc {dstdir}/rv32-hello.o"
+
+### translator benchmark (100k functions, 400k+ basic blocks)
+
+XLATE_BENCH_FUNCS := 100000
+
+{dstdir}/rv32-big.s: {srcdir}/genbig.py
+\tmkdir -p {dstdir}
+\t{srcdir}/genbig.py $(XLATE_BENCH_FUNCS) > $@
+
+{dstdir}/rv32-big.o: {dstdir}/rv32-big.s
+\t{as} {as_flags} $< -o $@
+
+.PHONY: xlate-bench
+xlate-bench: {dstdir}/rv32-big.o
+\tbash -c "time riscv-sbt -stats -o {dstdir}/rv32-big.bc {dstdir}/rv32-big.o"
+
+.PHONY: decoder-bench
+decoder-bench: {dstdir}/rv32-big.o
+\triscv-sbt -decoder-bench -check-decoder -o {dstdir}/rv32-big.bc {dstdir}/rv32-big.o
+
+### translator benchmark (50k code pointers in data)
+
+XLATE_BENCH_PTRS := 50000
+
+{dstdir}/rv32-big-ptrs.s: {srcdir}/genbig.py
+\tmkdir -p {dstdir}
+\t{srcdir}/genbig.py 1 --code-ptrs $(XLATE_BENCH_PTRS) > $@
+
+{dstdir}/rv32-big-ptrs.o: {dstdir}/rv32-big-ptrs.s
+\t{as} {as_flags} $< -o $@
+
+.PHONY: xlate-bench-ptrs
+xlate-bench-ptrs: {dstdir}/rv32-big-ptrs.o
+\tbash -c "time riscv-sbt -stats -o {dstdir}/rv32-big-ptrs.bc {dstdir}/rv32-big-ptrs.o"
+
 ### everything ###
 
 clean:
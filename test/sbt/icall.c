@@ -0,0 +1,153 @@
+#include <stdio.h>
+
+#ifndef N
+#   define N    100000
+#endif
+
+// number of times each bit counting function is called, per element
+#define REPS    8
+
+// function pointer heavy code: a sort with a comparator,
+// and a table of bit counting functions
+
+static unsigned data[N];
+
+static void init()
+{
+    unsigned x = 12345;
+    int i;
+
+    for (i = 0; i < N; i++) {
+        x = x * 1103515245 + 12345;
+        data[i] = x;
+    }
+}
+
+typedef int (*cmp_fn)(unsigned a, unsigned b);
+
+static int cmp_asc(unsigned a, unsigned b)
+{
+    return a < b? -1 : a > b? 1 : 0;
+}
+
+static int cmp_desc(unsigned a, unsigned b)
+{
+    return cmp_asc(b, a);
+}
+
+static void sort(unsigned *v, int lo, int hi, cmp_fn cmp)
+{
+    while (lo < hi) {
+        unsigned pivot = v[lo + (hi - lo) / 2];
+        int i = lo;
+        int j = hi;
+
+        while (i <= j) {
+            while (cmp(v[i], pivot) < 0)
+                i++;
+            while (cmp(v[j], pivot) > 0)
+                j--;
+            if (i <= j) {
+                unsigned t = v[i];
+                v[i] = v[j];
+                v[j] = t;
+                i++;
+                j--;
+            }
+        }
+
+        // recurse on the smaller part
+        if (j - lo < hi - i) {
+            sort(v, lo, j, cmp);
+            lo = i;
+        } else {
+            sort(v, i, hi, cmp);
+            hi = j;
+        }
+    }
+}
+
+static int sorted(const unsigned *v, int n, cmp_fn cmp)
+{
+    int i;
+
+    for (i = 1; i < n; i++)
+        if (cmp(v[i - 1], v[i]) > 0)
+            return 0;
+    return 1;
+}
+
+typedef int (*bitcount_fn)(unsigned x);
+
+static int bc_loop(unsigned x)
+{
+    int n = 0;
+
+    for (; x; x >>= 1)
+        n += x & 1;
+    return n;
+}
+
+static int bc_sparse(unsigned x)
+{
+    int n = 0;
+
+    for (; x; x &= x - 1)
+        n++;
+    return n;
+}
+
+static const char nibbles[16] = {
+    0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4
+};
+
+static int bc_nibble(unsigned x)
+{
+    int n = 0;
+
+    for (; x; x >>= 4)
+        n += nibbles[x & 0xf];
+    return n;
+}
+
+static int bc_parallel(unsigned x)
+{
+    x = x - ((x >> 1) & 0x55555555);
+    x = (x & 0x33333333) + ((x >> 2) & 0x33333333);
+    x = (x + (x >> 4)) & 0x0f0f0f0f;
+    return (x * 0x01010101) >> 24;
+}
+
+static bitcount_fn bitcounts[] = {
+    bc_loop,
+    bc_sparse,
+    bc_nibble,
+    bc_parallel
+};
+
+#define NBITCOUNTS  (sizeof(bitcounts) / sizeof(bitcounts[0]))
+
+int main()
+{
+    unsigned i;
+    unsigned j;
+    unsigned k;
+    unsigned bits[NBITCOUNTS] = { 0 };
+
+    init();
+
+    for (j = 0; j < NBITCOUNTS; j++)
+        for (k = 0; k < REPS; k++)
+            for (i = 0; i < N; i++)
+                bits[j] += bitcounts[j](data[i] + k);
+
+    for (j = 0; j < NBITCOUNTS; j++)
+        printf("bitcount[%u]: %u\n", j, bits[j]);
+
+    sort(data, 0, N - 1, cmp_asc);
+    printf("ascending: %s\n", sorted(data, N, cmp_asc)? "ok" : "FAILED");
+    sort(data, 0, N - 1, cmp_desc);
+    printf("descending: %s\n", sorted(data, N, cmp_desc)? "ok" : "FAILED");
+
+    return 0;
+}